@@ -0,0 +1,168 @@
+#include "animation.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tracer/animation.hpp>
+#include <tracer/renderer.hpp>
+#include <tracer/scene.hpp>
+#include <tracer/stream.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "options.hpp"
+
+namespace cli {
+
+namespace {
+
+// Bounded queue connecting two pipeline stages. The producer blocks while it is full, which keeps the number of
+// frames in flight, and so the memory used, bounded when the later stages fall behind.
+template<typename T> class Channel
+{
+public:
+    explicit Channel(usize capacity) : _capacity{ capacity } {}
+
+    auto push(T value) -> void
+    {
+        auto lock = std::unique_lock{ _mutex };
+        _condition.wait(lock, [&] { return _values.size() < _capacity; });
+        _values.push_back(std::move(value));
+        _condition.notify_all();
+    }
+
+    // Blocks until a value is available. Returns std::nullopt once the channel is closed and drained.
+    [[nodiscard]] auto pop() -> std::optional<T>
+    {
+        auto lock = std::unique_lock{ _mutex };
+        _condition.wait(lock, [&] { return !_values.empty() || _closed; });
+
+        if (_values.empty())
+            return std::nullopt;
+
+        auto value = std::move(_values.front());
+        _values.pop_front();
+        _condition.notify_all();
+        return value;
+    }
+
+    auto close() -> void
+    {
+        auto lock = std::scoped_lock{ _mutex };
+        _closed = true;
+        _condition.notify_all();
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<T> _values;
+    usize _capacity;
+    bool _closed{ false };
+};
+
+struct TracedFrame
+{
+    usize frame{ 0 };
+    tracer::Image image{};
+};
+
+struct EncodedFrame
+{
+    usize frame{ 0 };
+    std::vector<u8> data{};
+};
+
+} // namespace
+
+auto render_animation(const Options& options, const std::string& scene_text) -> bool
+{
+    auto scene = tracer::parse_scene(scene_text);
+
+    if (!scene)
+    {
+        spdlog::critical("Invalid scene.");
+        return false;
+    }
+
+    if (scene->accelerator() != options.accelerator)
+        scene->set_accelerator(options.accelerator);
+
+    auto animation_text = tracer::load_scene_text(options.animation);
+    auto animation = animation_text ? tracer::parse_animation(*animation_text, scene->objects().size()) : std::nullopt;
+
+    if (!animation)
+    {
+        spdlog::critical("Failed to read a valid animation from {}.", options.animation.string());
+        return false;
+    }
+
+    const auto base_objects = std::vector<std::shared_ptr<const tracer::Object>>{ scene->objects().begin(),
+                                                                                  scene->objects().end() };
+
+    auto traced = Channel<TracedFrame>{ 1 };
+    auto encoded = Channel<EncodedFrame>{ 1 };
+    auto write_failed = std::atomic<bool>{ false };
+
+    auto encoder = std::jthread{ [&] {
+        while (auto frame = traced.pop())
+            encoded.push(EncodedFrame{ .frame = frame->frame, .data = tracer::encode_ppm(frame->image) });
+
+        encoded.close();
+    } };
+
+    auto writer = std::jthread{ [&] {
+        while (auto frame = encoded.pop())
+        {
+            auto path = numbered_output(options, frame->frame);
+
+            if (!tracer::write_file(path, frame->data))
+            {
+                spdlog::error("Failed to write {}.", path.string());
+                write_failed = true;
+            }
+        }
+    } };
+
+    spdlog::info("Rendering frames {} to {} at {}x{}.", animation->first_frame, animation->last_frame, options.width,
+                 options.height);
+
+    for (auto frame = animation->first_frame; frame <= animation->last_frame && !write_failed; frame++)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        if (!animation->object_tracks.empty())
+            scene->update(animation->objects_at(frame, base_objects));
+
+        auto image = tracer::Image{ options.width, options.height };
+        auto view = tracer::BatchView{
+            .image = image,
+            .camera = animation->camera_at(frame, options.camera),
+            .render_params = options.render_params,
+        };
+
+        tracer::render_batch(std::span{ &view, 1 }, *scene, options.batch_params);
+        traced.push(TracedFrame{ .frame = frame, .image = std::move(image) });
+
+        auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+        spdlog::info("Traced frame {} in {:.4f}s.", frame, elapsed.count());
+    }
+
+    traced.close();
+    encoder.join();
+    writer.join();
+
+    return !write_failed;
+}
+
+} // namespace cli
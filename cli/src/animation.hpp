@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+#include "options.hpp"
+
+namespace cli {
+
+// Renders every frame of options.animation to numbered output files. Frames are traced one after another using every
+// thread, while finished frames are encoded and written by two more threads, so the sequence is only as slow as its
+// tracing. Moving objects refit the scene's BVH between frames instead of rebuilding it.
+[[nodiscard]] auto render_animation(const Options& options, const std::string& scene_text) -> bool;
+
+} // namespace cli
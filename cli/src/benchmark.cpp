@@ -0,0 +1,481 @@
+#include "benchmark.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+#include <spdlog/spdlog.h>
+#include <tracer/aabb.hpp>
+#include <tracer/accumulation.hpp>
+#include <tracer/cpu.hpp>
+#include <tracer/material.hpp>
+#include <tracer/numeric.hpp>
+#include <tracer/object.hpp>
+#include <tracer/random.hpp>
+#include <tracer/ray.hpp>
+#include <tracer/ray_sort.hpp>
+#include <tracer/renderer.hpp>
+#include <tracer/scene.hpp>
+#include <tracer/stream.hpp>
+#include <tracer/topology.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "options.hpp"
+
+namespace cli {
+
+namespace {
+
+constexpr u64 benchmark_seed = 0x5eed;
+
+// Image the shading benchmark renders, small enough to repeat a few times and keep the fastest run.
+constexpr usize shading_width = 160;
+constexpr usize shading_height = 90;
+constexpr usize shading_samples = 4;
+constexpr usize shading_runs = 3;
+
+// Frame the kernels of every instruction set resolve and convert, keeping the fastest of a few runs.
+constexpr usize kernel_width = 1920;
+constexpr usize kernel_height = 1080;
+constexpr usize kernel_runs = 10;
+
+// Frame the scaling benchmark renders in tiles across threads.
+constexpr usize scaling_width = 320;
+constexpr usize scaling_height = 180;
+constexpr usize scaling_samples = 4;
+
+// How much slower all-diffuse shading may get once the material table holds other kinds of materials too.
+constexpr double max_material_overhead = 1.05;
+
+struct RaySet
+{
+    std::string_view name;
+    std::vector<tracer::Ray> rays;
+};
+
+[[nodiscard]] auto generate_spheres(usize count) -> tracer::Scene
+{
+    auto random = tracer::Random{ benchmark_seed };
+    auto objects = std::vector<std::shared_ptr<const tracer::Object>>{};
+    objects.reserve(count);
+
+    for (usize i = 0; i < count; i++)
+    {
+        auto center = random.get_dvec3(-10.0, 10.0) - glm::dvec3{ 0.0, 0.0, 12.0 };
+        objects.push_back(std::make_shared<tracer::Sphere>(center, random.get_double(0.01, 0.1)));
+    }
+
+    return tracer::Scene{ std::move(objects) };
+}
+
+// Coherent rays from the camera through the image plane.
+[[nodiscard]] auto camera_rays(const Options& options, usize count) -> std::vector<tracer::Ray>
+{
+    auto random = tracer::Random{ benchmark_seed };
+    auto rays = std::vector<tracer::Ray>{};
+    rays.reserve(count);
+
+    const auto aspect_ratio = static_cast<double>(options.width) / static_cast<double>(options.height);
+
+    for (usize i = 0; i < count; i++)
+    {
+        auto target = glm::dvec3{ random.get_double(-aspect_ratio, aspect_ratio), random.get_double(-1.0, 1.0),
+                                  -options.camera.focal_length };
+        rays.emplace_back(options.camera.position, glm::normalize(target));
+    }
+
+    return rays;
+}
+
+// Incoherent rays starting anywhere in the scene, like bounces are.
+[[nodiscard]] auto scattered_rays(const tracer::Aabb& bounds, usize count) -> std::vector<tracer::Ray>
+{
+    auto random = tracer::Random{ benchmark_seed + 1 };
+    auto rays = std::vector<tracer::Ray>{};
+    rays.reserve(count);
+
+    for (usize i = 0; i < count; i++)
+    {
+        auto origin = bounds.min + glm::dvec3{ random.get_double(), random.get_double(), random.get_double() }
+                                       * bounds.extent();
+        rays.emplace_back(origin, random.get_unit_dvec3());
+    }
+
+    return rays;
+}
+
+// The same rays, reordered so that rays starting near each other and pointing the same way are traced back to back.
+[[nodiscard]] auto sorted_rays(std::span<const tracer::Ray> rays, const tracer::Aabb& bounds)
+    -> std::vector<tracer::Ray>
+{
+    auto keys = std::vector<u64>{};
+    keys.reserve(rays.size());
+
+    for (const auto& ray : rays)
+        keys.push_back(tracer::ray_sort_key(ray, bounds));
+
+    auto sorter = tracer::RaySorter{};
+    auto sorted = std::vector<tracer::Ray>{};
+    sorted.reserve(rays.size());
+
+    for (auto index : sorter.sort(keys))
+        sorted.push_back(rays[index]);
+
+    return sorted;
+}
+
+// A table of the given size with nothing but the default diffuse material, so that every hit shades as diffuse.
+[[nodiscard]] auto diffuse_materials(usize count) -> tracer::MaterialTable
+{
+    auto materials = tracer::MaterialTable{};
+
+    while (materials.size() < count)
+        materials.add(tracer::Material{});
+
+    return materials;
+}
+
+// Seconds the fastest of a few renders of the scene took.
+[[nodiscard]] auto time_shading(const Options& options, const tracer::Scene& scene, tracer::Pipeline pipeline)
+    -> double
+{
+    auto image = tracer::Image{ shading_width, shading_height };
+    auto render_params = options.render_params;
+    render_params.samples = shading_samples;
+    render_params.pipeline = pipeline;
+
+    auto best = std::numeric_limits<double>::max();
+
+    for (usize run = 0; run < shading_runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        tracer::render(image, scene, options.camera, render_params);
+        best = std::min(best, std::chrono::duration<double>{ std::chrono::steady_clock::now() - start }.count());
+    }
+
+    return best;
+}
+
+// Renders the scene with every material replaced by diffuse, once with a table of only diffuse materials and once
+// with unused materials of every other kind appended. The hot all-diffuse path must not pay for materials it does not
+// hit.
+auto run_shading_benchmark(const Options& options, const tracer::Scene& scene) -> void
+{
+    const auto objects = std::vector<std::shared_ptr<const tracer::Object>>{ scene.objects().begin(),
+                                                                              scene.objects().end() };
+
+    auto mixed_materials = diffuse_materials(scene.materials().size());
+    mixed_materials.add(tracer::Material::metal(glm::vec3{ 0.8f }, 0.1f));
+    mixed_materials.add(tracer::Material::dielectric(1.5f));
+    mixed_materials.add(tracer::Material::emissive(glm::vec3{ 1.0f }));
+
+    const auto diffuse = tracer::Scene{ objects, diffuse_materials(scene.materials().size()) };
+    const auto mixed = tracer::Scene{ objects, std::move(mixed_materials) };
+
+    constexpr auto pipelines = std::array{
+        std::pair{ tracer::Pipeline::Megakernel, std::string_view{ "megakernel" } },
+        std::pair{ tracer::Pipeline::Wavefront, std::string_view{ "wavefront" } },
+    };
+
+    spdlog::info("All-diffuse shading, {}x{} at {} samples:", shading_width, shading_height, shading_samples);
+
+    for (const auto& [pipeline, name] : pipelines)
+    {
+        const auto diffuse_time = time_shading(options, diffuse, pipeline);
+        const auto mixed_time = time_shading(options, mixed, pipeline);
+        const auto samples = static_cast<double>(shading_width * shading_height * shading_samples);
+
+        spdlog::info("  {:>10}: {:8.3f} Msamples/s, {:8.3f} Msamples/s with every material kind in the table", name,
+                     samples / diffuse_time / 1e6, samples / mixed_time / 1e6);
+
+        if (mixed_time > max_material_overhead * diffuse_time)
+        {
+            spdlog::warn("  {:>10}: unused materials slow down diffuse shading by {:.1f}%.", name,
+                         (mixed_time / diffuse_time - 1.0) * 100.0);
+        }
+    }
+}
+
+struct ScalingSetup
+{
+    std::string_view name;
+    usize thread_count{ 0 };
+    tracer::TileOrder tile_order{ tracer::TileOrder::Hilbert };
+    bool replicate_scene{ false };
+};
+
+// Renders a frame in tiles on one thread, then pinned on every CPU of the first NUMA node and on every CPU of all of
+// them, and reports the speedup over one thread. Across nodes, also with a copy of the scene on every node and with
+// tiles in row-major order, to show what locality buys.
+auto run_scaling_benchmark(const Options& options, const tracer::Scene& scene) -> void
+{
+    const auto nodes = tracer::numa_nodes();
+    const auto node_threads = nodes.front().cpus.size();
+    usize all_threads = 0;
+
+    for (const auto& node : nodes)
+        all_threads += node.cpus.size();
+
+    auto setups = std::vector<ScalingSetup>{ ScalingSetup{ .name = "one thread", .thread_count = 1 } };
+
+    if (nodes.size() > 1)
+        setups.push_back(ScalingSetup{ .name = "first node", .thread_count = node_threads });
+
+    setups.push_back(ScalingSetup{ .name = "all nodes", .thread_count = all_threads });
+
+    if (nodes.size() > 1)
+    {
+        setups.push_back(
+            ScalingSetup{ .name = "all nodes, replicas", .thread_count = all_threads, .replicate_scene = true });
+    }
+
+    setups.push_back(ScalingSetup{
+        .name = "all nodes, row-major", .thread_count = all_threads, .tile_order = tracer::TileOrder::RowMajor });
+
+    auto image = tracer::Image{ scaling_width, scaling_height };
+    auto view = tracer::BatchView{ .image = image, .camera = options.camera, .render_params = options.render_params };
+    view.render_params.samples = scaling_samples;
+
+    const auto samples = static_cast<double>(scaling_width * scaling_height * scaling_samples);
+    auto single_thread_time = 0.0;
+
+    spdlog::info("Scaling over {} NUMA nodes of {} CPUs in all, {}x{} at {} samples:", nodes.size(), all_threads,
+                 scaling_width, scaling_height, scaling_samples);
+
+    for (const auto& setup : setups)
+    {
+        const auto batch_params = tracer::BatchParams{
+            .tile_size = options.batch_params.tile_size,
+            .thread_count = setup.thread_count,
+            .tile_order = setup.tile_order,
+            .pin_threads = setup.thread_count > 1,
+            .replicate_scene = setup.replicate_scene,
+        };
+
+        auto best = std::numeric_limits<double>::max();
+
+        for (usize run = 0; run < shading_runs; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            tracer::render_batch(std::span{ &view, 1 }, scene, batch_params);
+            best = std::min(best, std::chrono::duration<double>{ std::chrono::steady_clock::now() - start }.count());
+        }
+
+        if (setup.thread_count == 1)
+            single_thread_time = best;
+
+        const auto speedup = single_thread_time / best;
+        spdlog::info(
+            "  {:>20}: {:4} threads, {:8.3f} Msamples/s, {:6.2f}x the speed of one thread, {:5.1f}% efficiency",
+            setup.name, setup.thread_count, samples / best / 1e6, speedup,
+            speedup / static_cast<double>(setup.thread_count) * 100.0);
+    }
+}
+
+// Resolves and converts a frame with the kernels of every instruction set the CPU supports, which must all produce the
+// same bytes, then goes back to the kernels that were selected.
+[[nodiscard]] auto run_kernel_benchmark() -> bool
+{
+    auto random = tracer::Random{ benchmark_seed };
+    auto buffer = tracer::AccumulationBuffer{ kernel_width, kernel_height };
+
+    for (usize i = 0; i < buffer.sums().size(); i++)
+    {
+        // Some pixels without samples and some brighter than white, to cover every branch.
+        buffer.sample_counts()[i] = static_cast<u32>(i % 8);
+        buffer.sums()[i] = glm::vec3{ random.get_dvec3(-0.5, 8.0) };
+    }
+
+    constexpr auto instruction_sets = std::array{ tracer::InstructionSet::Baseline, tracer::InstructionSet::Sse42,
+                                                  tracer::InstructionSet::Avx2, tracer::InstructionSet::Avx512 };
+
+    const auto selected = tracer::instruction_set();
+    const auto pixels = static_cast<double>(kernel_width * kernel_height);
+
+    auto image = tracer::Image{ kernel_width, kernel_height };
+    auto reference = std::vector<u8>{};
+    auto success = true;
+
+    spdlog::info("Kernels, {}x{}:", kernel_width, kernel_height);
+
+    for (auto instruction_set : instruction_sets)
+    {
+        if (!tracer::set_instruction_set(instruction_set))
+            continue;
+
+        auto resolve_time = std::numeric_limits<double>::max();
+        auto encode_time = std::numeric_limits<double>::max();
+        auto bytes = std::vector<u8>{};
+
+        for (usize run = 0; run < kernel_runs; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            buffer.resolve(image.view());
+            auto resolved = std::chrono::steady_clock::now();
+            bytes = tracer::encode_ppm(image);
+            auto encoded = std::chrono::steady_clock::now();
+
+            resolve_time = std::min(resolve_time, std::chrono::duration<double>{ resolved - start }.count());
+            encode_time = std::min(encode_time, std::chrono::duration<double>{ encoded - resolved }.count());
+        }
+
+        const auto matches = reference.empty() || bytes == reference;
+
+        if (reference.empty())
+            reference = std::move(bytes);
+
+        spdlog::info("  {:>10}: resolve {:8.1f} Mpixels/s, encode {:8.1f} Mpixels/s{}",
+                     tracer::instruction_set_name(instruction_set), pixels / resolve_time / 1e6,
+                     pixels / encode_time / 1e6, matches ? "" : " (differs from the baseline)");
+
+        success &= matches;
+    }
+
+    [[maybe_unused]] auto restored = tracer::set_instruction_set(selected);
+    return success;
+}
+
+} // namespace
+
+auto run_benchmark(const Options& options, const std::optional<std::string>& scene_text) -> bool
+{
+    auto parse_start = std::chrono::steady_clock::now();
+    auto scene = scene_text ? tracer::parse_scene(*scene_text)
+                            : std::optional<tracer::Scene>{ generate_spheres(options.bench_spheres) };
+
+    if (!scene)
+    {
+        spdlog::critical("Invalid scene.");
+        return false;
+    }
+
+    auto build_time = std::chrono::duration<double, std::milli>{ std::chrono::steady_clock::now() - parse_start };
+    spdlog::info("Running the {} kernels, the CPU supports {}.",
+                 tracer::instruction_set_name(tracer::instruction_set()),
+                 tracer::instruction_set_name(tracer::detect_instruction_set()));
+    spdlog::info("{} objects, scene and binary BVH built in {:.2f}ms.", scene->objects().size(), build_time.count());
+
+    auto scattered = scattered_rays(scene->bvh().bounds(), options.bench_rays);
+
+    auto sort_start = std::chrono::steady_clock::now();
+    auto sorted = sorted_rays(scattered, scene->bvh().bounds());
+    auto sort_time = std::chrono::duration<double>{ std::chrono::steady_clock::now() - sort_start };
+    spdlog::info("Sorted the scattered rays in {:.2f}ms, {:.3f} Mrays/s.", sort_time.count() * 1e3,
+                 static_cast<double>(sorted.size()) / sort_time.count() / 1e6);
+
+    const auto ray_sets = std::array{
+        RaySet{ .name = "camera", .rays = camera_rays(options, options.bench_rays) },
+        RaySet{ .name = "scattered", .rays = std::move(scattered) },
+        RaySet{ .name = "sorted", .rays = std::move(sorted) },
+    };
+
+    constexpr auto accelerators = std::array{
+        std::pair{ tracer::Accelerator::Binary, std::string_view{ "binary BVH" } },
+        std::pair{ tracer::Accelerator::Wide4, std::string_view{ "BVH4" } },
+        std::pair{ tracer::Accelerator::Wide8, std::string_view{ "BVH8" } },
+        std::pair{ tracer::Accelerator::Grid, std::string_view{ "grid" } },
+        std::pair{ tracer::Accelerator::HashedGrid, std::string_view{ "hashed grid" } },
+    };
+
+    auto success = true;
+
+    // Distances found by the first accelerator, which the others have to match, and the fastest accelerator for each
+    // ray set.
+    auto references = std::array<std::vector<double>, ray_sets.size()>{};
+    auto best = std::array<std::pair<double, std::string_view>, ray_sets.size()>{};
+
+    for (const auto& [accelerator, name] : accelerators)
+    {
+        auto build_start = std::chrono::steady_clock::now();
+        scene->set_accelerator(accelerator);
+        auto build_time_ms =
+            std::chrono::duration<double, std::milli>{ std::chrono::steady_clock::now() - build_start }.count();
+        if (accelerator == tracer::Accelerator::Binary)
+            spdlog::info("{}:", name);
+        else
+            spdlog::info("{}: built in {:.2f}ms.", name, build_time_ms);
+
+        for (usize set = 0; set < ray_sets.size(); set++)
+        {
+            const auto& rays = ray_sets[set].rays;
+            auto distances = std::vector<double>{};
+            distances.reserve(rays.size());
+
+            auto start = std::chrono::steady_clock::now();
+
+            for (const auto& ray : rays)
+            {
+                auto hit = scene->closest_hit(ray, tracer::Interval{ .min = 0.001, .max = +tracer::infinity });
+                distances.push_back(hit ? hit->t : -1.0);
+            }
+
+            auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+            auto throughput = static_cast<double>(rays.size()) / elapsed.count() / 1e6;
+
+            usize mismatches = 0;
+
+            if (references[set].empty())
+            {
+                references[set] = std::move(distances);
+            }
+            else
+            {
+                for (usize i = 0; i < rays.size(); i++)
+                {
+                    if (references[set][i] != distances[i])
+                        mismatches++;
+                }
+            }
+
+            spdlog::info("  {:>9} rays: {:8.3f} Mrays/s{}", ray_sets[set].name, throughput,
+                         mismatches != 0 ? " (" + std::to_string(mismatches) + " mismatches)" : std::string{});
+
+            // The same rays as shadow rays, which only ask whether anything is hit.
+            auto occlusion_start = std::chrono::steady_clock::now();
+            usize occlusion_mismatches = 0;
+
+            for (usize i = 0; i < rays.size(); i++)
+            {
+                auto occluded = scene->occluded(rays[i], tracer::Interval{ .min = 0.001, .max = +tracer::infinity });
+
+                if (occluded != (references[set][i] >= 0.0))
+                    occlusion_mismatches++;
+            }
+
+            auto occlusion_elapsed =
+                std::chrono::duration<double>{ std::chrono::steady_clock::now() - occlusion_start };
+            spdlog::info("  {:>9} any-hit: {:8.3f} Mrays/s{}", ray_sets[set].name,
+                         static_cast<double>(rays.size()) / occlusion_elapsed.count() / 1e6,
+                         occlusion_mismatches != 0 ? " (" + std::to_string(occlusion_mismatches) + " mismatches)"
+                                                   : std::string{});
+
+            success &= occlusion_mismatches == 0;
+
+            if (throughput > best[set].first)
+                best[set] = std::pair{ throughput, name };
+
+            success &= mismatches == 0;
+        }
+    }
+
+    for (usize set = 0; set < ray_sets.size(); set++)
+        spdlog::info("Fastest for {} rays: {}.", ray_sets[set].name, best[set].second);
+
+    run_shading_benchmark(options, *scene);
+    run_scaling_benchmark(options, *scene);
+    success &= run_kernel_benchmark();
+
+    return success;
+}
+
+} // namespace cli
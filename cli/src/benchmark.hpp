@@ -0,0 +1,16 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "options.hpp"
+
+namespace cli {
+
+// Times ray queries against every acceleration structure of the scene and checks that they agree, then times
+// all-diffuse shading with and without other kinds of materials in the table and how rendering scales across threads
+// and NUMA nodes, and finally checks and times the kernels of every instruction set the CPU supports. Without a scene,
+// a random field of options.bench_spheres spheres is generated.
+[[nodiscard]] auto run_benchmark(const Options& options, const std::optional<std::string>& scene_text) -> bool;
+
+} // namespace cli
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <tracer/common.hpp>
+
+namespace cli {
+
+// The tracer's aliases, most values the CLI handles are passed on to it.
+using tracer::u8;
+using tracer::u16;
+using tracer::u32;
+using tracer::u64;
+using tracer::usize;
+
+using tracer::i8;
+using tracer::i16;
+using tracer::i32;
+using tracer::i64;
+using tracer::isize;
+
+using tracer::f32;
+using tracer::f64;
+
+} // namespace cli
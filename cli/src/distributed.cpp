@@ -0,0 +1,283 @@
+#include "distributed.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tracer/accumulation.hpp>
+#include <tracer/renderer.hpp>
+#include <tracer/scene.hpp>
+#include <tracer/stream.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "options.hpp"
+#include "protocol.hpp"
+#include "socket.hpp"
+
+namespace cli {
+
+namespace {
+
+constexpr i32 accept_timeout_ms = 100;
+
+class TileQueue
+{
+public:
+    explicit TileQueue(std::vector<tracer::Tile> tiles)
+        : _pending{ tiles.begin(), tiles.end() }, _remaining{ tiles.size() }
+    {}
+
+    // Blocks until a tile is available or every tile has been completed.
+    [[nodiscard]] auto pop() -> std::optional<tracer::Tile>
+    {
+        auto lock = std::unique_lock{ _mutex };
+        _condition.wait(lock, [&] { return !_pending.empty() || _remaining == 0; });
+
+        if (_pending.empty())
+            return std::nullopt;
+
+        auto tile = _pending.front();
+        _pending.pop_front();
+        return tile;
+    }
+
+    auto complete() -> void
+    {
+        auto lock = std::scoped_lock{ _mutex };
+
+        if (--_remaining == 0)
+            _condition.notify_all();
+    }
+
+    auto requeue(const tracer::Tile& tile) -> void
+    {
+        auto lock = std::scoped_lock{ _mutex };
+        _pending.push_back(tile);
+        _condition.notify_one();
+    }
+
+    [[nodiscard]] auto remaining() const -> usize
+    {
+        auto lock = std::scoped_lock{ _mutex };
+        return _remaining;
+    }
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<tracer::Tile> _pending;
+    usize _remaining;
+};
+
+struct SharedAccumulation
+{
+    std::mutex mutex;
+    tracer::AccumulationBuffer buffer;
+};
+
+[[nodiscard]] auto split_into_tiles(usize width, usize height, usize tile_size) -> std::vector<tracer::Tile>
+{
+    auto tiles = std::vector<tracer::Tile>{};
+
+    for (usize y = 0; y < height; y += tile_size)
+    {
+        for (usize x = 0; x < width; x += tile_size)
+        {
+            tiles.push_back(tracer::Tile{
+                .x = x,
+                .y = y,
+                .width = std::min(tile_size, width - x),
+                .height = std::min(tile_size, height - y),
+            });
+        }
+    }
+
+    return tiles;
+}
+
+auto serve_worker(Socket socket, usize worker_id, const PayloadWriter& job, i32 tile_timeout_s, TileQueue& queue,
+                  SharedAccumulation& accumulation) -> void
+{
+    // A worker that hangs would otherwise keep its tile forever, and the frame would never finish.
+    if (!socket.set_receive_timeout(tile_timeout_s * 1000))
+        spdlog::warn("Failed to set a tile timeout for worker {}, it may keep its tiles forever.", worker_id);
+
+    if (!send_message(socket, MessageType::Job, job.bytes()))
+    {
+        spdlog::warn("Worker {} disconnected before receiving the job.", worker_id);
+        return;
+    }
+
+    usize tiles = 0;
+
+    while (auto tile = queue.pop())
+    {
+        auto result = std::optional<TileResult>{};
+
+        if (send_message(socket, MessageType::Tile, encode_tile(*tile).bytes()))
+        {
+            if (auto message = receive_message(socket); message && message->type == MessageType::TileResult)
+                result = decode_tile_result(message->payload);
+        }
+
+        if (!result || result->tile != *tile)
+        {
+            spdlog::warn("Worker {} failed or timed out after {} tiles, handing its tile to the others.", worker_id,
+                         tiles);
+
+            // Tells a worker that is still rendering right away that its result is no longer wanted, and stops
+            // reading a stream that may be out of step.
+            socket.shutdown();
+            queue.requeue(*tile);
+            return;
+        }
+
+        {
+            auto lock = std::scoped_lock{ accumulation.mutex };
+            accumulation.buffer.merge(result->accumulation, result->tile);
+        }
+
+        queue.complete();
+        tiles++;
+    }
+
+    // The frame is finished, it doesn't matter whether the worker still listens.
+    [[maybe_unused]] auto sent = send_message(socket, MessageType::Done);
+    spdlog::info("Worker {} rendered {} tiles.", worker_id, tiles);
+}
+
+} // namespace
+
+auto run_coordinator(const Options& options, const std::string& scene) -> bool
+{
+    auto listener = Socket::listen(options.port);
+
+    if (!listener)
+    {
+        spdlog::critical("Failed to listen on port {}.", options.port);
+        return false;
+    }
+
+    auto job = encode_job(Job{
+        .width = options.width,
+        .height = options.height,
+        .camera = options.camera,
+        .render_params = options.render_params,
+        .scene = scene,
+    });
+
+    auto tiles = split_into_tiles(options.width, options.height, options.tile_size);
+    const auto tile_count = tiles.size();
+    auto queue = TileQueue{ std::move(tiles) };
+    SharedAccumulation accumulation;
+    accumulation.buffer.resize(options.width, options.height);
+
+    spdlog::info("Waiting for workers on port {}, {} tiles to render.", options.port, tile_count);
+
+    auto workers = std::vector<std::jthread>{};
+    auto last_remaining = tile_count;
+
+    while (last_remaining != 0)
+    {
+        if (auto socket = listener->accept(accept_timeout_ms))
+        {
+            spdlog::info("Worker {} connected.", workers.size());
+            workers.emplace_back(serve_worker, std::move(*socket), workers.size(), std::cref(job),
+                                 options.tile_timeout_s, std::ref(queue), std::ref(accumulation));
+        }
+
+        if (auto remaining = queue.remaining(); remaining != last_remaining)
+        {
+            spdlog::info("{}/{} tiles done.", tile_count - remaining, tile_count);
+            last_remaining = remaining;
+        }
+    }
+
+    workers.clear();
+
+    auto image = tracer::Image{ options.width, options.height };
+    accumulation.buffer.resolve(image.view());
+
+    if (!tracer::write_ppm(options.output, image))
+    {
+        spdlog::critical("Failed to write {}.", options.output.string());
+        return false;
+    }
+
+    return true;
+}
+
+auto run_worker(const Options& options) -> bool
+{
+    auto socket = Socket::connect(options.host, options.port);
+
+    if (!socket)
+    {
+        spdlog::critical("Failed to connect to {}:{}.", options.host, options.port);
+        return false;
+    }
+
+    auto job_message = receive_message(*socket);
+    auto job = job_message && job_message->type == MessageType::Job ? decode_job(job_message->payload) : std::nullopt;
+
+    if (!job || !valid_job(*job))
+    {
+        spdlog::critical("Didn't receive a valid job from the coordinator.");
+        return false;
+    }
+
+    auto scene = tracer::parse_scene(job->scene, remote_scene_params(options));
+
+    if (!scene)
+    {
+        spdlog::critical("The coordinator sent an invalid scene.");
+        return false;
+    }
+
+    spdlog::info("Rendering tiles of a {}x{} frame.", job->width, job->height);
+
+    usize tiles = 0;
+
+    while (auto message = receive_message(*socket))
+    {
+        if (message->type == MessageType::Done)
+        {
+            spdlog::info("Done after {} tiles.", tiles);
+            return true;
+        }
+
+        auto tile = message->type == MessageType::Tile ? decode_tile(message->payload) : std::nullopt;
+
+        if (!tile || tile->x + tile->width > job->width || tile->y + tile->height > job->height)
+        {
+            spdlog::critical("The coordinator sent an invalid tile.");
+            return false;
+        }
+
+        auto result = TileResult{
+            .tile = *tile,
+            .accumulation = tracer::AccumulationBuffer{ tile->width, tile->height },
+        };
+
+        tracer::accumulate_tile(result.accumulation, *tile, job->width, job->height, job->render_params.samples,
+                                *scene, job->camera, job->render_params);
+
+        if (!send_message(*socket, MessageType::TileResult, encode_tile_result(result).bytes()))
+            break;
+
+        tiles++;
+    }
+
+    spdlog::critical("Lost the connection to the coordinator.");
+    return false;
+}
+
+} // namespace cli
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "options.hpp"
+
+namespace cli {
+
+// Splits the frame into tiles and hands them out, one at a time, to worker processes connecting on options.port. Fast
+// workers come back for more tiles sooner, which balances the load. If a worker disconnects mid-tile, or doesn't return
+// the tile within options.tile_timeout_s, the tile goes back into the queue for the others.
+[[nodiscard]] auto run_coordinator(const Options& options, const std::string& scene) -> bool;
+
+// Connects to a coordinator and renders tiles until told there are none left.
+[[nodiscard]] auto run_worker(const Options& options) -> bool;
+
+} // namespace cli
@@ -0,0 +1,260 @@
+#include <spdlog/spdlog.h>
+#include <tracer/autotune.hpp>
+#include <tracer/cpu.hpp>
+#include <tracer/defer.hpp>
+#include <tracer/renderer.hpp>
+#include <tracer/scene.hpp>
+#include <tracer/stream.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "animation.hpp"
+#include "benchmark.hpp"
+#include "common.hpp"
+#include "distributed.hpp"
+#include "options.hpp"
+#include "service.hpp"
+#include "socket.hpp"
+
+namespace cli {
+
+namespace {
+
+constexpr auto default_scene = R"(sphere 0.0 0.0 -1.0 0.5
+sphere 0.0 -100.5 -1.0 100.0
+)";
+
+[[nodiscard]] auto render(const Options& options, const std::string& scene_text) -> bool
+{
+    auto scene = tracer::parse_scene(scene_text);
+
+    if (!scene)
+    {
+        spdlog::critical("Invalid scene.");
+        return false;
+    }
+
+    if (scene->accelerator() != options.accelerator)
+        scene->set_accelerator(options.accelerator);
+
+    spdlog::info("Rendering {}x{} image to {}.", options.width, options.height, options.output.string());
+
+    auto stream_params = options.stream_params;
+    stream_params.batch_params = options.batch_params;
+
+    if (!tracer::render_to_file(options.output, options.width, options.height, *scene, options.camera,
+                                options.render_params, stream_params))
+    {
+        spdlog::critical("Failed to write {}.", options.output.string());
+        return false;
+    }
+
+    return true;
+}
+
+// Renders one view per camera position, all of them through the same scene and work queue.
+[[nodiscard]] auto render_batch(const Options& options, const std::string& scene_text) -> bool
+{
+    auto scene = tracer::parse_scene(scene_text);
+
+    if (!scene)
+    {
+        spdlog::critical("Invalid scene.");
+        return false;
+    }
+
+    if (scene->accelerator() != options.accelerator)
+        scene->set_accelerator(options.accelerator);
+
+    if (options.camera_positions.empty())
+    {
+        spdlog::critical("A batch needs at least one --camera.");
+        return false;
+    }
+
+    auto images = std::vector<tracer::Image>{};
+    auto views = std::vector<tracer::BatchView>{};
+    images.reserve(options.camera_positions.size());
+
+    for (const auto& position : options.camera_positions)
+    {
+        auto camera = options.camera;
+        camera.position = position;
+
+        views.push_back(tracer::BatchView{
+            .image = images.emplace_back(options.width, options.height),
+            .camera = camera,
+            .render_params = options.render_params,
+        });
+    }
+
+    spdlog::info("Rendering {} views of {}x{}.", views.size(), options.width, options.height);
+    tracer::render_batch(views, *scene, options.batch_params);
+
+    for (usize i = 0; i < images.size(); i++)
+    {
+        auto path = numbered_output(options, i);
+
+        if (!tracer::write_ppm(path, images[i]))
+        {
+            spdlog::critical("Failed to write {}.", path.string());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Takes the configuration tuned for this machine and scene from the cache, tuning and caching it first if there is
+// none.
+[[nodiscard]] auto apply_tuned_config(Options& options, const std::string& scene_text) -> bool
+{
+    const auto machine_key = tracer::machine_key();
+    const auto scene_key = tracer::scene_key(scene_text);
+    auto entries = tracer::read_tuning_cache(options.tuning_cache);
+    auto config = tracer::find_tuned_config(entries, machine_key, scene_key);
+
+    if (config)
+    {
+        spdlog::info("Using the configuration tuned in {}.", options.tuning_cache.string());
+    }
+    else
+    {
+        auto scene = tracer::parse_scene(scene_text);
+
+        if (!scene)
+        {
+            spdlog::critical("Invalid scene.");
+            return false;
+        }
+
+        // Batches are tuned on their first view.
+        auto camera = options.camera;
+
+        if (!options.camera_positions.empty())
+            camera.position = options.camera_positions.front();
+
+        spdlog::info("Tuning the configuration for this machine and scene.");
+        config = tracer::autotune(*scene, options.width, options.height, camera, options.render_params,
+                                  options.batch_params);
+        entries.push_back(
+            tracer::TuningEntry{ .machine_key = machine_key, .scene_key = scene_key, .config = *config });
+
+        if (!tracer::write_tuning_cache(options.tuning_cache, entries))
+            spdlog::warn("Failed to write {}.", options.tuning_cache.string());
+    }
+
+    if (!tracer::set_instruction_set(config->instruction_set))
+    {
+        spdlog::critical("This CPU does not support {}.", tracer::instruction_set_name(config->instruction_set));
+        return false;
+    }
+
+    options.accelerator = config->accelerator;
+    options.render_params.pipeline = config->pipeline;
+    options.render_params.packet_size = config->packet_size;
+    options.batch_params.tile_size = config->tile_size;
+    options.batch_params.thread_count = config->thread_count;
+
+    spdlog::info(
+        "Tuned configuration: {} accelerator, {} kernels, {} pipeline, packets of {}, tiles of {}, {} threads.",
+        tracer::accelerator_name(config->accelerator), tracer::instruction_set_name(config->instruction_set),
+        tracer::pipeline_name(config->pipeline), config->packet_size, config->tile_size, config->thread_count);
+
+    return true;
+}
+
+auto run(std::span<const char* const> args) -> int
+{
+    tracer::Defer shutdown_spdlog{ [] { spdlog::shutdown(); } };
+
+    auto options = parse_options(args);
+
+    if (!options)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (options->instruction_set && !tracer::set_instruction_set(*options->instruction_set))
+    {
+        spdlog::critical("This CPU does not support {}.", tracer::instruction_set_name(*options->instruction_set));
+        return EXIT_FAILURE;
+    }
+
+    auto scene_text = options->scene.empty() ? std::optional<std::string>{ default_scene }
+                                             : tracer::load_scene_text(options->scene);
+
+    if (!scene_text)
+    {
+        spdlog::critical("Failed to read {}.", options->scene.string());
+        return EXIT_FAILURE;
+    }
+
+    const auto renders_locally = options->command == Command::Render || options->command == Command::Batch
+                                 || options->command == Command::Animate;
+
+    if (!options->tuning_cache.empty() && renders_locally && !apply_tuned_config(*options, *scene_text))
+        return EXIT_FAILURE;
+
+    auto network = NetworkContext{};
+
+    if (!network.initialized())
+    {
+        spdlog::critical("Failed to initialize networking.");
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto success = false;
+
+    switch (options->command)
+    {
+    case Command::Render:
+        success = render(*options, *scene_text);
+        break;
+    case Command::Coordinator:
+        success = run_coordinator(*options, *scene_text);
+        break;
+    case Command::Worker:
+        success = run_worker(*options);
+        break;
+    case Command::Serve:
+        success = run_service(*options);
+        break;
+    case Command::Submit:
+        success = submit_job(*options, *scene_text);
+        break;
+    case Command::Batch:
+        success = render_batch(*options, *scene_text);
+        break;
+    case Command::Animate:
+        success = render_animation(*options, *scene_text);
+        break;
+    case Command::Benchmark:
+        success = run_benchmark(*options, options->scene.empty() ? std::nullopt : scene_text);
+        break;
+    }
+
+    if (!success)
+        return EXIT_FAILURE;
+
+    auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+    spdlog::info("Took {:.4f}s.", elapsed.count());
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+} // namespace cli
+
+auto main(int argc, char** argv) -> int
+{
+    return cli::run(std::span{ argv + 1, static_cast<cli::usize>(argc - 1) });
+}
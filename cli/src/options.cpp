@@ -0,0 +1,336 @@
+#include "options.hpp"
+
+#include <glm/vec3.hpp>
+#include <spdlog/spdlog.h>
+#include <tracer/cpu.hpp>
+#include <tracer/packet.hpp>
+#include <tracer/renderer.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "common.hpp"
+
+namespace cli {
+
+namespace {
+
+template<typename T> [[nodiscard]] auto parse_number(std::string_view text, T& value) -> bool
+{
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size();
+}
+
+// Parses "x,y,z".
+[[nodiscard]] auto parse_position(std::string_view text, glm::dvec3& position) -> bool
+{
+    for (auto axis = 0; axis < 3; axis++)
+    {
+        auto end = axis < 2 ? text.find(',') : text.size();
+
+        if (end == std::string_view::npos || !parse_number(text.substr(0, end), position[axis]))
+            return false;
+
+        text = text.substr(std::min(end + 1, text.size()));
+    }
+
+    return true;
+}
+
+// Timeouts are passed to sockets in milliseconds.
+constexpr i32 max_timeout_s = std::numeric_limits<i32>::max() / 1000;
+
+} // namespace
+
+auto parse_options(std::span<const char* const> args) -> std::optional<Options>
+{
+    auto options = Options{};
+
+    if (!args.empty() && !std::string_view{ args[0] }.starts_with('-'))
+    {
+        auto command = std::string_view{ args[0] };
+
+        if (command == "render")
+        {
+            options.command = Command::Render;
+        }
+        else if (command == "coordinator")
+        {
+            options.command = Command::Coordinator;
+        }
+        else if (command == "worker")
+        {
+            options.command = Command::Worker;
+        }
+        else if (command == "serve")
+        {
+            options.command = Command::Serve;
+        }
+        else if (command == "submit")
+        {
+            options.command = Command::Submit;
+        }
+        else if (command == "batch")
+        {
+            options.command = Command::Batch;
+        }
+        else if (command == "animate")
+        {
+            options.command = Command::Animate;
+        }
+        else if (command == "bench")
+        {
+            options.command = Command::Benchmark;
+        }
+        else
+        {
+            spdlog::error("Unknown command {}.", command);
+            return std::nullopt;
+        }
+
+        args = args.subspan(1);
+    }
+
+    for (usize i = 0; i < args.size(); i++)
+    {
+        auto arg = std::string_view{ args[i] };
+
+        if (i + 1 >= args.size())
+        {
+            spdlog::error("Missing value for option {}.", arg);
+            return std::nullopt;
+        }
+
+        auto value = std::string_view{ args[++i] };
+        auto valid = true;
+
+        if (arg == "--output" || arg == "-o")
+        {
+            options.output = value;
+        }
+        else if (arg == "--scene")
+        {
+            options.scene = value;
+        }
+        else if (arg == "--animation")
+        {
+            options.animation = value;
+        }
+        else if (arg == "--width")
+        {
+            valid = parse_number(value, options.width) && options.width != 0;
+        }
+        else if (arg == "--height")
+        {
+            valid = parse_number(value, options.height) && options.height != 0;
+        }
+        else if (arg == "--samples")
+        {
+            valid = parse_number(value, options.render_params.samples) && options.render_params.samples != 0;
+        }
+        else if (arg == "--max-depth")
+        {
+            valid = parse_number(value, options.render_params.max_depth);
+        }
+        else if (arg == "--packet-size")
+        {
+            valid = parse_number(value, options.render_params.packet_size) && options.render_params.packet_size != 0
+                    && options.render_params.packet_size <= tracer::max_packet_side;
+        }
+        else if (arg == "--pipeline")
+        {
+            if (value == "megakernel")
+                options.render_params.pipeline = tracer::Pipeline::Megakernel;
+            else if (value == "wavefront")
+                options.render_params.pipeline = tracer::Pipeline::Wavefront;
+            else
+                valid = false;
+        }
+        else if (arg == "--sort-rays")
+        {
+            valid = value == "on" || value == "off";
+            options.render_params.sort_rays = value == "on";
+        }
+        else if (arg == "--guiding")
+        {
+            valid = value == "on" || value == "off";
+            options.render_params.guiding = value == "on";
+        }
+        else if (arg == "--focal-length")
+        {
+            valid = parse_number(value, options.camera.focal_length) && options.camera.focal_length != 0.0;
+        }
+        else if (arg == "--working-set-mb")
+        {
+            usize megabytes = 0;
+            valid = parse_number(value, megabytes) && megabytes != 0;
+            options.stream_params.working_set_bytes = megabytes * 1024 * 1024;
+        }
+        else if (arg == "--host")
+        {
+            options.host = value;
+        }
+        else if (arg == "--port")
+        {
+            valid = parse_number(value, options.port);
+        }
+        else if (arg == "--tile-size")
+        {
+            valid = parse_number(value, options.tile_size) && options.tile_size != 0;
+        }
+        else if (arg == "--tile-timeout")
+        {
+            valid = parse_number(value, options.tile_timeout_s) && options.tile_timeout_s > 0
+                    && options.tile_timeout_s <= max_timeout_s;
+        }
+        else if (arg == "--priority")
+        {
+            valid = parse_number(value, options.priority);
+        }
+        else if (arg == "--scene-cache")
+        {
+            valid = parse_number(value, options.scene_cache_size);
+        }
+        else if (arg == "--assets")
+        {
+            options.asset_directory = value;
+        }
+        else if (arg == "--camera")
+        {
+            auto position = glm::dvec3{ 0.0 };
+            valid = parse_position(value, position);
+            options.camera_positions.push_back(position);
+        }
+        else if (arg == "--threads")
+        {
+            valid = parse_number(value, options.batch_params.thread_count);
+        }
+        else if (arg == "--tile-order")
+        {
+            if (value == "row")
+                options.batch_params.tile_order = tracer::TileOrder::RowMajor;
+            else if (value == "morton")
+                options.batch_params.tile_order = tracer::TileOrder::Morton;
+            else if (value == "hilbert")
+                options.batch_params.tile_order = tracer::TileOrder::Hilbert;
+            else
+                valid = false;
+        }
+        else if (arg == "--pin-threads")
+        {
+            valid = value == "on" || value == "off";
+            options.batch_params.pin_threads = value == "on";
+        }
+        else if (arg == "--replicas")
+        {
+            valid = value == "on" || value == "off";
+            options.batch_params.replicate_scene = value == "on";
+        }
+        else if (arg == "--isa")
+        {
+            options.instruction_set = tracer::parse_instruction_set(value);
+            valid = options.instruction_set.has_value();
+        }
+        else if (arg == "--autotune")
+        {
+            options.tuning_cache = value;
+        }
+        else if (arg == "--rays")
+        {
+            valid = parse_number(value, options.bench_rays) && options.bench_rays != 0;
+        }
+        else if (arg == "--spheres")
+        {
+            valid = parse_number(value, options.bench_spheres);
+        }
+        else
+        {
+            spdlog::error("Unknown option {}.", arg);
+            return std::nullopt;
+        }
+
+        if (!valid)
+        {
+            spdlog::error("Invalid value {} for option {}.", value, arg);
+            return std::nullopt;
+        }
+    }
+
+    return options;
+}
+
+auto print_usage() -> void
+{
+    std::cout << "Usage: cli [command] [options]\n"
+                 "\n"
+                 "Commands:\n"
+                 "  render                  Render to a file, streaming tiles to disk (default)\n"
+                 "  coordinator             Split the frame into tiles and hand them out to connected workers\n"
+                 "  worker                  Connect to a coordinator and render the tiles it hands out\n"
+                 "  serve                   Run a local render service that renders submitted jobs by priority\n"
+                 "  submit                  Submit a job to a running render service and wait for the image\n"
+                 "  batch                   Render one image per --camera, sharing the scene and the threads\n"
+                 "  animate                 Render the frames of an --animation, writing them while the next traces\n"
+                 "  bench                   Compare the ray query speed of the acceleration structures\n"
+                 "\n"
+                 "Options:\n"
+                 "  --output, -o <path>     Output PPM file (default: image.ppm)\n"
+                 "  --scene <path>          Scene description file (default: built-in scene)\n"
+                 "  --animation <path>      Animation description file\n"
+                 "  --width <pixels>        Image width (default: 640)\n"
+                 "  --height <pixels>       Image height (default: 360)\n"
+                 "  --samples <count>       Samples per pixel (default: 100)\n"
+                 "  --max-depth <count>     Maximum ray depth (default: 50)\n"
+                 "  --packet-size <pixels>  Side of the pixel blocks traced as ray packets, 1 to 8 (default: 8)\n"
+                 "  --pipeline <name>       megakernel or wavefront (default: megakernel)\n"
+                 "  --sort-rays <on|off>    Sort wavefront bounce rays by direction and origin (default: off)\n"
+                 "  --guiding <on|off>      Guide bounces by the light learnt over progressive passes (default: off)\n"
+                 "  --focal-length <value>  Camera focal length (default: 1.0)\n"
+                 "  --working-set-mb <mb>   Memory budget for pixel data (default: 256)\n"
+                 "  --host <address>        Coordinator or service address (default: 127.0.0.1)\n"
+                 "  --port <port>           Coordinator or service port (default: 7147)\n"
+                 "  --tile-size <pixels>    Size of the tiles handed out to workers (default: 64)\n"
+                 "  --tile-timeout <s>      Time a worker gets to return a tile before it's dropped (default: 600)\n"
+                 "  --priority <value>      Priority of a submitted job, higher renders first (default: 0)\n"
+                 "  --scene-cache <count>   Number of parsed scenes the service keeps warm (default: 8)\n"
+                 "  --assets <path>         Directory received scenes may load files from (default: none)\n"
+                 "  --camera <x,y,z>        Camera position of a batch view, repeatable\n"
+                 "  --threads <count>       Render threads (default: all hardware threads)\n"
+                 "  --tile-order <name>     Batch tile order: row, morton or hilbert (default: hilbert)\n"
+                 "  --pin-threads <on|off>  Pin batch threads to CPUs, spread across NUMA nodes (default: off)\n"
+                 "  --replicas <on|off>     Copy the scene to every NUMA node of the pinned threads (default: off)\n"
+                 "  --isa <name>            Kernels: baseline, sse4.2, avx2 or avx512 (default: newest supported)\n"
+                 "  --autotune <path>       Tune speed settings once per machine and scene, cached in the file\n"
+                 "  --rays <count>          Rays per benchmark ray set (default: 1000000)\n"
+                 "  --spheres <count>       Spheres of the benchmark scene if no --scene is given (default: 100000)\n";
+}
+
+auto remote_scene_params(const Options& options) -> tracer::SceneParseParams
+{
+    return tracer::SceneParseParams{
+        .load_files = !options.asset_directory.empty(),
+        .asset_directory = options.asset_directory,
+    };
+}
+
+auto numbered_output(const Options& options, usize index) -> std::filesystem::path
+{
+    auto number = std::to_string(index);
+
+    if (number.size() < 4)
+        number.insert(0, 4 - number.size(), '0');
+
+    auto path = options.output;
+    path.replace_filename(options.output.stem().string() + "_" + number + options.output.extension().string());
+    return path;
+}
+
+} // namespace cli
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <tracer/cpu.hpp>
+#include <tracer/renderer.hpp>
+#include <tracer/scene.hpp>
+#include <tracer/stream.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+namespace cli {
+
+enum class Command : u8
+{
+    Render,
+    Coordinator,
+    Worker,
+    Serve,
+    Submit,
+    Batch,
+    Animate,
+    Benchmark,
+};
+
+struct Options
+{
+    Command command{ Command::Render };
+    std::filesystem::path output{ "image.ppm" };
+    std::filesystem::path scene{};
+    std::filesystem::path animation{};
+    usize width{ 640 };
+    usize height{ 360 };
+    tracer::Camera camera{};
+    tracer::RenderParams render_params{};
+    tracer::StreamParams stream_params{};
+
+    std::string host{ "127.0.0.1" };
+    u16 port{ 7147 };
+    usize tile_size{ 64 };
+    // A worker that takes longer than this to return a tile is dropped, and the tile handed to the others.
+    i32 tile_timeout_s{ 600 };
+
+    i32 priority{ 0 };
+    usize scene_cache_size{ 8 };
+    // The only directory scenes received by a worker or the service may read files from. Empty lets them read none.
+    std::filesystem::path asset_directory{};
+
+    std::vector<glm::dvec3> camera_positions{};
+    tracer::BatchParams batch_params{};
+
+    std::optional<tracer::InstructionSet> instruction_set{}; // Overrides the detected one.
+    // Where configurations tuned per machine and scene are kept. Empty renders with the options as given.
+    std::filesystem::path tuning_cache{};
+    tracer::Accelerator accelerator{ tracer::Accelerator::Wide8 }; // Of the scenes rendered, set by tuning.
+
+    usize bench_rays{ 1'000'000 };
+    usize bench_spheres{ 100'000 };
+};
+
+// Returns std::nullopt and logs the reason if the arguments are invalid.
+[[nodiscard]] auto parse_options(std::span<const char* const> args) -> std::optional<Options>;
+auto print_usage() -> void;
+
+// How a worker or the service parses scenes it receives over the network.
+[[nodiscard]] auto remote_scene_params(const Options& options) -> tracer::SceneParseParams;
+
+// The output path with index appended to the file name, for commands writing several images.
+[[nodiscard]] auto numbered_output(const Options& options, usize index) -> std::filesystem::path;
+
+} // namespace cli
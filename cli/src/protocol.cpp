@@ -0,0 +1,331 @@
+#include "protocol.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <tracer/accumulation.hpp>
+#include <tracer/packet.hpp>
+#include <tracer/renderer.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "socket.hpp"
+
+namespace cli {
+
+namespace {
+
+struct MessageHeader
+{
+    MessageType type{};
+    u32 reserved{ 0 };
+    u64 size{ 0 };
+};
+
+// Scenes are the only part of a job that can be large.
+constexpr u64 max_scene_size = 256ull * 1024 * 1024;
+constexpr u64 max_error_size = 64ull * 1024;
+// Room for the fields that come with the pixels, text or scene of a payload.
+constexpr u64 max_fields_size = 1024;
+
+// Payloads are received in pieces of at most this size, see receive_message().
+constexpr usize receive_chunk_size = 1024 * 1024;
+
+// Anything bigger than this for a message of the type is treated as a corrupted stream rather than allocated. Only
+// images and tile results can be large, up to the pixels of the largest job.
+[[nodiscard]] auto max_payload_size(MessageType type) -> u64
+{
+    switch (type)
+    {
+    case MessageType::Job:
+    case MessageType::Submit:
+        return max_fields_size + max_scene_size;
+    case MessageType::Tile:
+        return sizeof(tracer::Tile);
+    case MessageType::TileResult:
+        return max_fields_size + u64{ max_job_pixels } * (sizeof(u32) + sizeof(glm::vec3));
+    case MessageType::Done:
+        return 0;
+    case MessageType::Progress:
+        return sizeof(i32);
+    case MessageType::Image:
+        return max_fields_size + u64{ max_job_pixels } * sizeof(glm::vec4);
+    case MessageType::Error:
+        return max_fields_size + max_error_size;
+    }
+
+    return 0;
+}
+
+// Every pixel takes more than a byte, so sizes with more pixels than the payload has bytes are bogus and rejected
+// before allocating for them. Each side is checked on its own first, so that the product can't overflow.
+[[nodiscard]] auto fits_payload(u64 width, u64 height, usize payload_size) -> bool
+{
+    return width <= payload_size && height <= payload_size && (width == 0 || height <= payload_size / width);
+}
+
+} // namespace
+
+auto send_message(Socket& socket, MessageType type, std::span<const std::byte> payload) -> bool
+{
+    auto header = MessageHeader{ .type = type, .reserved = 0, .size = payload.size() };
+    return socket.send_all(std::as_bytes(std::span{ &header, 1 })) && socket.send_all(payload);
+}
+
+auto receive_message(Socket& socket) -> std::optional<Message>
+{
+    auto header = MessageHeader{};
+
+    if (!socket.receive_all(std::as_writable_bytes(std::span{ &header, 1 }))
+        || header.size > max_payload_size(header.type))
+    {
+        return std::nullopt;
+    }
+
+    // Grown as the bytes arrive, so that a header alone can't make the process commit memory for all of its size.
+    auto message = Message{ .type = header.type };
+
+    while (message.payload.size() < header.size)
+    {
+        const auto offset = message.payload.size();
+        message.payload.resize(offset + static_cast<usize>(std::min(header.size - offset, u64{ receive_chunk_size })));
+
+        if (!socket.receive_all(std::span{ message.payload }.subspan(offset)))
+            return std::nullopt;
+    }
+
+    return message;
+}
+
+namespace {
+
+// Field by field, so that enums and bools are sent as plain bytes and checked when read instead of copied into place.
+auto write_render_params(PayloadWriter& writer, const tracer::RenderParams& render_params) -> void
+{
+    writer.write(u64{ render_params.samples });
+    writer.write(u64{ render_params.max_depth });
+    writer.write(render_params.seed);
+    writer.write(u64{ render_params.packet_size });
+    writer.write(std::to_underlying(render_params.pipeline));
+    writer.write(static_cast<u8>(render_params.sort_rays));
+    writer.write(static_cast<u8>(render_params.guiding));
+}
+
+// Rejects packet sizes the renderers have no room for and bytes that are no valid pipeline or bool.
+[[nodiscard]] auto read_render_params(PayloadReader& reader, tracer::RenderParams& render_params) -> bool
+{
+    auto samples = u64{ 0 };
+    auto max_depth = u64{ 0 };
+    auto packet_size = u64{ 0 };
+    auto pipeline = u8{ 0 };
+    auto sort_rays = u8{ 0 };
+    auto guiding = u8{ 0 };
+
+    if (!reader.read(samples) || !reader.read(max_depth) || !reader.read(render_params.seed)
+        || !reader.read(packet_size) || !reader.read(pipeline) || !reader.read(sort_rays) || !reader.read(guiding))
+    {
+        return false;
+    }
+
+    if (packet_size == 0 || packet_size > tracer::max_packet_side
+        || pipeline > std::to_underlying(tracer::Pipeline::Wavefront) || sort_rays > 1 || guiding > 1)
+    {
+        return false;
+    }
+
+    render_params.samples = samples;
+    render_params.max_depth = max_depth;
+    render_params.packet_size = packet_size;
+    render_params.pipeline = static_cast<tracer::Pipeline>(pipeline);
+    render_params.sort_rays = sort_rays != 0;
+    render_params.guiding = guiding != 0;
+    return true;
+}
+
+auto write_job(PayloadWriter& writer, const Job& job) -> void
+{
+    writer.write(u64{ job.width });
+    writer.write(u64{ job.height });
+    writer.write(job.camera);
+    write_render_params(writer, job.render_params);
+    writer.write_string(job.scene);
+}
+
+[[nodiscard]] auto read_job(PayloadReader& reader, Job& job) -> bool
+{
+    auto width = u64{ 0 };
+    auto height = u64{ 0 };
+
+    if (!reader.read(width) || !reader.read(height) || !reader.read(job.camera)
+        || !read_render_params(reader, job.render_params) || !reader.read_string(job.scene))
+    {
+        return false;
+    }
+
+    job.width = width;
+    job.height = height;
+    return true;
+}
+
+} // namespace
+
+auto encode_job(const Job& job) -> PayloadWriter
+{
+    auto writer = PayloadWriter{};
+    write_job(writer, job);
+    return writer;
+}
+
+auto valid_job(const Job& job) -> bool
+{
+    // Divided rather than multiplied, so that the pixel count can't overflow.
+    return job.width != 0 && job.height != 0 && job.width <= max_job_pixels / job.height
+           && job.render_params.samples != 0 && job.camera.focal_length != 0.0;
+}
+
+auto decode_job(std::span<const std::byte> payload) -> std::optional<Job>
+{
+    auto reader = PayloadReader{ payload };
+    auto job = Job{};
+
+    if (!read_job(reader, job) || !reader.empty())
+        return std::nullopt;
+
+    return job;
+}
+
+auto encode_tile(const tracer::Tile& tile) -> PayloadWriter
+{
+    auto writer = PayloadWriter{};
+    writer.write(tile);
+    return writer;
+}
+
+auto decode_tile(std::span<const std::byte> payload) -> std::optional<tracer::Tile>
+{
+    auto reader = PayloadReader{ payload };
+    auto tile = tracer::Tile{};
+
+    if (!reader.read(tile) || !reader.empty())
+        return std::nullopt;
+
+    return tile;
+}
+
+auto encode_tile_result(const TileResult& result) -> PayloadWriter
+{
+    auto writer = PayloadWriter{};
+    writer.write(result.tile);
+    writer.write_span(result.accumulation.sample_counts());
+    writer.write_span(result.accumulation.sums());
+    return writer;
+}
+
+auto decode_tile_result(std::span<const std::byte> payload) -> std::optional<TileResult>
+{
+    auto reader = PayloadReader{ payload };
+    auto result = TileResult{};
+
+    if (!reader.read(result.tile) || !fits_payload(result.tile.width, result.tile.height, payload.size()))
+        return std::nullopt;
+
+    result.accumulation.resize(result.tile.width, result.tile.height);
+
+    if (!reader.read_span(result.accumulation.sample_counts()) || !reader.read_span(result.accumulation.sums())
+        || !reader.empty())
+    {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+auto encode_submission(const Submission& submission) -> PayloadWriter
+{
+    auto writer = PayloadWriter{};
+    writer.write(submission.priority);
+    write_job(writer, submission.job);
+    return writer;
+}
+
+auto decode_submission(std::span<const std::byte> payload) -> std::optional<Submission>
+{
+    auto reader = PayloadReader{ payload };
+    auto submission = Submission{};
+
+    if (!reader.read(submission.priority) || !read_job(reader, submission.job) || !reader.empty())
+        return std::nullopt;
+
+    return submission;
+}
+
+auto encode_progress(i32 progress) -> PayloadWriter
+{
+    auto writer = PayloadWriter{};
+    writer.write(progress);
+    return writer;
+}
+
+auto decode_progress(std::span<const std::byte> payload) -> std::optional<i32>
+{
+    auto reader = PayloadReader{ payload };
+    auto progress = i32{ 0 };
+
+    if (!reader.read(progress) || !reader.empty())
+        return std::nullopt;
+
+    return progress;
+}
+
+auto encode_image(const tracer::Image& image) -> PayloadWriter
+{
+    auto writer = PayloadWriter{};
+    writer.write(u64{ image.width() });
+    writer.write(u64{ image.height() });
+    writer.write_span(image.pixels());
+    return writer;
+}
+
+auto decode_image(std::span<const std::byte> payload) -> std::optional<tracer::Image>
+{
+    auto reader = PayloadReader{ payload };
+    auto width = u64{ 0 };
+    auto height = u64{ 0 };
+
+    if (!reader.read(width) || !reader.read(height) || !fits_payload(width, height, payload.size()))
+        return std::nullopt;
+
+    auto image = tracer::Image{ width, height };
+
+    if (!reader.read_span(image.pixels()) || !reader.empty())
+        return std::nullopt;
+
+    return image;
+}
+
+auto encode_error(std::string_view error) -> PayloadWriter
+{
+    auto writer = PayloadWriter{};
+    writer.write_string(error);
+    return writer;
+}
+
+auto decode_error(std::span<const std::byte> payload) -> std::optional<std::string>
+{
+    auto reader = PayloadReader{ payload };
+    auto error = std::string{};
+
+    if (!reader.read_string(error) || !reader.empty())
+        return std::nullopt;
+
+    return error;
+}
+
+} // namespace cli
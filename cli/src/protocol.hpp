@@ -0,0 +1,175 @@
+#pragma once
+
+#include <tracer/accumulation.hpp>
+#include <tracer/renderer.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "common.hpp"
+#include "socket.hpp"
+
+namespace cli {
+
+// Messages are a header followed by a payload of header.size bytes. Values are sent in native byte order, so every
+// process taking part in a render must run on the same architecture.
+enum class MessageType : u32
+{
+    Job,
+    Tile,
+    TileResult,
+    Done,
+    Submit,
+    Progress,
+    Image,
+    Error,
+};
+
+struct Message
+{
+    MessageType type{};
+    std::vector<std::byte> payload{};
+};
+
+class PayloadWriter
+{
+public:
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    auto write(const T& value) -> void
+    {
+        auto offset = _bytes.size();
+        _bytes.resize(offset + sizeof(T));
+        std::memcpy(_bytes.data() + offset, &value, sizeof(T));
+    }
+
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    auto write_span(std::span<const T> values) -> void
+    {
+        write(u64{ values.size() });
+        auto offset = _bytes.size();
+        _bytes.resize(offset + values.size_bytes());
+        std::memcpy(_bytes.data() + offset, values.data(), values.size_bytes());
+    }
+
+    auto write_string(std::string_view value) -> void { write_span(std::span{ value.data(), value.size() }); }
+
+    [[nodiscard]] auto bytes() const -> std::span<const std::byte> { return _bytes; }
+
+private:
+    std::vector<std::byte> _bytes{};
+};
+
+class PayloadReader
+{
+public:
+    explicit PayloadReader(std::span<const std::byte> bytes) : _bytes{ bytes } {}
+
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    [[nodiscard]] auto read(T& value) -> bool
+    {
+        if (_bytes.size() < sizeof(T))
+            return false;
+
+        std::memcpy(&value, _bytes.data(), sizeof(T));
+        _bytes = _bytes.subspan(sizeof(T));
+        return true;
+    }
+
+    // The number of values sent must match the size of the span exactly.
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    [[nodiscard]] auto read_span(std::span<T> values) -> bool
+    {
+        auto count = u64{ 0 };
+
+        if (!read(count) || count != values.size() || _bytes.size() < values.size_bytes())
+            return false;
+
+        std::memcpy(values.data(), _bytes.data(), values.size_bytes());
+        _bytes = _bytes.subspan(values.size_bytes());
+        return true;
+    }
+
+    [[nodiscard]] auto read_string(std::string& value) -> bool
+    {
+        auto count = u64{ 0 };
+
+        if (!read(count) || _bytes.size() < count)
+            return false;
+
+        value.assign(reinterpret_cast<const char*>(_bytes.data()), count);
+        _bytes = _bytes.subspan(count);
+        return true;
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return _bytes.empty(); }
+
+private:
+    std::span<const std::byte> _bytes;
+};
+
+[[nodiscard]] auto send_message(Socket& socket, MessageType type, std::span<const std::byte> payload = {}) -> bool;
+[[nodiscard]] auto receive_message(Socket& socket) -> std::optional<Message>;
+
+// A frame to render, sent by the coordinator once to every worker that connects.
+struct Job
+{
+    usize width{ 0 };
+    usize height{ 0 };
+    tracer::Camera camera{};
+    tracer::RenderParams render_params{};
+    std::string scene{};
+};
+
+// The accumulated samples of a tile, sent back by a worker.
+struct TileResult
+{
+    tracer::Tile tile{};
+    tracer::AccumulationBuffer accumulation{};
+};
+
+// A job submitted to the render service. Higher priorities are rendered first.
+struct Submission
+{
+    i32 priority{ 0 };
+    Job job{};
+};
+
+// Jobs are at most 16384 x 16384 pixels, or the same area in another shape, so that a job received over the network
+// can't make the process allocate without bound.
+constexpr usize max_job_pixels = usize{ 1 } << 28;
+
+// Whether the job describes an image that can be rendered. Decoding already rejects fields out of their range.
+[[nodiscard]] auto valid_job(const Job& job) -> bool;
+
+[[nodiscard]] auto encode_job(const Job& job) -> PayloadWriter;
+[[nodiscard]] auto decode_job(std::span<const std::byte> payload) -> std::optional<Job>;
+
+[[nodiscard]] auto encode_tile(const tracer::Tile& tile) -> PayloadWriter;
+[[nodiscard]] auto decode_tile(std::span<const std::byte> payload) -> std::optional<tracer::Tile>;
+
+[[nodiscard]] auto encode_tile_result(const TileResult& result) -> PayloadWriter;
+[[nodiscard]] auto decode_tile_result(std::span<const std::byte> payload) -> std::optional<TileResult>;
+
+[[nodiscard]] auto encode_submission(const Submission& submission) -> PayloadWriter;
+[[nodiscard]] auto decode_submission(std::span<const std::byte> payload) -> std::optional<Submission>;
+
+[[nodiscard]] auto encode_progress(i32 progress) -> PayloadWriter;
+[[nodiscard]] auto decode_progress(std::span<const std::byte> payload) -> std::optional<i32>;
+
+[[nodiscard]] auto encode_image(const tracer::Image& image) -> PayloadWriter;
+[[nodiscard]] auto decode_image(std::span<const std::byte> payload) -> std::optional<tracer::Image>;
+
+[[nodiscard]] auto encode_error(std::string_view error) -> PayloadWriter;
+[[nodiscard]] auto decode_error(std::span<const std::byte> payload) -> std::optional<std::string>;
+
+} // namespace cli
@@ -0,0 +1,372 @@
+#include "service.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tracer/accumulation.hpp>
+#include <tracer/renderer.hpp>
+#include <tracer/scene.hpp>
+#include <tracer/stream.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "options.hpp"
+#include "protocol.hpp"
+#include "socket.hpp"
+
+namespace cli {
+
+namespace {
+
+constexpr i32 accept_timeout_ms = 100;
+// Clients send their submission right after connecting, one that doesn't is dropped after this long.
+constexpr i32 submission_timeout_ms = 10'000;
+
+// Set by the handler of SIGINT and SIGTERM, which may not touch anything else.
+volatile std::sig_atomic_t stop_signal = 0;
+
+struct QueuedJob
+{
+    i32 priority{ 0 };
+    u64 sequence{ 0 };
+    Job job{};
+    Socket client{};
+};
+
+struct JobOrder
+{
+    // The heap keeps the largest element on top, which must be the highest priority, earliest submitted job.
+    [[nodiscard]] auto operator()(const std::unique_ptr<QueuedJob>& lhs, const std::unique_ptr<QueuedJob>& rhs) const
+        -> bool
+    {
+        if (lhs->priority != rhs->priority)
+            return lhs->priority < rhs->priority;
+
+        return lhs->sequence > rhs->sequence;
+    }
+};
+
+class JobQueue
+{
+public:
+    auto push(i32 priority, Job job, Socket client) -> usize
+    {
+        auto lock = std::scoped_lock{ _mutex };
+        _jobs.push_back(std::make_unique<QueuedJob>(QueuedJob{
+            .priority = priority,
+            .sequence = _next_sequence++,
+            .job = std::move(job),
+            .client = std::move(client),
+        }));
+        std::ranges::push_heap(_jobs, JobOrder{});
+        _condition.notify_one();
+        return _jobs.size();
+    }
+
+    // Blocks until a job is available or a stop is requested.
+    [[nodiscard]] auto pop(std::stop_token stop_token) -> std::unique_ptr<QueuedJob>
+    {
+        auto lock = std::unique_lock{ _mutex };
+
+        if (!_condition.wait(lock, stop_token, [&] { return !_jobs.empty(); }))
+            return nullptr;
+
+        std::ranges::pop_heap(_jobs, JobOrder{});
+        auto job = std::move(_jobs.back());
+        _jobs.pop_back();
+        return job;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable_any _condition;
+    std::vector<std::unique_ptr<QueuedJob>> _jobs;
+    u64 _next_sequence{ 0 };
+};
+
+// Least recently used scenes are evicted first. Only the render thread touches the cache.
+class SceneCache
+{
+public:
+    explicit SceneCache(usize capacity, tracer::SceneParseParams parse_params)
+        : _capacity{ capacity }, _parse_params{ std::move(parse_params) }
+    {}
+
+    // Returns nullptr if the scene text is invalid.
+    [[nodiscard]] auto get(const std::string& text) -> std::shared_ptr<const tracer::Scene>
+    {
+        for (auto it = _entries.begin(); it != _entries.end(); ++it)
+        {
+            if (it->text == text)
+            {
+                _entries.splice(_entries.begin(), _entries, it);
+                _hits++;
+                return _entries.front().scene;
+            }
+        }
+
+        _misses++;
+        auto scene = tracer::parse_scene(text, _parse_params);
+
+        if (!scene)
+            return nullptr;
+
+        auto shared_scene = std::make_shared<const tracer::Scene>(std::move(*scene));
+
+        if (_capacity != 0)
+        {
+            if (_entries.size() == _capacity)
+                _entries.pop_back();
+
+            _entries.push_front(Entry{ .text = text, .scene = shared_scene });
+        }
+
+        return shared_scene;
+    }
+
+    [[nodiscard]] auto hits() const -> usize { return _hits; }
+    [[nodiscard]] auto misses() const -> usize { return _misses; }
+
+private:
+    struct Entry
+    {
+        std::string text;
+        std::shared_ptr<const tracer::Scene> scene;
+    };
+
+    usize _capacity;
+    tracer::SceneParseParams _parse_params;
+    std::list<Entry> _entries;
+    usize _hits{ 0 };
+    usize _misses{ 0 };
+};
+
+// Renders one sample per pixel per pass and reports progress after each pass. Returns false if the client went away,
+// which cancels the job.
+[[nodiscard]] auto render_job(QueuedJob& queued, const tracer::Scene& scene, std::stop_token stop_token) -> bool
+{
+    const auto& job = queued.job;
+    auto accumulation = tracer::AccumulationBuffer{ job.width, job.height };
+    auto last_progress = i32{ -1 };
+
+    for (usize samples = 1; samples <= job.render_params.samples; samples++)
+    {
+        tracer::accumulate(accumulation, samples, scene, job.camera, job.render_params, stop_token);
+
+        if (stop_token.stop_requested())
+            return false;
+
+        auto progress = static_cast<i32>(samples * 100 / job.render_params.samples);
+
+        if (progress != last_progress)
+        {
+            if (!send_message(queued.client, MessageType::Progress, encode_progress(progress).bytes()))
+                return false;
+
+            last_progress = progress;
+        }
+    }
+
+    auto image = tracer::Image{ job.width, job.height };
+    accumulation.resolve(image.view());
+
+    return send_message(queued.client, MessageType::Image, encode_image(image).bytes());
+}
+
+auto run_job(QueuedJob& queued, SceneCache& cache, std::stop_token stop_token) -> void
+{
+    auto start = std::chrono::steady_clock::now();
+    auto misses = cache.misses();
+    auto scene = cache.get(queued.job.scene);
+
+    if (!scene)
+    {
+        spdlog::warn("Job {} has an invalid scene.", queued.sequence);
+        [[maybe_unused]] auto sent =
+            send_message(queued.client, MessageType::Error, encode_error("Invalid scene.").bytes());
+        return;
+    }
+
+    auto setup = std::chrono::duration<double, std::milli>{ std::chrono::steady_clock::now() - start };
+    spdlog::info("Rendering job {} (priority {}, {}x{}), scene {} in {:.3f}ms.", queued.sequence, queued.priority,
+                 queued.job.width, queued.job.height, cache.misses() == misses ? "cached" : "built", setup.count());
+
+    if (!render_job(queued, *scene, stop_token))
+    {
+        spdlog::warn("Job {} was cancelled.", queued.sequence);
+        return;
+    }
+
+    auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+    spdlog::info("Job {} done in {:.4f}s ({} scene cache hits, {} misses).", queued.sequence, elapsed.count(),
+                 cache.hits(), cache.misses());
+}
+
+auto render_jobs(std::stop_token stop_token, JobQueue& queue, usize scene_cache_size,
+                 const tracer::SceneParseParams& parse_params) -> void
+{
+    auto cache = SceneCache{ scene_cache_size, parse_params };
+
+    while (auto queued = queue.pop(stop_token))
+    {
+        // A job that fails, such as one whose scene or image doesn't fit into memory, only fails its own client. Left
+        // to escape the render thread, it would end the service.
+        try
+        {
+            run_job(*queued, cache, stop_token);
+        }
+        catch (const std::exception& error)
+        {
+            spdlog::error("Job {} failed: {}", queued->sequence, error.what());
+            [[maybe_unused]] auto sent =
+                send_message(queued->client, MessageType::Error, encode_error("Failed to render the job.").bytes());
+        }
+    }
+}
+
+// Reads the submission of a newly connected client and queues the job. Runs once per connection, so that a client that
+// never sends anything only holds up itself.
+auto read_submission(Socket client, JobQueue& queue) -> void
+{
+    if (!client.set_receive_timeout(submission_timeout_ms))
+        spdlog::warn("Failed to set a submission timeout, a silent client may keep its connection forever.");
+
+    auto message = receive_message(client);
+    auto submission =
+        message && message->type == MessageType::Submit ? decode_submission(message->payload) : std::nullopt;
+
+    if (!submission || !valid_job(submission->job))
+    {
+        spdlog::warn("Rejected an invalid submission.");
+        [[maybe_unused]] auto sent = send_message(client, MessageType::Error, encode_error("Invalid job.").bytes());
+        return;
+    }
+
+    auto queued = queue.push(submission->priority, std::move(submission->job), std::move(client));
+    spdlog::info("Queued a job with priority {}, {} waiting.", submission->priority, queued);
+}
+
+} // namespace
+
+auto run_service(const Options& options) -> bool
+{
+    auto listener = Socket::listen(options.port, true);
+
+    if (!listener)
+    {
+        spdlog::critical("Failed to listen on port {}.", options.port);
+        return false;
+    }
+
+    spdlog::info("Render service listening on port {}.", options.port);
+
+    stop_signal = 0;
+    std::signal(SIGINT, [](int) { stop_signal = 1; });
+    std::signal(SIGTERM, [](int) { stop_signal = 1; });
+
+    auto queue = JobQueue{};
+    auto renderer =
+        std::jthread{ render_jobs, std::ref(queue), options.scene_cache_size, remote_scene_params(options) };
+    auto readers = std::list<std::future<void>>{};
+
+    while (!stop_signal)
+    {
+        std::erase_if(readers, [](const std::future<void>& reader) {
+            return reader.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready;
+        });
+
+        if (auto client = listener->accept(accept_timeout_ms))
+            readers.push_back(std::async(std::launch::async, read_submission, std::move(*client), std::ref(queue)));
+    }
+
+    spdlog::info("Stopping the render service.");
+
+    // Wait for the submissions being read, then cancel the job rendering.
+    readers.clear();
+    renderer.request_stop();
+    renderer.join();
+
+    return true;
+}
+
+auto submit_job(const Options& options, const std::string& scene) -> bool
+{
+    auto socket = Socket::connect(options.host, options.port);
+
+    if (!socket)
+    {
+        spdlog::critical("Failed to connect to the render service at {}:{}.", options.host, options.port);
+        return false;
+    }
+
+    auto submission = encode_submission(Submission{
+        .priority = options.priority,
+        .job =
+            Job{
+                .width = options.width,
+                .height = options.height,
+                .camera = options.camera,
+                .render_params = options.render_params,
+                .scene = scene,
+            },
+    });
+
+    if (!send_message(*socket, MessageType::Submit, submission.bytes()))
+    {
+        spdlog::critical("Failed to submit the job.");
+        return false;
+    }
+
+    while (auto message = receive_message(*socket))
+    {
+        if (message->type == MessageType::Progress)
+        {
+            if (auto progress = decode_progress(message->payload))
+                spdlog::info("{}%", *progress);
+        }
+        else if (message->type == MessageType::Image)
+        {
+            auto image = decode_image(message->payload);
+
+            if (!image || image->width() != options.width || image->height() != options.height)
+                break;
+
+            if (!tracer::write_ppm(options.output, *image))
+            {
+                spdlog::critical("Failed to write {}.", options.output.string());
+                return false;
+            }
+
+            return true;
+        }
+        else if (message->type == MessageType::Error)
+        {
+            auto error = decode_error(message->payload);
+            spdlog::critical("The render service rejected the job: {}", error.value_or("unknown error."));
+            return false;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    spdlog::critical("Lost the connection to the render service.");
+    return false;
+}
+
+} // namespace cli
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+#include "options.hpp"
+
+namespace cli {
+
+// Runs a render service on the loopback interface until interrupted by SIGINT or SIGTERM, which cancels the job
+// rendering and drops the queued ones. Clients submit jobs with a priority; one job renders at a time, highest priority
+// first and in submission order otherwise. Parsed scenes and their acceleration structures are kept in an LRU cache
+// keyed by the scene text, so resubmitting a scene skips the setup.
+[[nodiscard]] auto run_service(const Options& options) -> bool;
+
+// Submits a job to a running service, reports its progress and writes the image to options.output.
+[[nodiscard]] auto submit_job(const Options& options, const std::string& scene) -> bool;
+
+} // namespace cli
@@ -0,0 +1,291 @@
+#include "socket.hpp"
+
+#if defined(_WIN32)
+
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+
+#else
+
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "common.hpp"
+
+namespace cli {
+
+namespace {
+
+#if defined(_WIN32)
+
+using NativeHandle = SOCKET;
+using IoSize = int;
+
+constexpr auto native_invalid_handle = INVALID_SOCKET;
+constexpr auto native_shutdown_both = SD_BOTH;
+constexpr int send_flags = 0;
+
+auto close_native(NativeHandle handle) -> void
+{
+    closesocket(handle);
+}
+
+auto poll_native(WSAPOLLFD* fds, ULONG count, INT timeout_ms) -> int
+{
+    return WSAPoll(fds, count, timeout_ms);
+}
+
+using PollFd = WSAPOLLFD;
+
+#else
+
+using NativeHandle = int;
+using IoSize = std::size_t;
+
+constexpr auto native_invalid_handle = -1;
+constexpr auto native_shutdown_both = SHUT_RDWR;
+
+// A peer that dies mid-transfer must surface as a failed send, not kill the process with SIGPIPE.
+    #if defined(MSG_NOSIGNAL)
+constexpr int send_flags = MSG_NOSIGNAL;
+    #else
+constexpr int send_flags = 0;
+    #endif
+
+auto close_native(NativeHandle handle) -> void
+{
+    ::close(handle);
+}
+
+auto poll_native(pollfd* fds, nfds_t count, int timeout_ms) -> int
+{
+    return ::poll(fds, count, timeout_ms);
+}
+
+using PollFd = pollfd;
+
+#endif
+
+// Large transfers are split, so that the size always fits the platform's length type.
+constexpr usize max_transfer_size = 1 << 30;
+
+[[nodiscard]] auto to_native(std::uintptr_t handle) -> NativeHandle
+{
+    return static_cast<NativeHandle>(handle);
+}
+
+[[nodiscard]] auto from_native(NativeHandle handle) -> std::uintptr_t
+{
+    return static_cast<std::uintptr_t>(handle);
+}
+
+auto configure_connection(NativeHandle handle) -> void
+{
+    int enable = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+    // Notices peers that went away without closing the connection, such as crashed or unplugged machines.
+    setsockopt(handle, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<const char*>(&enable), sizeof(enable));
+
+#if defined(SO_NOSIGPIPE)
+    setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, reinterpret_cast<const char*>(&enable), sizeof(enable));
+#endif
+}
+
+} // namespace
+
+NetworkContext::NetworkContext()
+{
+#if defined(_WIN32)
+    WSADATA data;
+    _initialized = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    _initialized = true;
+#endif
+}
+
+NetworkContext::~NetworkContext()
+{
+#if defined(_WIN32)
+    if (_initialized)
+        WSACleanup();
+#endif
+}
+
+Socket::~Socket()
+{
+    close();
+}
+
+Socket::Socket(Socket&& other) noexcept : _handle{ std::exchange(other._handle, invalid_handle) } {}
+
+auto Socket::operator=(Socket&& other) noexcept -> Socket&
+{
+    close();
+
+    _handle = std::exchange(other._handle, invalid_handle);
+
+    return *this;
+}
+
+auto Socket::listen(u16 port, bool local_only) -> std::optional<Socket>
+{
+    auto handle = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (handle == native_invalid_handle)
+        return std::nullopt;
+
+    auto socket = Socket{ from_native(handle) };
+
+    int reuse = 1;
+    setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    auto address = sockaddr_in{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(local_only ? INADDR_LOOPBACK : INADDR_ANY);
+
+    if (::bind(handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        return std::nullopt;
+
+    if (::listen(handle, SOMAXCONN) != 0)
+        return std::nullopt;
+
+    return socket;
+}
+
+auto Socket::connect(const std::string& host, u16 port) -> std::optional<Socket>
+{
+    auto hints = addrinfo{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    addrinfo* addresses = nullptr;
+    auto service = std::to_string(port);
+
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0)
+        return std::nullopt;
+
+    auto result = std::optional<Socket>{};
+
+    for (auto address = addresses; address && !result; address = address->ai_next)
+    {
+        auto handle = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+        if (handle == native_invalid_handle)
+            continue;
+
+        auto socket = Socket{ from_native(handle) };
+
+        if (::connect(handle, address->ai_addr, static_cast<socklen_t>(address->ai_addrlen)) == 0)
+        {
+            configure_connection(handle);
+            result = std::move(socket);
+        }
+    }
+
+    freeaddrinfo(addresses);
+    return result;
+}
+
+auto Socket::accept(i32 timeout_ms) -> std::optional<Socket>
+{
+    auto fd = PollFd{};
+    fd.fd = to_native(_handle);
+    fd.events = POLLIN;
+
+    if (poll_native(&fd, 1, timeout_ms) <= 0 || !(fd.revents & POLLIN))
+        return std::nullopt;
+
+    auto handle = ::accept(to_native(_handle), nullptr, nullptr);
+
+    if (handle == native_invalid_handle)
+        return std::nullopt;
+
+    configure_connection(handle);
+    return Socket{ from_native(handle) };
+}
+
+auto Socket::send_all(std::span<const std::byte> data) -> bool
+{
+    while (!data.empty())
+    {
+        auto size = std::min(data.size(), max_transfer_size);
+        auto sent = ::send(to_native(_handle), reinterpret_cast<const char*>(data.data()), static_cast<IoSize>(size),
+                           send_flags);
+
+        if (sent <= 0)
+            return false;
+
+        data = data.subspan(static_cast<usize>(sent));
+    }
+
+    return true;
+}
+
+auto Socket::receive_all(std::span<std::byte> data) -> bool
+{
+    while (!data.empty())
+    {
+        auto size = std::min(data.size(), max_transfer_size);
+        auto received =
+            ::recv(to_native(_handle), reinterpret_cast<char*>(data.data()), static_cast<IoSize>(size), 0);
+
+        if (received <= 0)
+            return false;
+
+        data = data.subspan(static_cast<usize>(received));
+    }
+
+    return true;
+}
+
+auto Socket::set_receive_timeout(i32 timeout_ms) -> bool
+{
+#if defined(_WIN32)
+    auto timeout = static_cast<DWORD>(timeout_ms);
+#else
+    auto timeout = timeval{};
+    timeout.tv_sec = static_cast<decltype(timeout.tv_sec)>(timeout_ms / 1000);
+    timeout.tv_usec = static_cast<decltype(timeout.tv_usec)>(timeout_ms % 1000 * 1000);
+#endif
+
+    return setsockopt(to_native(_handle), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout),
+                      sizeof(timeout))
+           == 0;
+}
+
+auto Socket::shutdown() -> void
+{
+    if (valid())
+        ::shutdown(to_native(_handle), native_shutdown_both);
+}
+
+auto Socket::valid() const -> bool
+{
+    return _handle != invalid_handle;
+}
+
+auto Socket::close() -> void
+{
+    if (valid())
+        close_native(to_native(_handle));
+
+    _handle = invalid_handle;
+}
+
+} // namespace cli
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+#include "common.hpp"
+
+namespace cli {
+
+// Initializes the platform socket library for the lifetime of the object. Must outlive every Socket.
+class NetworkContext
+{
+public:
+    explicit NetworkContext();
+    ~NetworkContext();
+
+    NetworkContext(const NetworkContext&) = delete;
+    auto operator=(const NetworkContext&) = delete;
+    NetworkContext(NetworkContext&&) = delete;
+    auto operator=(NetworkContext&&) = delete;
+
+    [[nodiscard]] auto initialized() const -> bool { return _initialized; }
+
+private:
+    bool _initialized{ false };
+};
+
+// Blocking TCP socket.
+class Socket
+{
+public:
+    explicit Socket() = default;
+    ~Socket();
+
+    Socket(const Socket&) = delete;
+    auto operator=(const Socket&) = delete;
+
+    Socket(Socket&& other) noexcept;
+    auto operator=(Socket&& other) noexcept -> Socket&;
+
+    // Listens on all local interfaces if local_only is false, otherwise only on the loopback interface.
+    [[nodiscard]] static auto listen(u16 port, bool local_only = false) -> std::optional<Socket>;
+    [[nodiscard]] static auto connect(const std::string& host, u16 port) -> std::optional<Socket>;
+
+    // Waits at most timeout_ms for an incoming connection.
+    [[nodiscard]] auto accept(i32 timeout_ms) -> std::optional<Socket>;
+
+    [[nodiscard]] auto send_all(std::span<const std::byte> data) -> bool;
+    [[nodiscard]] auto receive_all(std::span<std::byte> data) -> bool;
+
+    // Makes receives fail once the peer has sent nothing for timeout_ms, instead of waiting for it forever. Zero
+    // waits forever again.
+    [[nodiscard]] auto set_receive_timeout(i32 timeout_ms) -> bool;
+
+    // Ends the connection in both directions, which unblocks any thread waiting on the socket and makes the peer's
+    // next receive fail, while the handle stays open until the socket is destroyed.
+    auto shutdown() -> void;
+
+    [[nodiscard]] auto valid() const -> bool;
+
+private:
+    using Handle = std::uintptr_t;
+    static constexpr auto invalid_handle = ~Handle{ 0 };
+
+    Handle _handle{ invalid_handle };
+
+private:
+    explicit Socket(Handle handle) : _handle{ handle } {}
+
+    auto close() -> void;
+};
+
+} // namespace cli
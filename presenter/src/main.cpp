@@ -9,24 +9,33 @@
 #include <portable-file-dialogs.h>
 #include <spdlog/spdlog.h>
 #include <stb_image_write.h>
+#include <tracer/checkpoint.hpp>
 #include <tracer/defer.hpp>
 #include <tracer/gl.hpp>
+#include <tracer/hash.hpp>
 #include <tracer/object.hpp>
+#include <tracer/render_cache.hpp>
 #include <tracer/renderer.hpp>
+#include <tracer/scene.hpp>
 
 #include <array>
 #include <chrono>
+#include <cmath>
 #include <cstdlib>
 #include <filesystem>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <span>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "assert.hpp"
 #include "common.hpp"
 #include "log.hpp"
 #include "render_worker.hpp"
+#include "timer.hpp"
 #include "ui.hpp"
 
 namespace presenter {
@@ -132,26 +141,57 @@ const auto fragment_shader_source = std::string{
 in vec2 TexCoords;
 
 layout (location = 0) uniform sampler2D image;
+layout (location = 1) uniform float exposure_scale;
 
 out vec4 outColor;
 
 void main()
 {
-    outColor = texture(image, TexCoords);
+    vec4 color = texture(image, TexCoords);
+    outColor = vec4(color.rgb * exposure_scale, color.a);
 })"
 };
 
 constexpr u32 window_width = 1920;
 constexpr u32 window_height = 1080;
 
-const auto world = std::array<std::shared_ptr<const tracer::Object>, 2>{
+// Shown unless a scene file is given on the command line.
+const auto default_objects = std::vector<std::shared_ptr<const tracer::Object>>{
     std::make_shared<tracer::Sphere>(glm::dvec3{ 0.0, 0.0, -1.0 }, 0.5),
-    std::make_shared<tracer::Sphere>(glm::dvec3{ 0.0, -100.5, -1.0 }, 100.0)
+    std::make_shared<tracer::Sphere>(glm::dvec3{ 0.0, -100.5, -1.0 }, 100.0),
 };
 
-// Returns true if a restart of the render job is needed.
-[[nodiscard]] auto tracer_ui(const RenderWorker& render_worker, tracer::Camera& camera,
-                             tracer::RenderParams& render_params, u32& image_width, u32& image_height) -> bool
+const auto checkpoint_path = std::filesystem::path{ "render.ptck" };
+const auto cache_spill_directory = std::filesystem::path{ "render_cache" };
+
+// Off by default, the checkpoint of the last session would be overwritten as soon as a render completes.
+struct CheckpointSettings
+{
+    bool enabled{ false };
+    double interval_s{ 30.0 };
+};
+
+struct CacheSettings
+{
+    bool spill{ false };
+};
+
+// Applied when drawing the image, so changing them never restarts the render.
+struct DisplaySettings
+{
+    float exposure{ 0.0f }; // In stops.
+
+    // The image holds gamma corrected colors, with a gamma of 2.0.
+    [[nodiscard]] auto exposure_scale() const -> float { return std::exp2(exposure * 0.5f); }
+};
+
+// Returns true if the render job may need a restart, see RenderWorker::restart(). Sets resume if the user picked a
+// checkpoint of the current scene version to continue.
+[[nodiscard]] auto tracer_ui(RenderWorker& render_worker, tracer::Camera& camera, tracer::RenderParams& render_params,
+                             u32& image_width, u32& image_height, bool& restir,
+                             CheckpointSettings& checkpoint_settings, CacheSettings& cache_settings,
+                             DisplaySettings& display_settings, u64 current_scene_version,
+                             std::optional<tracer::Checkpoint>& resume) -> bool
 {
     auto restart = false;
 
@@ -162,7 +202,11 @@ const auto world = std::array<std::shared_ptr<const tracer::Object>, 2>{
     auto render_time_s = render_time_ms / 1000.0;
     ImGui::Text("Took %.4fs (%.4fms)", render_time_s, render_time_ms);
 
-    restart |= ImGui::Button("Generate");
+    if (ImGui::Button("Generate"))
+    {
+        render_worker.discard_samples();
+        restart = true;
+    }
 
     if (ImGui::Button("Save"))
     {
@@ -186,12 +230,164 @@ const auto world = std::array<std::shared_ptr<const tracer::Object>, 2>{
     restart |= ui::input_usize("Samples", render_params.samples);
     restart |= ui::input_usize("Max Depth", render_params.max_depth);
 
+    if (ImGui::Checkbox("ReSTIR Direct Lighting", &restir))
+    {
+        render_worker.set_restir(restir);
+        restart = true;
+    }
+
+    ImGui::SeparatorText("Render Cache");
+
+    auto cache_stats = render_worker.cache_stats();
+    ImGui::Text("Hit rate %.1f%% (%zu hits, %zu from disk, %zu misses)", cache_stats.hit_rate() * 100.0,
+                cache_stats.hits, cache_stats.spill_hits, cache_stats.misses);
+    ImGui::Text("%zu renders in %.1f MiB, %zu on disk in %.1f MiB", cache_stats.entries,
+                static_cast<double>(cache_stats.memory_bytes) / (1024.0 * 1024.0), cache_stats.spilled_entries,
+                static_cast<double>(cache_stats.spilled_bytes) / (1024.0 * 1024.0));
+
+    if (ImGui::Checkbox("Spill to Disk", &cache_settings.spill))
+        render_worker.set_cache_spill_directory(cache_settings.spill ? cache_spill_directory : std::filesystem::path{});
+
+    if (ImGui::Button("Clear Cache"))
+        render_worker.clear_cache();
+
+    ImGui::SeparatorText("Display");
+
+    ui::drag("Exposure", display_settings.exposure, 0.1f, -10.0f, 10.0f, "%.1f stops");
+
+    ImGui::SeparatorText("Checkpoints");
+
+    auto checkpoints_changed = ImGui::Checkbox("Save Checkpoints", &checkpoint_settings.enabled);
+    checkpoints_changed |= ui::drag("Interval (s)", checkpoint_settings.interval_s, 1.0f, 1.0, 3600.0);
+
+    if (checkpoints_changed)
+    {
+        render_worker.set_checkpoints(checkpoint_settings.enabled ? checkpoint_path : std::filesystem::path{},
+                                      checkpoint_settings.interval_s);
+    }
+
+    if (ImGui::Button("Resume"))
+    {
+        auto paths = pfd::open_file{ "Resume Render", "", { "Checkpoint Files", "*.ptck" } }.result();
+
+        if (!paths.empty())
+        {
+            resume = tracer::read_checkpoint(paths.front());
+
+            if (resume && resume->scene_hash != current_scene_version)
+            {
+                PRESENTER_ERROR("Checkpoint {} is of another scene, or of the scene with objects moved.",
+                                paths.front());
+                resume = std::nullopt;
+            }
+            else if (resume && (resume->accumulation.width() > std::numeric_limits<u32>::max()
+                                || resume->accumulation.height() > std::numeric_limits<u32>::max()))
+            {
+                PRESENTER_ERROR("Checkpoint {} is larger than an image can be.", paths.front());
+                resume = std::nullopt;
+            }
+            else if (resume)
+            {
+                camera = resume->camera;
+                render_params = resume->render_params;
+                image_width = static_cast<u32>(resume->accumulation.width());
+                image_height = static_cast<u32>(resume->accumulation.height());
+            }
+            else
+            {
+                PRESENTER_ERROR("Failed to read checkpoint {}.", paths.front());
+            }
+        }
+    }
+
     ImGui::End();
 
     return restart;
 }
 
-auto run() -> int
+// Returns true if an object was moved. Offsets are relative to the objects' initial positions.
+[[nodiscard]] auto scene_ui(std::span<glm::dvec3> object_offsets) -> bool
+{
+    auto moved = false;
+
+    ImGui::Begin("Scene");
+
+    for (usize i = 0; i < object_offsets.size(); i++)
+    {
+        ImGui::PushID(static_cast<int>(i));
+        moved |= ui::drag("Offset", object_offsets[i], 0.01f);
+        ImGui::PopID();
+    }
+
+    ImGui::End();
+
+    return moved;
+}
+
+// Identifies the state of the scene by the text it was loaded from and the offsets of its objects, so that moving them
+// back finds the renders cached before, and checkpoints of other scenes are told apart.
+[[nodiscard]] auto scene_version(u64 scene_hash, std::span<const glm::dvec3> object_offsets) -> u64
+{
+    auto hash = scene_hash;
+
+    for (const auto& offset : object_offsets)
+    {
+        // Adding zero turns -0.0 into 0.0.
+        for (auto axis = 0; axis < 3; axis++)
+            hash = tracer::hash_value(hash, offset[axis] + 0.0);
+    }
+
+    return hash;
+}
+
+// Moving objects only refits the top level of the scene's hierarchy, models keep their BVH.
+auto move_objects(tracer::Scene& scene, tracer::ObjectSpan initial_objects,
+                  std::span<const glm::dvec3> object_offsets) -> void
+{
+    auto objects = std::vector<std::shared_ptr<const tracer::Object>>{};
+    objects.reserve(initial_objects.size());
+
+    for (usize i = 0; i < initial_objects.size(); i++)
+        objects.push_back(initial_objects[i]->translated(object_offsets[i]));
+
+    auto timer = HighResolutionTimer{};
+    timer.start();
+    scene.update(std::move(objects));
+    PRESENTER_DEBUG("Updated the scene in {:.4f}ms.", timer.elapsed_ms());
+}
+
+struct LoadedScene
+{
+    tracer::Scene scene;
+    u64 hash{ tracer::hash_seed }; // Of the scene text, the default scene hashes like an empty one.
+};
+
+// Loads the scene file given as the first argument, or builds the default scene.
+[[nodiscard]] auto load_scene(std::span<const char* const> args) -> std::optional<LoadedScene>
+{
+    if (args.size() < 2)
+        return LoadedScene{ .scene = tracer::Scene{ default_objects } };
+
+    auto text = tracer::load_scene_text(args[1]);
+
+    if (!text)
+    {
+        PRESENTER_CRITICAL("Failed to read scene {}.", args[1]);
+        return std::nullopt;
+    }
+
+    auto scene = tracer::parse_scene(*text);
+
+    if (!scene)
+    {
+        PRESENTER_CRITICAL("Invalid scene {}.", args[1]);
+        return std::nullopt;
+    }
+
+    return LoadedScene{ .scene = std::move(*scene), .hash = tracer::hash_bytes(tracer::hash_seed, *text) };
+}
+
+auto run(std::span<const char* const> args) -> int
 {
     // There's a bug in VS runtime that can cause the application to deadlock when it exits when using asynchronous
     // loggers. Calling spdlog::shutdown() prevents that.
@@ -283,7 +479,25 @@ auto run() -> int
     u32 image_width = 640;
     u32 image_height = 360;
 
-    auto render_worker = RenderWorker{ image_width, image_height, world, camera, render_params };
+    auto restir = false;
+    auto checkpoint_settings = CheckpointSettings{};
+    auto cache_settings = CacheSettings{};
+    auto display_settings = DisplaySettings{};
+
+    auto loaded_scene = load_scene(args);
+
+    if (!loaded_scene)
+        return EXIT_FAILURE;
+
+    auto scene = std::move(loaded_scene->scene);
+    const auto scene_hash = loaded_scene->hash;
+    const auto initial_objects = std::vector<std::shared_ptr<const tracer::Object>>(scene.objects().begin(),
+                                                                                    scene.objects().end());
+    auto object_offsets = std::vector<glm::dvec3>(initial_objects.size(), glm::dvec3{ 0.0 });
+
+    const auto worker_checkpoint_path = checkpoint_settings.enabled ? checkpoint_path : std::filesystem::path{};
+    auto render_worker = RenderWorker{ image_width, image_height, scene, scene_version(scene_hash, object_offsets),
+                                       camera, render_params, worker_checkpoint_path, checkpoint_settings.interval_s };
 
     auto image_vertex_array = tracer::gl::VertexArray{};
     auto image_shader = tracer::gl::Shader{ vertex_shader_source, fragment_shader_source };
@@ -301,7 +515,21 @@ auto run() -> int
         if (render_status == RenderStatus::InProgress || render_status == RenderStatus::JustCompleted)
             image_texture.upload(render_worker.image().pixels());
 
-        if (tracer_ui(render_worker, camera, render_params, image_width, image_height))
+        auto resume = std::optional<tracer::Checkpoint>{};
+        auto restart = tracer_ui(render_worker, camera, render_params, image_width, image_height, restir,
+                                 checkpoint_settings, cache_settings, display_settings,
+                                 scene_version(scene_hash, object_offsets), resume);
+
+        if (scene_ui(object_offsets))
+        {
+            // The render thread reads the scene, it has to be stopped before the scene changes.
+            render_worker.stop();
+            move_objects(scene, initial_objects, object_offsets);
+            render_worker.clear_history();
+            restart = true;
+        }
+
+        if (restart || resume)
         {
             if (image_width != image_texture.width() || image_height != image_texture.height())
             {
@@ -309,13 +537,21 @@ auto run() -> int
                 image_texture.clear();
             }
 
-            render_worker.restart(image_width, image_height, world, camera, render_params);
+            if (resume)
+                render_worker.resume(std::move(*resume), scene, scene_version(scene_hash, object_offsets));
+            else
+                render_worker.restart(image_width, image_height, scene, scene_version(scene_hash, object_offsets),
+                                      camera, render_params);
+
+            // A render restored from the cache may already be complete, in which case nothing else uploads it.
+            image_texture.upload(render_worker.image().pixels());
         }
 
         glClear(GL_COLOR_BUFFER_BIT);
         image_vertex_array.bind();
         image_shader.bind();
         image_texture.bind(0);
+        glUniform1f(1, display_settings.exposure_scale());
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
         ImGui::Render();
@@ -339,7 +575,7 @@ auto run() -> int
 
 } // namespace presenter
 
-auto main() -> int
+auto main(int argc, char** argv) -> int
 {
-    return presenter::run();
+    return presenter::run(std::span{ argv, static_cast<presenter::usize>(argc) });
 }
@@ -1,40 +1,38 @@
 #include "render_worker.hpp"
 
+#include <tracer/accumulation.hpp>
+#include <tracer/checkpoint.hpp>
+#include <tracer/render_cache.hpp>
 #include <tracer/renderer.hpp>
+#include <tracer/reservoir.hpp>
+#include <tracer/scene.hpp>
 
 #include <chrono>
+#include <filesystem>
 #include <future>
 #include <memory>
+#include <optional>
 #include <stop_token>
 #include <utility>
 
+#include "assert.hpp"
 #include "common.hpp"
+#include "log.hpp"
 #include "timer.hpp"
 
 namespace presenter {
 
-namespace {
-
-auto timed_render(const tracer::ImageView<glm::vec4>& image, tracer::ObjectSpan world, const tracer::Camera& camera,
-                  const tracer::RenderParams& render_params, std::stop_token stop_token, volatile i32* progress)
-    -> double
+RenderWorker::RenderWorker(usize image_width, usize image_height, const tracer::Scene& scene, u64 scene_version,
+                           const tracer::Camera& camera, const tracer::RenderParams& render_params,
+                           const std::filesystem::path& checkpoint_path, double checkpoint_interval_s)
+    : _checkpoint_path{ checkpoint_path }, _checkpoint_interval_s{ checkpoint_interval_s }
 {
-    auto timer = HighResolutionTimer{};
-    timer.start();
-    tracer::render(image, world, camera, render_params, std::move(stop_token), progress);
-    return timer.elapsed_ms();
-}
-
-} // namespace
-
-RenderWorker::RenderWorker(usize image_width, usize image_height, tracer::ObjectSpan world,
-                           const tracer::Camera& camera, const tracer::RenderParams& render_params)
-{
-    restart(image_width, image_height, world, camera, render_params);
+    restart(image_width, image_height, scene, scene_version, camera, render_params);
 }
 
 RenderWorker::~RenderWorker()
 {
+    _exiting = true;
     stop();
 }
 
@@ -48,18 +46,248 @@ auto RenderWorker::stop() -> void
     _stop_source = std::stop_source{};
 }
 
-auto RenderWorker::restart(usize image_width, usize image_height, tracer::ObjectSpan world,
+auto RenderWorker::restart(usize image_width, usize image_height, const tracer::Scene& scene, u64 scene_version,
                            const tracer::Camera& camera, const tracer::RenderParams& render_params) -> void
 {
+    const auto keep_samples = keeps_samples(image_width, image_height, scene, scene_version, camera, render_params);
+
+    if (keep_samples && render_params == _render_params)
+        return;
+
+    stop();
+
+    if (!keep_samples)
+    {
+        const auto discarded = _samples_discarded;
+
+        if (!discarded && !_accumulated_restir && _accumulation.min_sample_count() > 0)
+            _cache.store(cache_key(), _accumulation);
+
+        _image.resize(image_width, image_height);
+        _scene = &scene;
+        _scene_version = scene_version;
+        _camera = camera;
+        _render_params = render_params;
+        _samples_discarded = false;
+        _accumulated_restir = _restir;
+
+        auto cached = discarded || _restir ? std::nullopt : _cache.find(cache_key());
+
+        if (cached)
+        {
+            // Shows the cached render right away, whether or not it needs more samples.
+            _accumulation = std::move(*cached);
+            _accumulation.resolve(_image.view());
+        }
+        else
+        {
+            _accumulation.resize(image_width, image_height);
+        }
+    }
+
+    _render_params = render_params;
+
+    // Lowering the sample count below what has been accumulated leaves nothing to render.
+    if (_accumulation.min_sample_count() >= _render_params.samples)
+    {
+        *_progress = 100;
+        return;
+    }
+
+    launch();
+}
+
+auto RenderWorker::discard_samples() -> void
+{
+    _samples_discarded = true;
+}
+
+auto RenderWorker::resume(tracer::Checkpoint checkpoint, const tracer::Scene& scene, u64 scene_version) -> void
+{
+    PRESENTER_ASSERT(checkpoint.scene_hash == scene_version);
+
     stop();
 
-    _image.resize(image_width, image_height);
-    _result = std::async(std::launch::async, timed_render, _image.view(), world, camera, render_params,
-                         _stop_source.get_token(), _progress.get());
+    if (!_samples_discarded && !_accumulated_restir && _accumulation.min_sample_count() > 0)
+        _cache.store(cache_key(), _accumulation);
+
+    _image.resize(checkpoint.accumulation.width(), checkpoint.accumulation.height());
+    _accumulation = std::move(checkpoint.accumulation);
+    _scene = &scene;
+    _scene_version = scene_version;
+    _camera = checkpoint.camera;
+    _render_params = checkpoint.render_params;
+    _samples_discarded = false;
+    _accumulated_restir = false;
+
+    launch();
+}
+
+auto RenderWorker::set_checkpoints(const std::filesystem::path& path, double interval_s) -> void
+{
+    _checkpoint_path = path;
+    _checkpoint_interval_s = interval_s;
+}
+
+auto RenderWorker::set_restir(bool enabled) -> void
+{
+    _restir = enabled;
+}
+
+auto RenderWorker::clear_history() -> void
+{
+    _reservoir_renderer.clear_history();
+}
+
+// Samples are seeded by their pixel and index, so topping up the accumulated ones gives the same image as rendering
+// them all at once. That holds as long as every sample would trace the same paths.
+auto RenderWorker::keeps_samples(usize image_width, usize image_height, const tracer::Scene& scene,
+                                 u64 scene_version, const tracer::Camera& camera,
+                                 const tracer::RenderParams& render_params) const -> bool
+{
+    if (_samples_discarded || _scene != &scene || _scene_version != scene_version || _accumulated_restir != _restir)
+        return false;
+
+    if (_accumulation.width() != image_width || _accumulation.height() != image_height || _camera != camera)
+        return false;
+
+    return tracer::same_estimate(render_params, _render_params);
+}
+
+auto RenderWorker::cache_key() const -> tracer::RenderKey
+{
+    return tracer::RenderKey{
+        .scene_version = _scene_version,
+        .camera = _camera,
+        .width = _image.width(),
+        .height = _image.height(),
+        .render_params = _render_params,
+    };
+}
+
+auto RenderWorker::set_cache_spill_directory(const std::filesystem::path& path) -> void
+{
+    _cache.set_spill_directory(path);
+}
+
+auto RenderWorker::clear_cache() -> void
+{
+    _cache.clear();
+}
+
+auto RenderWorker::cache_stats() const -> tracer::RenderCacheStats
+{
+    return _cache.stats();
+}
+
+auto RenderWorker::launch() -> void
+{
+    if (_restir)
+    {
+        _result = std::async(std::launch::async, &RenderWorker::run_restir, this, _stop_source.get_token());
+    }
+    else
+    {
+        _result = std::async(std::launch::async, &RenderWorker::run, this, _stop_source.get_token(), _checkpoint_path,
+                             _checkpoint_interval_s);
+    }
 
     _time_ms = 0.0;
 }
 
+auto RenderWorker::run(std::stop_token stop_token, std::filesystem::path checkpoint_path,
+                       double checkpoint_interval_s) -> double
+{
+    using namespace std::chrono_literals;
+
+    auto timer = HighResolutionTimer{};
+    timer.start();
+
+    auto checkpoint_timer = HighResolutionTimer{};
+    checkpoint_timer.start();
+
+    auto checkpoint_write = std::future<bool>{};
+
+    auto snapshot = [&] {
+        return tracer::Checkpoint{
+            .scene_hash = _scene_version,
+            .camera = _camera,
+            .render_params = _render_params,
+            .accumulation = _accumulation,
+        };
+    };
+
+    auto check_write = [&] {
+        if (!checkpoint_write.get())
+            PRESENTER_WARN("Failed to write checkpoint {}.", checkpoint_path.string());
+    };
+
+    // Accumulate one sample per pixel per pass, so that the image refines progressively and there's always a recent
+    // state to checkpoint.
+    while (_accumulation.min_sample_count() < _render_params.samples)
+    {
+        auto target_samples = usize{ _accumulation.min_sample_count() } + 1;
+        tracer::accumulate(_accumulation, target_samples, *_scene, _camera, _render_params, stop_token);
+        _accumulation.resolve(_image.view());
+        *_progress = static_cast<i32>(target_samples * 100 / _render_params.samples);
+
+        if (stop_token.stop_requested())
+            break;
+
+        if (checkpoint_path.empty() || checkpoint_timer.elapsed_s() < checkpoint_interval_s)
+            continue;
+
+        // Only the copy happens on the render thread, the file is written in the background. If the previous write
+        // hasn't finished yet, skip this checkpoint instead of waiting for it.
+        if (checkpoint_write.valid() && checkpoint_write.wait_for(0ms) != std::future_status::ready)
+            continue;
+
+        if (checkpoint_write.valid())
+            check_write();
+
+        checkpoint_write = std::async(std::launch::async, [checkpoint_path, checkpoint = snapshot()] {
+            return tracer::write_checkpoint(checkpoint_path, checkpoint);
+        });
+
+        checkpoint_timer.start();
+    }
+
+    if (checkpoint_write.valid())
+        check_write();
+
+    // A render stopped to restart with other settings is not saved, it would replace the last checkpoint with one of
+    // only a few samples. Finished renders are, and so is the one running when the application exits.
+    const auto completed = _accumulation.min_sample_count() >= _render_params.samples;
+
+    if (!checkpoint_path.empty() && (completed || (_exiting && _accumulation.min_sample_count() > 0)))
+    {
+        if (!tracer::write_checkpoint(checkpoint_path, snapshot()))
+            PRESENTER_WARN("Failed to write checkpoint {}.", checkpoint_path.string());
+    }
+
+    return timer.elapsed_ms();
+}
+
+// Previews are not checkpointed, since they only hold direct lighting.
+auto RenderWorker::run_restir(std::stop_token stop_token) -> double
+{
+    auto timer = HighResolutionTimer{};
+    timer.start();
+
+    while (_accumulation.min_sample_count() < _render_params.samples)
+    {
+        _reservoir_renderer.render_frame(_accumulation, *_scene, _camera, _render_params, tracer::ReservoirParams{},
+                                         stop_token);
+        _accumulation.resolve(_image.view());
+        *_progress = static_cast<i32>(usize{ _accumulation.min_sample_count() } * 100 / _render_params.samples);
+
+        if (stop_token.stop_requested())
+            break;
+    }
+
+    return timer.elapsed_ms();
+}
+
 auto RenderWorker::poll_status() -> RenderStatus
 {
     using namespace std::chrono_literals;
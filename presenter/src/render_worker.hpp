@@ -1,7 +1,14 @@
 #pragma once
 
+#include <tracer/accumulation.hpp>
+#include <tracer/checkpoint.hpp>
+#include <tracer/render_cache.hpp>
 #include <tracer/renderer.hpp>
+#include <tracer/reservoir.hpp>
+#include <tracer/scene.hpp>
 
+#include <atomic>
+#include <filesystem>
 #include <future>
 #include <memory>
 #include <stop_token>
@@ -20,8 +27,9 @@ enum class RenderStatus : u8
 class RenderWorker
 {
 public:
-    explicit RenderWorker(usize image_width, usize image_height, tracer::ObjectSpan world, const tracer::Camera& camera,
-                          const tracer::RenderParams& render_params);
+    explicit RenderWorker(usize image_width, usize image_height, const tracer::Scene& scene, u64 scene_version,
+                          const tracer::Camera& camera, const tracer::RenderParams& render_params,
+                          const std::filesystem::path& checkpoint_path = {}, double checkpoint_interval_s = 30.0);
     ~RenderWorker();
 
     RenderWorker(const RenderWorker&) = delete;
@@ -30,8 +38,32 @@ public:
     auto operator=(RenderWorker&&) = delete;
 
     auto stop() -> void;
-    auto restart(usize image_width, usize image_height, tracer::ObjectSpan world, const tracer::Camera& camera,
-                 const tracer::RenderParams& render_params) -> void;
+    // Brings the render up to date with the settings, redoing only the work that changed. A new size, scene version or
+    // camera, or a setting that changes the image, puts the accumulated samples in the cache and continues from those
+    // cached for the new settings, if any. Otherwise the render continues from the accumulated samples, and does
+    // nothing at all if they are already enough. The scene version has to change whenever the scene does.
+    auto restart(usize image_width, usize image_height, const tracer::Scene& scene, u64 scene_version,
+                 const tracer::Camera& camera, const tracer::RenderParams& render_params) -> void;
+    // Makes the next restart render from scratch, without the accumulated or cached samples.
+    auto discard_samples() -> void;
+    // Continues the render saved in the checkpoint from the sample it was interrupted at. The checkpoint has to be of
+    // the given scene version.
+    auto resume(tracer::Checkpoint checkpoint, const tracer::Scene& scene, u64 scene_version) -> void;
+
+    // Periodically saves the accumulated samples to the given path, and once more when the render completes or the
+    // worker is destroyed. An empty path disables checkpoints. Takes effect on the next restart.
+    auto set_checkpoints(const std::filesystem::path& path, double interval_s) -> void;
+
+    // Renders direct lighting with reservoir resampling instead of full paths, which converges in a few samples and
+    // keeps up while the camera moves. Takes effect on the next restart.
+    auto set_restir(bool enabled) -> void;
+    // Forgets the lighting reused from earlier frames, for after the scene changed. The render has to be stopped.
+    auto clear_history() -> void;
+
+    // Spills renders that don't fit in memory to the directory. An empty path keeps them in memory only.
+    auto set_cache_spill_directory(const std::filesystem::path& path) -> void;
+    auto clear_cache() -> void;
+    [[nodiscard]] auto cache_stats() const -> tracer::RenderCacheStats;
 
     [[nodiscard]] auto poll_status() -> RenderStatus;
     [[nodiscard]] auto time_ms() const -> double;
@@ -41,12 +73,39 @@ public:
 
 private:
     tracer::Image _image;
+    tracer::AccumulationBuffer _accumulation;
+    const tracer::Scene* _scene{ nullptr };
+    u64 _scene_version{ 0 };
+    tracer::Camera _camera;
+    tracer::RenderParams _render_params;
     std::future<double> _result;
     std::stop_source _stop_source;
     double _time_ms{ 0.0 };
+    bool _samples_discarded{ true };
+    // Accumulated samples of earlier settings. Previews are not kept, since they depend on the frames before them.
+    tracer::RenderCache _cache;
+
+    std::filesystem::path _checkpoint_path;
+    double _checkpoint_interval_s{ 30.0 };
+    std::atomic<bool> _exiting{ false }; // Set by the destructor, so that the render thread saves the last checkpoint.
+
+    bool _restir{ false };
+    bool _accumulated_restir{ false }; // Whether the accumulated samples are previews.
+    // Outlives restarts, so that frames after a camera move reuse the reservoirs of the frames before it.
+    tracer::ReservoirRenderer _reservoir_renderer;
 
     // Put this value on a different cache line, because it's going to be written to by the render thread.
     std::unique_ptr<volatile i32> _progress{ std::make_unique<volatile i32>(0) };
+
+private:
+    [[nodiscard]] auto keeps_samples(usize image_width, usize image_height, const tracer::Scene& scene,
+                                     u64 scene_version, const tracer::Camera& camera,
+                                     const tracer::RenderParams& render_params) const -> bool;
+    [[nodiscard]] auto cache_key() const -> tracer::RenderKey;
+    auto launch() -> void;
+    [[nodiscard]] auto run(std::stop_token stop_token, std::filesystem::path checkpoint_path,
+                           double checkpoint_interval_s) -> double;
+    [[nodiscard]] auto run_restir(std::stop_token stop_token) -> double;
 };
 
 } // namespace presenter
@@ -0,0 +1,80 @@
+#include <glm/vec3.hpp>
+#include <tracer/bvh.hpp>
+#include <tracer/numeric.hpp>
+#include <tracer/object.hpp>
+#include <tracer/ray.hpp>
+
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "check.hpp"
+
+namespace {
+
+using tracer::usize;
+
+constexpr usize sphere_count = 100;
+
+// Every sphere is 16 times further out and larger than the one before, so all the others fall into the first bin of
+// its parent's split and the surface area heuristic alone would give every sphere a level of its own.
+[[nodiscard]] auto geometric_spheres() -> std::vector<std::shared_ptr<const tracer::Object>>
+{
+    auto spheres = std::vector<std::shared_ptr<const tracer::Object>>{};
+
+    for (usize i = 0; i < sphere_count; i++)
+    {
+        const auto x = std::ldexp(1.0, 4 * static_cast<int>(i));
+        spheres.push_back(std::make_shared<tracer::Sphere>(glm::dvec3{ x, 0.0, 0.0 }, x / 4.0));
+    }
+
+    return spheres;
+}
+
+[[nodiscard]] auto brute_force_hit(tracer::ObjectSpan objects, const tracer::Ray& ray) -> std::optional<tracer::Hit>
+{
+    auto interval = tracer::Interval::non_negative;
+    auto closest = std::optional<tracer::Hit>{};
+
+    for (const auto& object : objects)
+    {
+        if (auto hit = object->hit(ray, interval))
+        {
+            closest = hit;
+            interval.max = hit->t;
+        }
+    }
+
+    return closest;
+}
+
+} // namespace
+
+auto main() -> int
+{
+    const auto spheres = geometric_spheres();
+    const auto bvh = tracer::Bvh{ spheres };
+
+    TEST_CHECK(bvh.depth() <= tracer::Bvh::max_depth);
+
+    // Straight down onto every sphere, so that each query has to descend to the sphere's leaf.
+    for (usize i = 0; i < spheres.size(); i++)
+    {
+        const auto x = std::ldexp(1.0, 4 * static_cast<int>(i));
+        const auto ray = tracer::Ray{ glm::dvec3{ x, 0.0, 2.0 * x }, glm::dvec3{ 0.0, 0.0, -1.0 } };
+
+        const auto hit = bvh.closest_hit(spheres, ray);
+        const auto expected = brute_force_hit(spheres, ray);
+
+        TEST_CHECK(hit.has_value() && expected.has_value());
+
+        if (hit && expected)
+            TEST_CHECK(hit->object == spheres[i].get() && hit->t == expected->t);
+
+        TEST_CHECK(bvh.occluded(spheres, ray));
+        TEST_CHECK(!bvh.occluded(spheres, ray, tracer::Interval{ .min = 0.0, .max = x }));
+    }
+
+    return tests::exit_status();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <source_location>
+
+namespace tests {
+
+// Failed checks so far. Tests keep going after a failure, so that one run reports all of them.
+inline int failures = 0;
+
+[[nodiscard]] inline auto exit_status() -> int
+{
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace tests
+
+#define TEST_CHECK(...)                                                                                                \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(__VA_ARGS__))                                                                                            \
+        {                                                                                                              \
+            auto source_location = std::source_location::current();                                                    \
+            std::cerr << source_location.file_name() << '(' << source_location.line() << "): Check failed: ("         \
+                      << #__VA_ARGS__ << ")\n";                                                                        \
+            ::tests::failures++;                                                                                       \
+        }                                                                                                              \
+    } while (false)
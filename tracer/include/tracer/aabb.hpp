@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+
+#include <optional>
+#include <utility>
+
+#include "tracer/numeric.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+// Axis-aligned bounding box. Default box is empty.
+struct Aabb
+{
+    glm::dvec3 min{ +infinity };
+    glm::dvec3 max{ -infinity };
+
+    auto expand(const glm::dvec3& point) -> void
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    auto expand(const Aabb& other) -> void
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    [[nodiscard]] auto extent() const -> glm::dvec3 { return max - min; }
+    [[nodiscard]] auto centroid() const -> glm::dvec3 { return (min + max) * 0.5; }
+
+    [[nodiscard]] auto largest_axis() const -> int
+    {
+        auto e = extent();
+        return e.x > e.y && e.x > e.z ? 0 : (e.y > e.z ? 1 : 2);
+    }
+
+    [[nodiscard]] auto surface_area() const -> double
+    {
+        if (empty())
+            return 0.0;
+
+        auto e = extent();
+        return 2.0 * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Slab test. Returns the distance at which the ray enters the box, clipped to the interval.
+    [[nodiscard]] auto entry(const Ray& ray, const glm::dvec3& inverse_direction, Interval interval) const
+        -> std::optional<double>
+    {
+        auto origin = ray.origin();
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            auto t0 = (min[axis] - origin[axis]) * inverse_direction[axis];
+            auto t1 = (max[axis] - origin[axis]) * inverse_direction[axis];
+
+            if (inverse_direction[axis] < 0.0)
+                std::swap(t0, t1);
+
+            interval.min = t0 > interval.min ? t0 : interval.min;
+            interval.max = t1 < interval.max ? t1 : interval.max;
+
+            if (interval.max < interval.min)
+                return std::nullopt;
+        }
+
+        return interval.min;
+    }
+};
+
+} // namespace tracer
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <span>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+// Running sums of linear radiance together with the number of samples that went into every pixel.
+class AccumulationBuffer
+{
+public:
+    explicit AccumulationBuffer() = default;
+    explicit AccumulationBuffer(usize width, usize height);
+
+    // Resizing always discards the accumulated samples.
+    auto resize(usize width, usize height) -> void;
+    auto clear() -> void;
+
+    // Adds the samples of a buffer covering the given tile of this one.
+    auto merge(const AccumulationBuffer& tile_buffer, const Tile& tile) -> void;
+
+    // Writes the average of every pixel, gamma corrected, to the image.
+    auto resolve(const ImageView<glm::vec4>& image) const -> void;
+
+    [[nodiscard]] auto width() const -> auto { return _width; }
+    [[nodiscard]] auto height() const -> auto { return _height; }
+    [[nodiscard]] auto sums() -> std::span<glm::vec3> { return _sums; }
+    [[nodiscard]] auto sums() const -> std::span<const glm::vec3> { return _sums; }
+    [[nodiscard]] auto sample_counts() -> std::span<u32> { return _sample_counts; }
+    [[nodiscard]] auto sample_counts() const -> std::span<const u32> { return _sample_counts; }
+    [[nodiscard]] auto min_sample_count() const -> u32;
+
+private:
+    usize _width{ 0 };
+    usize _height{ 0 };
+    std::vector<glm::vec3> _sums{};
+    std::vector<u32> _sample_counts{};
+};
+
+} // namespace tracer
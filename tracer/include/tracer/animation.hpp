@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/object.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+struct Keyframe
+{
+    double frame{ 0.0 };
+    glm::dvec3 value{ 0.0 };
+};
+
+// Keyframes sorted by frame, linearly interpolated in between and held constant before the first and after the last.
+class Track
+{
+public:
+    explicit Track() = default;
+
+    auto add(const Keyframe& keyframe) -> void;
+
+    [[nodiscard]] auto at(double frame) const -> std::optional<glm::dvec3>;
+    [[nodiscard]] auto empty() const -> bool { return _keyframes.empty(); }
+
+private:
+    std::vector<Keyframe> _keyframes{};
+};
+
+struct ObjectTrack
+{
+    usize object{ 0 };
+    Track offset{}; // Translation relative to the object's position in the scene.
+};
+
+// Keyframed camera and object motion over a range of frames.
+//
+// Animations are described in a line-based text format, frames being numbered from 0:
+//
+//     # comment
+//     frames <first> <last>
+//     camera <frame> <x> <y> <z>
+//     move <object index> <frame> <offset x> <offset y> <offset z>
+//
+struct Animation
+{
+    usize first_frame{ 0 };
+    usize last_frame{ 0 };
+    Track camera_position{};
+    std::vector<ObjectTrack> object_tracks{};
+
+    [[nodiscard]] auto camera_at(usize frame, const Camera& camera) const -> Camera;
+
+    // Returns the objects of the scene moved to where they are at the given frame, in the same order.
+    [[nodiscard]] auto objects_at(usize frame, ObjectSpan objects) const -> std::vector<std::shared_ptr<const Object>>;
+};
+
+// Returns std::nullopt if the text is not a valid animation description or moves objects the scene doesn't have.
+[[nodiscard]] auto parse_animation(std::string_view text, usize object_count) -> std::optional<Animation>;
+
+} // namespace tracer
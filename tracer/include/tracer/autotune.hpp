@@ -0,0 +1,77 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/cpu.hpp"
+#include "tracer/renderer.hpp"
+#include "tracer/scene.hpp"
+
+namespace tracer {
+
+// The settings that change how fast a scene renders on a machine, but not the image.
+struct TunedConfig
+{
+    Accelerator accelerator{ Accelerator::Wide8 };
+    InstructionSet instruction_set{ InstructionSet::Baseline };
+    Pipeline pipeline{ Pipeline::Megakernel };
+    usize packet_size{ 8 };
+    usize tile_size{ 32 };
+    usize thread_count{ 1 };
+
+    [[nodiscard]] constexpr auto operator==(const TunedConfig&) const -> bool = default;
+};
+
+struct AutotuneParams
+{
+    // Calibration renders are this many times smaller than the job on each side, unless that leaves fewer than
+    // min_pixels.
+    usize downscale{ 4 };
+    usize min_pixels{ 128 * 128 };
+    usize max_samples{ 4 };
+    // Each candidate counts with the fastest of this many renders.
+    usize runs{ 2 };
+    // A candidate has to be at least this much faster than the best so far to replace it, so that noise does not
+    // move the configuration away from the defaults.
+    double min_gain{ 0.02 };
+};
+
+// A tuned configuration, for the machine and scene with the given keys.
+struct TuningEntry
+{
+    u64 machine_key{ 0 };
+    u64 scene_key{ 0 };
+    TunedConfig config{};
+};
+
+// Names of the settings as the tuning cache spells them.
+[[nodiscard]] auto accelerator_name(Accelerator accelerator) -> std::string_view;
+[[nodiscard]] auto pipeline_name(Pipeline pipeline) -> std::string_view;
+
+// Identifies the machine by its newest supported instruction set and its hardware threads and NUMA nodes.
+[[nodiscard]] auto machine_key() -> u64;
+// Identifies the scene by the text it was parsed from.
+[[nodiscard]] auto scene_key(std::string_view scene_text) -> u64;
+
+// Times short renders of a low resolution version of the job while changing one setting at a time, starting from the
+// scene's accelerator, the selected kernels and the given parameters, and returns the fastest configuration found.
+// Tile sizes are tried scaled down with the image, and returned at full resolution.
+// Leaves the scene with the winning accelerator and the winning kernels selected.
+[[nodiscard]] auto autotune(Scene& scene, usize width, usize height, const Camera& camera,
+                            const RenderParams& render_params, const BatchParams& batch_params,
+                            const AutotuneParams& params = {}) -> TunedConfig;
+
+// Reads a cache of tuned configurations, one per line. A missing file is an empty cache, and lines that do not parse
+// are skipped, so that they get tuned again.
+[[nodiscard]] auto read_tuning_cache(const std::filesystem::path& path) -> std::vector<TuningEntry>;
+[[nodiscard]] auto write_tuning_cache(const std::filesystem::path& path, std::span<const TuningEntry> entries)
+    -> bool;
+
+[[nodiscard]] auto find_tuned_config(std::span<const TuningEntry> entries, u64 machine_key, u64 scene_key)
+    -> std::optional<TunedConfig>;
+
+} // namespace tracer
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/packet.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+template<usize Width> class WideBvh;
+
+// Binary bounding volume hierarchy built with a binned surface area heuristic. The hierarchy only stores indices, the
+// objects themselves are passed in on every query, so a Bvh stays valid when the container owning the objects is
+// copied or moved.
+class Bvh
+{
+public:
+    // Levels of the deepest tree built, which bounds the traversal stacks. Nodes deeper than the surface area heuristic
+    // can be trusted with are split at the median instead, so that any number of objects fits.
+    static constexpr usize max_depth = 64;
+
+    explicit Bvh() = default;
+    explicit Bvh(ObjectSpan objects);
+
+    // Recomputes the bounds of every node after objects have moved, keeping the topology of the tree. Much cheaper
+    // than a rebuild, but the tree degrades if objects move far.
+    auto refit(ObjectSpan objects) -> void;
+
+    [[nodiscard]] auto closest_hit(ObjectSpan objects, const Ray& ray, Interval interval = Interval::non_negative) const
+        -> std::optional<Hit>;
+
+    // Any-hit query for shadow rays. Stops at the first object the ray hits and never builds a Hit.
+    [[nodiscard]] auto occluded(ObjectSpan objects, const Ray& ray, Interval interval = Interval::non_negative) const
+        -> bool;
+
+    // Closest hit of every ray of the packet, one per direction. The packet walks the tree once, skipping nodes outside
+    // its frustum before testing any ray; once fewer than a quarter of its rays reach a node, they finish that subtree
+    // one at a time.
+    auto closest_hits(ObjectSpan objects, const RayPacket& packet, Interval interval,
+                      std::span<std::optional<Hit>> hits) const -> void;
+
+    // Sum of the surface areas of all nodes relative to the root's, a measure of traversal cost. Grows as refits loosen
+    // the tree.
+    [[nodiscard]] auto cost() const -> double;
+
+    [[nodiscard]] auto bounds() const -> Aabb { return _nodes.empty() ? Aabb{} : _nodes.front().bounds; }
+    [[nodiscard]] auto node_count() const -> usize { return _nodes.size(); }
+    // Levels from the root to the deepest leaf, at most max_depth.
+    [[nodiscard]] auto depth() const -> usize;
+
+private:
+    template<usize Width> friend class WideBvh;
+
+    struct Node
+    {
+        Aabb bounds{};
+        u32 offset{ 0 }; // First index of a leaf, or the right child of an interior node. The left child always
+                         // immediately follows its parent.
+        u16 count{ 0 };  // Number of objects in a leaf, 0 for interior nodes.
+        u8 axis{ 0 };    // Split axis of an interior node.
+    };
+
+    std::vector<Node> _nodes{};
+    std::vector<u32> _indices{};
+
+private:
+    auto build(ObjectSpan objects, std::vector<Aabb>& object_bounds, usize begin, usize end, usize depth) -> u32;
+
+    [[nodiscard]] auto closest_hit(ObjectSpan objects, const Ray& ray, Interval interval, u32 root) const
+        -> std::optional<Hit>;
+};
+
+} // namespace tracer
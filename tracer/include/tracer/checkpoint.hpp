@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+
+#include "tracer/accumulation.hpp"
+#include "tracer/common.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+// Everything needed to continue an interrupted render from the exact sample it stopped at. The random state is
+// implied by RenderParams::seed together with the per-pixel sample counts.
+struct Checkpoint
+{
+    // Chosen by the caller to identify the scene, resuming with a different one would mix two images.
+    u64 scene_hash{ 0 };
+    Camera camera{};
+    RenderParams render_params{};
+    AccumulationBuffer accumulation{};
+};
+
+[[nodiscard]] auto write_checkpoint(const std::filesystem::path& path, const Checkpoint& checkpoint) -> bool;
+// Returns std::nullopt if the file is not a checkpoint, or its size does not match the image it claims to hold.
+[[nodiscard]] auto read_checkpoint(const std::filesystem::path& path) -> std::optional<Checkpoint>;
+
+} // namespace tracer
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+#include <glm/vec3.hpp>
+
+namespace tracer {
+
+[[nodiscard]] inline auto gamma_correction(glm::vec3 linear_space_color) -> glm::vec3
+{
+    // We're using a gamma value of 2.0, therefore the inverse is just the square root.
+    linear_space_color = glm::clamp(linear_space_color, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
+    return glm::sqrt(linear_space_color);
+}
+
+// Perceived brightness of a linear Rec. 709 color.
+[[nodiscard]] inline auto luminance(const glm::vec3& color) -> float
+{
+    return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
+} // namespace tracer
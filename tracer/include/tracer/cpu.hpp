@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+#include "tracer/common.hpp"
+
+namespace tracer {
+
+// Instruction sets the kernels are compiled for, oldest first. Each one includes those before it.
+enum class InstructionSet : u8
+{
+    Baseline, // Whatever the rest of the library is compiled for.
+    Sse42,
+    Avx2,
+    Avx512, // F, BW and VL.
+};
+
+[[nodiscard]] auto instruction_set_name(InstructionSet instruction_set) -> std::string_view;
+[[nodiscard]] auto parse_instruction_set(std::string_view name) -> std::optional<InstructionSet>;
+
+// Newest instruction set that both the CPU, as reported by CPUID, and the operating system support, among those the
+// library was built with kernels for. Builds for other architectures only have the baseline.
+[[nodiscard]] auto detect_instruction_set() -> InstructionSet;
+
+// The instruction set kernels run with, the detected one unless overridden.
+[[nodiscard]] auto instruction_set() -> InstructionSet;
+
+// Overrides the instruction set kernels run with, for comparing them. Fails without changing anything if the
+// instruction set is newer than the detected one. Every instruction set produces bit-identical results.
+[[nodiscard]] auto set_instruction_set(InstructionSet instruction_set) -> bool;
+
+} // namespace tracer
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/random.hpp"
+
+namespace tracer {
+
+// HDR sky in latitude-longitude layout, with +y up. Texels are importance-sampled in proportion to their luminance
+// through an alias table, so a small, bright sun is found by light sampling instead of by lucky bounces. Each texel
+// keeps its radiance next to its alias table entry, so both lookups and samples touch a single cache line.
+class EnvironmentMap
+{
+public:
+    struct Sample
+    {
+        glm::dvec3 direction{ 0.0 };
+        glm::vec3 radiance{ 0.0f };
+        double pdf{ 0.0 }; // Per unit solid angle.
+    };
+
+    explicit EnvironmentMap() = default;
+    // Takes width * height RGB triples, row by row from the top, scaled by the given factor.
+    explicit EnvironmentMap(u32 width, u32 height, std::span<const float> rgb, float scale = 1.0f);
+
+    // Loads any image stb_image reads as floats, typically Radiance .hdr files. Returns std::nullopt on failure.
+    [[nodiscard]] static auto load(const std::filesystem::path& path, float scale = 1.0f)
+        -> std::optional<EnvironmentMap>;
+
+    [[nodiscard]] auto radiance(const glm::dvec3& direction) const -> glm::vec3;
+    [[nodiscard]] auto sample(Random& random) const -> Sample;
+    // Density with which sample() returns the direction.
+    [[nodiscard]] auto pdf(const glm::dvec3& direction) const -> double;
+
+    [[nodiscard]] auto width() const -> u32 { return _width; }
+    [[nodiscard]] auto height() const -> u32 { return _height; }
+
+private:
+    struct Texel
+    {
+        glm::vec3 radiance{ 0.0f };
+        float probability{ 0.0f }; // Of sampling this texel.
+        float threshold{ 1.0f }; // Of keeping this texel when the alias table lands on it, instead of the alias.
+        u32 alias{ 0 };
+    };
+
+    u32 _width{ 0 };
+    u32 _height{ 0 };
+    std::vector<Texel> _texels{};
+
+private:
+    auto build_alias_table() -> void;
+
+    [[nodiscard]] auto texel_index(const glm::dvec3& direction) const -> usize;
+};
+
+} // namespace tracer
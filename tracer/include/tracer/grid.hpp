@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+// Uniform grid traversed with a 3D-DDA, visiting the cells along a ray in order. Builds in linear time and is fastest
+// on roughly uniformly distributed objects. Objects much larger than the typical one, like a ground sphere, would
+// fill every cell, so they are kept in a separate list tested against every ray.
+//
+// The dense variant stores a list for every cell. The hashed variant stores lists in a hash table sized by the number
+// of object references instead, so sparse scenes can use fine cells without paying for the empty ones. Hash
+// collisions only add candidates, which the closest hit search filters out.
+class Grid
+{
+public:
+    enum class Storage : u8
+    {
+        Dense,
+        Hashed,
+    };
+
+    explicit Grid() = default;
+    explicit Grid(ObjectSpan objects, Storage storage = Storage::Dense);
+
+    [[nodiscard]] auto closest_hit(ObjectSpan objects, const Ray& ray, Interval interval = Interval::non_negative) const
+        -> std::optional<Hit>;
+    [[nodiscard]] auto occluded(ObjectSpan objects, const Ray& ray, Interval interval = Interval::non_negative) const
+        -> bool;
+
+    [[nodiscard]] auto resolution() const -> const std::array<usize, 3>& { return _resolution; }
+    [[nodiscard]] auto slot_count() const -> usize { return _slot_offsets.empty() ? 0 : _slot_offsets.size() - 1; }
+
+private:
+    Storage _storage{ Storage::Dense };
+    Aabb _bounds{};
+    std::array<usize, 3> _resolution{};
+    glm::dvec3 _cell_size{ 0.0 };
+
+    // Objects of slot i are _slot_objects[_slot_offsets[i]] to _slot_objects[_slot_offsets[i + 1]]. A slot is a cell
+    // of a dense grid, or a bucket of the hash table of a hashed one.
+    std::vector<u32> _slot_offsets{};
+    std::vector<u32> _slot_objects{};
+    std::vector<u32> _large_objects{};
+
+private:
+    [[nodiscard]] auto slot(const std::array<usize, 3>& cell) const -> usize;
+
+    // Visits the candidate objects of the ray, the large ones first and then those of every cell it passes through,
+    // front to back. The visitor may shrink the interval and ends the traversal by returning true.
+    template<typename ObjectVisitor> auto traverse(const Ray& ray, Interval& interval, ObjectVisitor&& visit) const
+        -> void;
+};
+
+} // namespace tracer
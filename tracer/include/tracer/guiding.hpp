@@ -0,0 +1,169 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <span>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+#include "tracer/random.hpp"
+
+namespace tracer {
+
+class GuidingRecorder;
+
+// Equal-area cylindrical map from unit directions to [0, 1)^2: the height on the y axis goes to x, the angle around it
+// to y.
+[[nodiscard]] auto to_square(const glm::dvec3& direction) -> glm::dvec2;
+[[nodiscard]] auto to_direction(const glm::dvec2& position) -> glm::dvec3;
+
+// Piecewise-constant distribution of incident radiance over all directions, stored as a quadtree over the square that
+// the sphere maps to with an equal-area cylindrical projection. Every node keeps the energy of its four quadrants, so
+// sampling descends by energy and cells are finer where more light arrives from.
+class DirectionalTree
+{
+public:
+    explicit DirectionalTree() : _nodes(1) {}
+
+    [[nodiscard]] auto sample(Random& random) const -> glm::dvec3;
+    // Density of sample() per unit solid angle.
+    [[nodiscard]] auto pdf(const glm::dvec3& direction) const -> double;
+    [[nodiscard]] auto energy() const -> double;
+
+    // The structure to record the next pass in, without energy: quadrants holding more than the threshold fraction of
+    // the energy are subdivided, down to max_depth levels, and the others collapsed.
+    [[nodiscard]] auto refined(double threshold, u32 max_depth) const -> DirectionalTree;
+
+    [[nodiscard]] auto node_count() const -> usize { return _nodes.size(); }
+
+    // Calls visit(node * 4 + quadrant) for every quadrant from the root down to the leaf cell of the direction.
+    template<typename Visitor> auto visit_cells(const glm::dvec3& direction, Visitor&& visit) const -> void;
+
+    // Replaces the energy of every quadrant, given per node and quadrant in visit_cells() order, in fixed point.
+    auto set_energies(std::span<const u64> energies) -> void;
+
+private:
+    struct Node
+    {
+        std::array<float, 4> energy{};
+        std::array<u32, 4> children{}; // 0 for quadrants that are leaves, since the root is no one's child.
+    };
+
+    std::vector<Node> _nodes{};
+
+private:
+    // Appends the refined copy of the source node, or of a new node with the given energy if source_node is none.
+    auto refine_node(const DirectionalTree& source, usize source_node, const std::array<double, 4>& energy,
+                     double threshold, double total, u32 depth, u32 max_depth) -> u32;
+};
+
+// Spatial-directional tree (SD-tree) learning where light comes from across the scene while rendering. A binary tree
+// halves the scene bounds along alternating axes, and every leaf holds a DirectionalTree for the points inside it.
+// Renders alternate between passes: one records radiance samples in a field, which then guides the next pass while
+// a refined copy records it. Regions that received many samples are split, so detail follows sample density.
+class GuidingField
+{
+public:
+    explicit GuidingField() = default;
+    explicit GuidingField(const Aabb& bounds);
+
+    // Distribution learnt for the point, or nullptr if nothing was recorded there yet.
+    [[nodiscard]] auto find(const glm::dvec3& point) const -> const DirectionalTree*;
+
+    // Takes the energies the recorders of a pass gathered in this field. Recorders hold integer sums, so the result
+    // does not depend on how samples were spread across threads.
+    auto absorb(std::span<const GuidingRecorder> recorders) -> void;
+
+    // The field to record the next pass in: leaves that received more than spatial_threshold samples are split, and
+    // the directional trees of all leaves refined.
+    [[nodiscard]] auto refined(u64 spatial_threshold, double directional_threshold) const -> GuidingField;
+
+private:
+    friend class GuidingRecorder;
+
+    struct Node
+    {
+        u32 child{ 0 }; // First of two consecutive children, or 0 for a leaf.
+        u32 leaf{ 0 };
+        u8 axis{ 0 };
+    };
+
+    struct Leaf
+    {
+        DirectionalTree distribution{};
+        usize first_slot{ 0 }; // Of its quadrants among the energies of a recorder.
+        u64 samples{ 0 };
+    };
+
+    Aabb _bounds{};
+    std::vector<Node> _nodes{};
+    std::vector<Leaf> _leaves{};
+    usize _slot_count{ 0 };
+
+private:
+    [[nodiscard]] auto leaf_index(const glm::dvec3& point) const -> usize;
+
+    auto copy_node(const GuidingField& source, usize source_node, usize node, u32 depth, u64 spatial_threshold,
+                   double directional_threshold) -> void;
+    auto split_leaf(usize node, const DirectionalTree& distribution, u64 samples, u32 depth, u64 spatial_threshold)
+        -> void;
+    auto assign_slots() -> void;
+};
+
+// Radiance samples one thread gathered for a field during a pass, kept apart from other threads until they are merged
+// into the field by GuidingField::absorb().
+class GuidingRecorder
+{
+public:
+    explicit GuidingRecorder(const GuidingField& field);
+
+    // Records radiance arriving at the point from the direction, as luminance over the density the direction was
+    // sampled with.
+    auto record(const glm::dvec3& point, const glm::dvec3& direction, double weight) -> void;
+
+private:
+    friend class GuidingField;
+
+    const GuidingField* _field{ nullptr };
+    std::vector<u64> _energies{};
+    std::vector<u64> _samples{};
+};
+
+// Direction of a bounce off a diffuse surface, together with its density per unit solid angle.
+struct GuidedBounce
+{
+    glm::dvec3 direction{ 0.0 };
+    double pdf{ 0.0 };
+};
+
+// Samples a bounce off a diffuse surface from an even mix of the learnt distribution and cosine-weighted sampling,
+// which keeps every direction above the surface reachable. Without a distribution, samples the cosine alone.
+[[nodiscard]] auto sample_guided_bounce(const DirectionalTree* distribution, const glm::dvec3& normal,
+                                        Random& random) -> GuidedBounce;
+
+template<typename Visitor> auto DirectionalTree::visit_cells(const glm::dvec3& direction, Visitor&& visit) const -> void
+{
+    auto position = to_square(direction);
+
+    for (usize node = 0;;)
+    {
+        const auto right = position.x >= 0.5;
+        const auto top = position.y >= 0.5;
+        const auto quadrant = usize{ right } + 2 * usize{ top };
+
+        visit(node * 4 + quadrant);
+
+        const auto child = _nodes[node].children[quadrant];
+
+        if (child == 0)
+            return;
+
+        position = position * 2.0 - glm::dvec2{ right ? 1.0 : 0.0, top ? 1.0 : 0.0 };
+        node = child;
+    }
+}
+
+} // namespace tracer
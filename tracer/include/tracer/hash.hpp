@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <string_view>
+#include <type_traits>
+
+#include "tracer/common.hpp"
+
+namespace tracer {
+
+// 64-bit FNV-1a, for keys that have to stay the same across runs, unlike std::hash.
+inline constexpr u64 hash_seed = 0xcbf29ce484222325ull;
+
+[[nodiscard]] inline auto hash_bytes(u64 hash, std::string_view bytes) -> u64
+{
+    for (auto byte : bytes)
+    {
+        hash ^= static_cast<u8>(byte);
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+template<typename T>
+    requires std::is_arithmetic_v<T>
+[[nodiscard]] auto hash_value(u64 hash, T value) -> u64
+{
+    const auto bytes = std::bit_cast<std::array<char, sizeof(T)>>(value);
+    return hash_bytes(hash, std::string_view{ bytes.data(), bytes.size() });
+}
+
+} // namespace tracer
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/bvh.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+// Objects in their own coordinate space together with a BVH over them, the bottom level of the two-level hierarchy.
+// Built once and shared by every instance placing it in a scene.
+class Model
+{
+public:
+    explicit Model(std::vector<std::shared_ptr<const Object>> objects);
+
+    [[nodiscard]] auto closest_hit(const Ray& ray, Interval interval = Interval::non_negative) const
+        -> std::optional<Hit>;
+    [[nodiscard]] auto occluded(const Ray& ray, Interval interval = Interval::non_negative) const -> bool;
+
+    [[nodiscard]] auto objects() const -> ObjectSpan { return _objects; }
+    [[nodiscard]] auto bounds() const -> Aabb { return _bvh.bounds(); }
+
+private:
+    std::vector<std::shared_ptr<const Object>> _objects{};
+    Bvh _bvh{};
+};
+
+// A model placed in the scene by a transform. Instances only reference their model, so a model can appear any number
+// of times for the cost of a transform each, and moving an instance never touches the model's BVH. Instances do not
+// emit light, whatever the objects of their model do.
+class Instance : public Object
+{
+public:
+    explicit Instance(std::shared_ptr<const Model> model, const glm::dmat4& object_to_world);
+
+    ~Instance() override = default;
+
+    [[nodiscard]] auto hit(const Ray& ray, Interval interval = Interval::non_negative) const
+        -> std::optional<Hit> override;
+    [[nodiscard]] auto occludes(const Ray& ray, Interval interval = Interval::non_negative) const -> bool override;
+    [[nodiscard]] auto bounds() const -> Aabb override { return _bounds; }
+    [[nodiscard]] auto translated(const glm::dvec3& offset) const -> std::shared_ptr<const Object> override;
+
+    [[nodiscard]] auto model() const -> const auto& { return _model; }
+    [[nodiscard]] auto object_to_world() const -> const auto& { return _object_to_world; }
+
+private:
+    std::shared_ptr<const Model> _model;
+    glm::dmat4 _object_to_world;
+    glm::dmat4 _world_to_object;
+    Aabb _bounds{};
+
+private:
+    [[nodiscard]] auto object_ray(const Ray& ray) const -> Ray;
+};
+
+} // namespace tracer
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "tracer/common.hpp"
+
+namespace tracer {
+
+// Slack for the rounding errors of testing boxes in single precision, so that no hit gets culled.
+inline constexpr float box_entry_slack = 1.0f - 1e-5f;
+inline constexpr float box_exit_slack = 1.0f + 1e-5f;
+
+// A ray against the child boxes of a wide BVH node, which are quantized to 8 bits in steps of scale from the node's
+// origin. On every axis, near holds the planes the ray enters the boxes through and far those it leaves through.
+// Plain arrays, since the kernels may not call inline functions from other files, see kernels.cpp.
+struct ChildBoxQuery
+{
+    const u8* near[3];
+    const u8* far[3];
+    float scale[3];
+    float relative_origin[3]; // Of the node's origin from the ray's.
+    float inverse_direction[3];
+    float interval_min;
+    float interval_max;
+    u32 child_count;
+};
+
+// The hot loops of the library over arrays of pixels or boxes, compiled once for every instruction set. Pixels are
+// given as consecutive floats, three per color and four per RGBA pixel.
+struct Kernels
+{
+    // Averages the sums over the sample counts and gamma corrects them into opaque pixels. Pixels without samples
+    // are black.
+    void (*resolve)(const float* sums, const u32* sample_counts, float* pixels, usize count);
+    // Quantizes the RGB of pixels with components in [0, 1] to bytes, three per pixel.
+    void (*to_rgb8)(const float* pixels, u8* bytes, usize count);
+    // Slab tests of a ray against the children of a node of a BVH4 or BVH8. Returns the children hit as a bit mask
+    // and stores the distances they are entered at.
+    u32 (*intersect_children4)(const ChildBoxQuery& query, float* t_near);
+    u32 (*intersect_children8)(const ChildBoxQuery& query, float* t_near);
+};
+
+// The kernels for instruction_set().
+[[nodiscard]] auto kernels() -> const Kernels&;
+
+} // namespace tracer
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+#include "tracer/material.hpp"
+#include "tracer/object.hpp"
+
+namespace tracer {
+
+// Bounding volume hierarchy over the lights of a scene for picking one light per shading point in proportion to an
+// estimate of its contribution there, in time logarithmic in the number of lights. Every node bounds its lights' total
+// power and extent. The estimate falls off with the squared distance to the node, and the cone of directions toward
+// the node bounds the cosine at the surface, so lights entirely below the horizon are never picked. Lights are spheres
+// and emit in every direction, so nodes need no cone of emission directions.
+class LightTree
+{
+public:
+    struct Selection
+    {
+        u32 light{ 0 }; // Index into the lights the tree was built from.
+        double probability{ 0.0 };
+    };
+
+    explicit LightTree() = default;
+    explicit LightTree(std::span<const Sphere* const> lights, const MaterialTable& materials);
+
+    // Picks a light for a surface at the point facing along the normal, using one uniform number in [0, 1). Returns
+    // std::nullopt if no light can reach the surface.
+    [[nodiscard]] auto select(const glm::dvec3& point, const glm::dvec3& normal, double u) const
+        -> std::optional<Selection>;
+    // Probability with which select() picks the light for the same surface.
+    [[nodiscard]] auto probability(const glm::dvec3& point, const glm::dvec3& normal, u32 light) const -> double;
+
+private:
+    struct Node
+    {
+        Aabb bounds{};
+        float power{ 0.0f };
+        u32 offset{ 0 }; // Light of a leaf, or the right child of an interior node. The left child follows its parent.
+        bool leaf{ false };
+    };
+
+    std::vector<Node> _nodes{};
+    // The turns from the root to the leaf of every light, bit i set for a right turn at depth i.
+    std::vector<u64> _trails{};
+
+private:
+    auto build(std::span<const Sphere* const> lights, const MaterialTable& materials, std::span<u32> indices,
+               u64 trail, u32 depth) -> u32;
+
+    [[nodiscard]] static auto importance(const Node& node, const glm::dvec3& point, const glm::dvec3& normal)
+        -> double;
+};
+
+} // namespace tracer
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <optional>
+
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/random.hpp"
+#include "tracer/ray.hpp"
+#include "tracer/scene.hpp"
+
+namespace tracer {
+
+// Shadow ray toward a point on a light, with the radiance it adds to the path if nothing blocks it.
+struct LightSample
+{
+    Ray ray;
+    Interval interval{}; // From just off the surface to just before the light.
+    glm::vec3 radiance{ 0.0f }; // Already divided by the density and weighted against BSDF sampling.
+};
+
+// Next-event estimation at a diffuse surface with the given albedo: picks the scene's environment map or one of its
+// lights through the light tree, and a direction toward it, weighted against cosine-weighted bounces with the power
+// heuristic. Draws from the generator only if the scene has something to sample, so scenes without lights or an
+// environment map render exactly as before light sampling existed.
+[[nodiscard]] auto sample_light(const Scene& scene, const Hit& hit, const glm::vec3& albedo, Random& random)
+    -> std::optional<LightSample>;
+
+// Weight of the emission a cosine-weighted bounce off the surface found on the emitter, the counterpart of the weight
+// sample_light() gives the same direction.
+[[nodiscard]] auto emission_weight(const Scene& scene, const Hit& surface, const glm::dvec3& direction,
+                                   const Object& emitter) -> float;
+
+// Radiance arriving from infinitely far away along the unit direction: the scene's environment map, or a blue-white
+// gradient if it has none.
+[[nodiscard]] auto environment_radiance(const Scene& scene, const glm::dvec3& direction) -> glm::vec3;
+// Weight of the environment radiance a cosine-weighted bounce off the surface escaped to, the counterpart of the weight
+// sample_light() gives the same direction.
+[[nodiscard]] auto environment_weight(const Scene& scene, const Hit& surface, const glm::dvec3& direction) -> float;
+
+} // namespace tracer
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/random.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+// Index of a material in a scene's MaterialTable, carried by every primitive and copied into its hits.
+using MaterialId = u32;
+
+enum class MaterialType : u8
+{
+    Diffuse,
+    Metal,
+    Dielectric,
+    Emissive,
+};
+
+// Plain data, so that shading is a switch over the type instead of a virtual call per hit. Fields a type does not use
+// are ignored.
+struct Material
+{
+    MaterialType type{ MaterialType::Diffuse };
+    glm::vec3 albedo{ 0.5f }; // Reflectance of diffuse and metal surfaces, and the tint of dielectrics.
+    glm::vec3 emission{ 0.0f };
+    float fuzz{ 0.0f }; // Radius of the sphere metal reflections are perturbed within, 0 for a perfect mirror.
+    float refractive_index{ 1.5f };
+
+    [[nodiscard]] static constexpr auto diffuse(const glm::vec3& albedo) -> Material
+    {
+        return Material{ .type = MaterialType::Diffuse, .albedo = albedo };
+    }
+
+    [[nodiscard]] static constexpr auto metal(const glm::vec3& albedo, float fuzz) -> Material
+    {
+        return Material{ .type = MaterialType::Metal, .albedo = albedo, .fuzz = fuzz };
+    }
+
+    [[nodiscard]] static constexpr auto dielectric(float refractive_index) -> Material
+    {
+        return Material{ .type = MaterialType::Dielectric, .albedo = glm::vec3{ 1.0f },
+                         .refractive_index = refractive_index };
+    }
+
+    [[nodiscard]] static constexpr auto emissive(const glm::vec3& emission) -> Material
+    {
+        return Material{ .type = MaterialType::Emissive, .albedo = glm::vec3{ 0.0f }, .emission = emission };
+    }
+};
+
+// The materials of a scene in one flat array. Entry 0 always exists and is the diffuse gray every primitive without a
+// material of its own uses.
+class MaterialTable
+{
+public:
+    static constexpr MaterialId default_material = 0;
+
+    explicit MaterialTable() : _materials{ Material{} } {}
+
+    auto add(const Material& material) -> MaterialId;
+
+    [[nodiscard]] auto operator[](MaterialId id) const -> const Material& { return _materials[id]; }
+    [[nodiscard]] auto size() const -> usize { return _materials.size(); }
+    [[nodiscard]] auto materials() const -> std::span<const Material> { return _materials; }
+
+private:
+    std::vector<Material> _materials{};
+};
+
+// Direction a path continues in after hitting a surface, and the factor its throughput is multiplied with.
+struct Scatter
+{
+    glm::dvec3 direction{ 0.0 };
+    glm::vec3 attenuation{ 1.0f };
+};
+
+// Samples the next direction off a diffuse, metal or dielectric surface: cosine-weighted for diffuse ones, a fuzzed
+// mirror reflection for metals, and reflection or refraction by their Fresnel reflectance for dielectrics. Returns
+// std::nullopt if the path is absorbed, which is always the case for emissive surfaces.
+[[nodiscard]] auto scatter(const Material& material, const Ray& ray, const Hit& hit, Random& random)
+    -> std::optional<Scatter>;
+
+} // namespace tracer
@@ -2,9 +2,14 @@
 
 #include <glm/vec3.hpp>
 
+#include <memory>
 #include <optional>
+#include <span>
 
+#include "tracer/aabb.hpp"
+#include "tracer/material.hpp"
 #include "tracer/numeric.hpp"
+#include "tracer/random.hpp"
 #include "tracer/ray.hpp"
 
 namespace tracer {
@@ -16,24 +21,55 @@ public:
 
     [[nodiscard]] virtual auto hit(const Ray& ray, Interval interval = Interval::non_negative) const
         -> std::optional<Hit> = 0;
+    // Whether the ray hits the object at all within the interval. Objects override it when they can answer without
+    // building a Hit.
+    [[nodiscard]] virtual auto occludes(const Ray& ray, Interval interval = Interval::non_negative) const -> bool
+    {
+        return hit(ray, interval).has_value();
+    }
+    [[nodiscard]] virtual auto bounds() const -> Aabb = 0;
+
+    // Returns a copy of the object moved by offset.
+    [[nodiscard]] virtual auto translated(const glm::dvec3& offset) const -> std::shared_ptr<const Object> = 0;
 };
 
+using ObjectSpan = std::span<const std::shared_ptr<const Object>>;
+
 class Sphere : public Object
 {
 public:
-    explicit constexpr Sphere(const glm::dvec3& center, double radius) : _center{ center }, _radius{ radius } {}
+    explicit constexpr Sphere(const glm::dvec3& center, double radius,
+                              MaterialId material = MaterialTable::default_material)
+        : _center{ center }, _radius{ radius }, _material{ material }
+    {}
 
     ~Sphere() override = default;
 
     [[nodiscard]] auto hit(const Ray& ray, Interval interval = Interval::non_negative) const
         -> std::optional<Hit> override;
+    [[nodiscard]] auto occludes(const Ray& ray, Interval interval = Interval::non_negative) const -> bool override;
+    [[nodiscard]] auto bounds() const -> Aabb override;
+    [[nodiscard]] auto translated(const glm::dvec3& offset) const -> std::shared_ptr<const Object> override;
+
+    // Samples a direction from the point toward the sphere, uniformly over the cone of directions that hit it.
+    // Returns std::nullopt if the point is inside the sphere, where there is no such cone.
+    [[nodiscard]] auto sample_direction(const glm::dvec3& point, Random& random) const -> std::optional<glm::dvec3>;
+    // Density of sample_direction() per unit solid angle, 0 inside the sphere.
+    [[nodiscard]] auto direction_pdf(const glm::dvec3& point) const -> double;
 
     [[nodiscard]] auto center() const -> auto { return _center; }
     [[nodiscard]] auto radius() const -> auto { return _radius; }
+    [[nodiscard]] auto material() const -> auto { return _material; }
 
 private:
     glm::dvec3 _center{ 0.0 };
     double _radius{ 0.0 };
+    MaterialId _material{ MaterialTable::default_material };
+
+private:
+    // One minus the cosine of the half angle of the cone of directions from the point toward the sphere, or 0 if the
+    // point is inside.
+    [[nodiscard]] auto cone_size(const glm::dvec3& point) const -> double;
 };
 
 } // namespace tracer
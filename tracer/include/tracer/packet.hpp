@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <span>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+
+namespace tracer {
+
+// Widest block of pixels whose primary rays form one packet, see RenderParams::packet_size.
+inline constexpr usize max_packet_side = 8;
+// Most rays a packet may hold, the primary rays of a block of the widest size.
+inline constexpr usize max_packet_size = max_packet_side * max_packet_side;
+
+// Pyramid of directions bounded by four planes through a common apex. Lets a packet of rays starting at the apex reject
+// a whole node without testing any of its rays. A default frustum rejects nothing.
+class Frustum
+{
+public:
+    explicit Frustum() = default;
+    // The corners are points on the four edges of the pyramid, in order around it.
+    explicit Frustum(const glm::dvec3& apex, const std::array<glm::dvec3, 4>& corners);
+
+    // True if the box lies entirely outside the pyramid, so no ray inside it can hit the box.
+    [[nodiscard]] auto excludes(const Aabb& box) const -> bool;
+
+private:
+    glm::dvec3 _apex{ 0.0 };
+    std::array<glm::dvec3, 4> _normals{}; // Pointing into the pyramid.
+};
+
+// Rays sharing an origin, such as the primary rays of a block of pixels, together with a frustum containing all of
+// them.
+struct RayPacket
+{
+    glm::dvec3 origin{ 0.0 };
+    std::span<const glm::dvec3> directions{};
+    Frustum frustum{};
+};
+
+} // namespace tracer
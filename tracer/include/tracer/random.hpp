@@ -3,11 +3,20 @@
 #include <glm/vec3.hpp>
 #include <pcg_random.hpp>
 
+#include "tracer/common.hpp"
+
 namespace tracer {
 
 class Random
 {
 public:
+    explicit Random() = default;
+    explicit Random(u64 seed) : _generator{ seed } {}
+
+    // Counter-based construction: the sequence depends only on the arguments, so any sample of any pixel can be
+    // reproduced on its own, in any order and on any thread.
+    [[nodiscard]] static auto for_sample(u64 seed, u64 pixel_index, u64 sample_index) -> Random;
+
     [[nodiscard]] auto get_float() -> float;
     [[nodiscard]] auto get_float(float min, float max) -> float;
 
@@ -2,8 +2,12 @@
 
 #include <glm/vec3.hpp>
 
+#include "tracer/common.hpp"
+
 namespace tracer {
 
+class Object;
+
 class Ray
 {
 public:
@@ -27,6 +31,8 @@ struct Hit
     glm::dvec3 normal{ 0.0 };
     double t{ 0.0 };
     bool front_face{ false };
+    u32 material{ 0 }; // MaterialId of the primitive hit.
+    const Object* object{ nullptr }; // The object hit. For instances the instance, not the object of its model.
 };
 
 } // namespace tracer
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+inline constexpr u32 ray_sort_key_bits = 48;
+
+// Key that groups rays likely to visit the same nodes: the octant of the direction first, then the Morton code of the
+// origin quantized to 1024 cells per axis of the bounds, then the Morton code of the direction quantized to 32 cells
+// per axis. Origins outside the bounds are clamped to them.
+[[nodiscard]] auto ray_sort_key(const Ray& ray, const Aabb& bounds) -> u64;
+
+// Stable radix sort of keys that fit in ray_sort_key_bits. Keeps its buffers between calls, so sorting the rays of
+// every bounce does not allocate.
+class RaySorter
+{
+public:
+    explicit RaySorter() = default;
+
+    // Returns the indices of the keys in sorted order, valid until the next call.
+    [[nodiscard]] auto sort(std::span<const u64> keys) -> std::span<const u32>;
+
+private:
+    std::vector<u64> _keys{};
+    std::vector<u64> _key_scratch{};
+    std::vector<u32> _order{};
+    std::vector<u32> _order_scratch{};
+};
+
+} // namespace tracer
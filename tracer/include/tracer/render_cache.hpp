@@ -0,0 +1,106 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <list>
+#include <optional>
+#include <unordered_map>
+
+#include "tracer/accumulation.hpp"
+#include "tracer/common.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+// Everything the accumulated samples of a render depend on. Renders with equal keys differ only in how many samples
+// they hold, so either can continue the other.
+struct RenderKey
+{
+    u64 scene_version{ 0 }; // Chosen by the caller, it has to change whenever the scene does.
+    Camera camera{};
+    usize width{ 0 };
+    usize height{ 0 };
+    RenderParams render_params{}; // Compared with same_estimate().
+
+    [[nodiscard]] auto operator==(const RenderKey& other) const -> bool;
+};
+
+// Stable across runs, since spilled renders are named after it.
+[[nodiscard]] auto hash_render_key(const RenderKey& key) -> u64;
+
+struct RenderCacheStats
+{
+    usize hits{ 0 };
+    usize spill_hits{ 0 }; // Among the hits, those read back from disk.
+    usize misses{ 0 };
+    usize entries{ 0 };
+    usize memory_bytes{ 0 };
+    usize spilled_entries{ 0 };
+    usize spilled_bytes{ 0 };
+
+    [[nodiscard]] auto hit_rate() const -> double
+    {
+        return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses);
+    }
+};
+
+// Accumulation buffers of earlier renders by their key, so that going back to a camera and parameters seen before
+// continues from the samples rendered then. Keeps the most recently used buffers in memory up to a budget. Older ones
+// are written to the spill directory, if there is one, as long as it has room, and dropped otherwise. Writing happens
+// in the background, so that storing a render never waits for the disk, and looking up a render still being written
+// waits for it. Spilled files belong to the cache and are deleted once read back, dropped or the cache goes away.
+class RenderCache
+{
+public:
+    explicit RenderCache(usize memory_budget_bytes = 1024ull * 1024 * 1024,
+                         const std::filesystem::path& spill_directory = {},
+                         usize spill_budget_bytes = 8ull * 1024 * 1024 * 1024);
+    ~RenderCache();
+
+    RenderCache(const RenderCache&) = delete;
+    auto operator=(const RenderCache&) = delete;
+    RenderCache(RenderCache&&) = delete;
+    auto operator=(RenderCache&&) = delete;
+
+    // Drops the renders spilled so far. An empty path disables spilling.
+    auto set_spill_directory(const std::filesystem::path& spill_directory) -> void;
+
+    // Keeps a copy of the buffer, replacing the one held for the key.
+    auto store(const RenderKey& key, const AccumulationBuffer& buffer) -> void;
+    // A copy of the buffer held for the key, or std::nullopt. Counts as a hit or a miss.
+    [[nodiscard]] auto find(const RenderKey& key) -> std::optional<AccumulationBuffer>;
+    auto clear() -> void;
+
+    [[nodiscard]] auto stats() const -> RenderCacheStats;
+
+private:
+    struct Entry
+    {
+        u64 hash{ 0 };
+        RenderKey key{};
+        AccumulationBuffer buffer{}; // Empty once spilled.
+        usize bytes{ 0 };
+        std::future<bool> spill{}; // Whether writing the spilled buffer succeeded.
+    };
+
+    using EntryList = std::list<Entry>;
+
+    usize _memory_budget_bytes{ 0 };
+    usize _spill_budget_bytes{ 0 };
+    std::filesystem::path _spill_directory{};
+    // Most recently used first.
+    EntryList _entries{};
+    EntryList _spilled{};
+    std::unordered_map<u64, EntryList::iterator> _index{};
+    std::unordered_map<u64, EntryList::iterator> _spilled_index{};
+    RenderCacheStats _stats{};
+
+private:
+    [[nodiscard]] auto spill_path(u64 hash) const -> std::filesystem::path;
+    auto erase(u64 hash) -> void;
+    auto evict() -> void;
+    auto drop_spilled(EntryList::iterator entry) -> void;
+    [[nodiscard]] static auto finish_spill(Entry& entry) -> bool;
+};
+
+} // namespace tracer
@@ -14,7 +14,8 @@
 
 namespace tracer {
 
-using ObjectSpan = std::span<const std::shared_ptr<const Object>>;
+class AccumulationBuffer;
+class Scene;
 template<typename PixelType> class ImageView;
 
 class Image
@@ -63,6 +64,8 @@ struct Camera
 {
     glm::dvec3 position{ 0.0 };
     double focal_length{ 1.0 };
+
+    [[nodiscard]] constexpr auto operator==(const Camera&) const -> bool = default;
 };
 
 struct Viewport
@@ -71,10 +74,99 @@ struct Viewport
     double height{ 2.0 };
 };
 
+// A rectangular region of a frame, in pixels.
+struct Tile
+{
+    usize x{ 0 };
+    usize y{ 0 };
+    usize width{ 0 };
+    usize height{ 0 };
+
+    [[nodiscard]] constexpr auto operator==(const Tile&) const -> bool = default;
+};
+
+// How render() and render_tile() organize their work. Both pipelines produce the same image; accumulation always
+// traces path by path.
+enum class Pipeline : u8
+{
+    Megakernel, // Every path is traced to the end on its own, see SoftwareRenderer.
+    Wavefront,  // Paths advance a bounce at a time in batched stages, see WavefrontRenderer.
+};
+
 struct RenderParams
 {
     usize samples{ 100 };
     usize max_depth{ 50 };
+    u64 seed{ 0 };
+    // Side of the square blocks of pixels whose primary rays are traced as one packet, from 1 (every ray on its own)
+    // to 8 (max_packet_side), other sizes are clamped. Does not change the image, only how fast it renders.
+    usize packet_size{ 8 };
+    Pipeline pipeline{ Pipeline::Megakernel };
+    // Reorders the bounce rays of the wavefront pipeline by direction and origin before tracing them, so that rays
+    // visiting the same nodes run back to back.
+    bool sort_rays{ false };
+    // Learns where light comes from over progressive passes and samples diffuse bounces towards it, see GuidingField.
+    // Renders with the megakernel whatever the pipeline. render() and render_tile() learn from the frame and the tile
+    // in every hardware thread, batches from each view as a whole in their own threads. accumulate() ignores it.
+    bool guiding{ false };
+
+    [[nodiscard]] constexpr auto operator==(const RenderParams&) const -> bool = default;
+};
+
+// Whether samples rendered with either parameters are interchangeable, which holds when they differ at most in the
+// sample count and the settings that only change how fast the image renders.
+[[nodiscard]] auto same_estimate(const RenderParams& a, const RenderParams& b) -> bool;
+
+// One viewpoint of a batch, rendered into its own image.
+struct BatchView
+{
+    ImageView<glm::vec4> image{};
+    Camera camera{};
+    RenderParams render_params{};
+};
+
+// A view of a streamed render, which only ever exists as the tiles handed to a TileSink.
+struct StreamView
+{
+    usize width{ 0 };
+    usize height{ 0 };
+    Tile region{}; // The part of the frame to render, all of it if empty.
+    Camera camera{};
+    RenderParams render_params{};
+};
+
+// Receives the tiles of a streamed render as they finish, see render_streamed().
+class TileSink
+{
+public:
+    virtual ~TileSink() = default;
+
+    // The tile of the view with the given index is done. Runs on the thread that rendered the tile, at the same time
+    // as calls for other tiles. The pixels are those of the tile alone, and only valid during the call.
+    virtual auto tile_finished(usize view, const Tile& tile, const ImageView<const glm::vec4>& pixels) -> void = 0;
+};
+
+// Order in which tiles are handed out to threads.
+enum class TileOrder : u8
+{
+    RowMajor,
+    Morton,  // Z-order curve.
+    Hilbert, // Every tile is next to the one before it.
+};
+
+struct BatchParams
+{
+    usize tile_size{ 32 };
+    usize thread_count{ 0 }; // 0 uses every hardware thread.
+    // Along a curve, threads working at the same time render nearby tiles, which see mostly the same part of the scene
+    // and share it in cache.
+    TileOrder tile_order{ TileOrder::Hilbert };
+    // Pins every thread to a CPU, spreading them evenly across NUMA nodes, see place_threads(). Threads allocate their
+    // tile images and scratch memory themselves, so these end up local to their node.
+    bool pin_threads{ false };
+    // Copies the scene once per NUMA node, from a thread of that node, so that traversal reads local memory. Objects
+    // and models are shared between the copies. Only with pin_threads.
+    bool replicate_scene{ false };
 };
 
 class Renderer
@@ -85,8 +177,48 @@ public:
     virtual auto render(std::stop_token stop_token = std::stop_token{}, volatile i32* progress = nullptr) -> void = 0;
 };
 
-auto render(const ImageView<glm::vec4>& image, ObjectSpan world, const Camera& camera = {},
+auto render(const ImageView<glm::vec4>& image, const Scene& scene, const Camera& camera = {},
             const RenderParams& render_params = {}, std::stop_token stop_token = std::stop_token{},
             volatile i32* progress = nullptr) -> void;
 
+// Adds samples to every pixel of the buffer until each holds target_samples of them. Samples are seeded by their pixel
+// and sample index, so a buffer accumulated over any number of calls matches one rendered in a single call.
+auto accumulate(AccumulationBuffer& buffer, usize target_samples, const Scene& scene, const Camera& camera = {},
+                const RenderParams& render_params = {}, std::stop_token stop_token = std::stop_token{},
+                volatile i32* progress = nullptr) -> void;
+
+// Same as accumulate(), but only for the given tile of a frame_width x frame_height frame. The buffer must be the size
+// of the tile.
+auto accumulate_tile(AccumulationBuffer& buffer, const Tile& tile, usize frame_width, usize frame_height,
+                     usize target_samples, const Scene& scene, const Camera& camera = {},
+                     const RenderParams& render_params = {}, std::stop_token stop_token = std::stop_token{},
+                     volatile i32* progress = nullptr) -> void;
+
+// Renders only the given tile of a frame_width x frame_height frame. The image must be the size of the tile. Guiding
+// learns from the tile alone, so it guides better the larger the tile.
+auto render_tile(const ImageView<glm::vec4>& image, const Tile& tile, usize frame_width, usize frame_height,
+                 const Scene& scene, const Camera& camera = {}, const RenderParams& render_params = {},
+                 std::stop_token stop_token = std::stop_token{}, volatile i32* progress = nullptr) -> void;
+
+// Sorts tiles of a frame, all tile_size large except at its right and bottom edges, into the order.
+auto order_tiles(std::span<Tile> tiles, usize tile_size, TileOrder order) -> void;
+
+// Renders several views of the same scene. The tiles of every view go through a single work queue shared by all
+// threads, so threads move on to the next view instead of idling while the last tiles of a view finish. Views with
+// guiding are rendered first, one at a time and as a whole, so that guiding learns from all of the view; their threads
+// are not pinned.
+auto render_batch(std::span<const BatchView> views, const Scene& scene, const BatchParams& batch_params = {},
+                  std::stop_token stop_token = std::stop_token{}, volatile i32* progress = nullptr) -> void;
+
+// Memory a view with guiding takes per pixel of its region while it renders in render_streamed(), beyond the sink.
+constexpr usize guided_bytes_per_pixel = sizeof(glm::vec3) + sizeof(u32);
+
+// Same as render_batch(), but hands every tile to the sink as soon as it is done instead of writing it into an image.
+// Consumers can show, encode or send the frame while the rest of it renders, and never need all of it in memory.
+// Views with guiding keep the accumulated samples of their region, guided_bytes_per_pixel, until the last pass hands
+// out their tiles, which are 32 pixels large whatever the batch's tile size.
+auto render_streamed(std::span<const StreamView> views, const Scene& scene, TileSink& sink,
+                     const BatchParams& batch_params = {}, std::stop_token stop_token = std::stop_token{},
+                     volatile i32* progress = nullptr) -> void;
+
 } // namespace tracer
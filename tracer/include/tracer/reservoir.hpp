@@ -0,0 +1,119 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/random.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+class AccumulationBuffer;
+class Scene;
+
+struct ReservoirParams
+{
+    // Light samples drawn per pixel and frame, of which the reservoir keeps one.
+    usize candidates{ 8 };
+    // Merges the reservoir the pixel's surface had in the previous frame, wherever the camera moved since.
+    bool temporal_reuse{ true };
+    // Previous frames count for at most this many times the candidates of the current one, so that the image follows
+    // changes instead of sticking to old samples.
+    u32 max_history{ 20 };
+    // Reservoirs of nearby pixels with a similar surface merged into every pixel, at most 15.
+    usize spatial_neighbours{ 5 };
+    double spatial_radius{ 30.0 }; // In pixels.
+    usize thread_count{ 0 }; // 0 uses every hardware thread.
+};
+
+// Direct lighting with spatiotemporal reservoir resampling (ReSTIR DI, Bitterli et al. 2020). Every pixel draws a few
+// lights, keeps one of them in a weighted reservoir, and merges the reservoirs of its surface in the previous frame
+// and of its neighbours, so it effectively picks among hundreds of candidates. Only the light a pixel ends up with
+// gets a shadow ray.
+//
+// Reservoirs hold lights rather than points on them: the lights are spheres, and a point that faces one pixel can sit
+// on the silhouette seen from the next, which makes reusing points very noisy. The point is drawn when shading.
+//
+// Frames show the first diffuse surface seen through any mirrors and glass, lit by the scene's lights and by the
+// environment through a single bounce. Light reflected by other surfaces is left out, which is what makes a frame
+// cheap enough to stay interactive.
+class ReservoirRenderer
+{
+public:
+    explicit ReservoirRenderer() = default;
+
+    // Adds one sample to every pixel of the buffer, which covers the whole frame. Frames are numbered, so that
+    // consecutive frames draw different samples for the same pixel.
+    auto render_frame(AccumulationBuffer& buffer, const Scene& scene, const Camera& camera = {},
+                      const RenderParams& render_params = {}, const ReservoirParams& params = {},
+                      std::stop_token stop_token = std::stop_token{}) -> void;
+
+    // Forgets the previous frame, for when the scene changed under it.
+    auto clear_history() -> void;
+
+private:
+    // The diffuse surface a pixel shows, with the light it reflects scaled by the mirrors and glass in front of it.
+    struct Surface
+    {
+        glm::dvec3 point{ 0.0 };
+        glm::dvec3 normal{ 0.0 };
+        glm::vec3 reflectance{ 0.0f };
+        double distance{ 0.0 }; // From the camera, along the path.
+        bool valid{ false };
+    };
+
+    struct Reservoir
+    {
+        u32 light{ 0 };
+        double weight_sum{ 0.0 };
+        // Unbiased contribution weight: the light's contribution times this estimates the pixel's direct lighting.
+        double weight{ 0.0 };
+        u32 count{ 0 }; // Candidates seen, including those of merged reservoirs.
+    };
+
+    usize _width{ 0 };
+    usize _height{ 0 };
+    u64 _frame{ 0 };
+
+    std::vector<Surface> _surfaces{};
+    std::vector<Reservoir> _reservoirs{};
+    std::vector<glm::vec3> _radiance{};
+    std::vector<Random> _generators{};
+    std::vector<Reservoir> _merged{};
+
+    bool _has_history{ false };
+    Camera _previous_camera{};
+    std::vector<Surface> _previous_surfaces{};
+    std::vector<Reservoir> _previous_reservoirs{};
+
+private:
+    auto trace_primary(const Scene& scene, const Camera& camera, const RenderParams& render_params, usize x, usize y)
+        -> void;
+    auto sample_candidates(const Scene& scene, const ReservoirParams& params, usize pixel) -> void;
+    auto reuse_temporal(const Scene& scene, const ReservoirParams& params, usize pixel) -> void;
+    auto reuse_spatial(const Scene& scene, const ReservoirParams& params, usize x, usize y) -> void;
+    auto shade(const Scene& scene, usize pixel) -> void;
+
+    // Whether reservoirs of the other surface suit this one.
+    [[nodiscard]] static auto similar(const Surface& surface, const Surface& other) -> bool;
+    // Luminance of the most light the light can send toward the surface's pixel, which reservoirs pick lights by. Only
+    // 0 if none of the light is above the surface.
+    [[nodiscard]] static auto target(const Scene& scene, const Surface& surface, u32 light) -> double;
+
+    // Streams a light into the reservoir, which keeps it with a probability proportional to its weight.
+    static auto update(Reservoir& reservoir, u32 light, double weight, Random& random) -> void;
+    // Merges reservoirs of other surfaces, or other frames, into one for the surface.
+    [[nodiscard]] static auto merge(const Scene& scene, const Surface& surface,
+                                    std::span<const Surface* const> surfaces,
+                                    std::span<const Reservoir* const> reservoirs, Random& random) -> Reservoir;
+
+    // Pixel of the previous frame showing the point, if it was in view.
+    [[nodiscard]] auto reproject(const glm::dvec3& point) const -> std::optional<usize>;
+};
+
+} // namespace tracer
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "tracer/bvh.hpp"
+#include "tracer/common.hpp"
+#include "tracer/environment.hpp"
+#include "tracer/grid.hpp"
+#include "tracer/light_tree.hpp"
+#include "tracer/material.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/packet.hpp"
+#include "tracer/ray.hpp"
+#include "tracer/wide_bvh.hpp"
+
+namespace tracer {
+
+// Acceleration structure answering the scene's ray queries. The binary BVH is always built, because refits happen on
+// it; the wide ones are collapsed from it and the grids are built from the objects directly.
+enum class Accelerator : u8
+{
+    Binary,
+    Wide4,
+    Wide8,
+    Grid,
+    HashedGrid,
+};
+
+// The objects of a scene together with the acceleration structure built over them. Building is the expensive part,
+// so scenes are meant to be built once and shared between renders. Objects may be instances of models with their own
+// BVH, which makes the scene's BVH the top level of a two-level hierarchy. Primitives refer to the scene's material
+// table by index, and those without a material are diffuse gray. Lights are spheres with emissive materials at the top
+// level; emissive spheres inside models glow, but are not sampled. An environment map is loaded while parsing, from
+// where SceneParseParams allows.
+//
+// Scenes are described in a line-based text format:
+//
+//     # comment
+//     material <name> diffuse <red> <green> <blue>
+//     material <name> metal <red> <green> <blue> [<fuzz>]
+//     material <name> dielectric <refractive index>
+//     material <name> emissive <red> <green> <blue>
+//     sphere <center x> <center y> <center z> <radius> [<material name>]
+//     light <center x> <center y> <center z> <radius> <red> <green> <blue>
+//     model <name>
+//         sphere ...
+//     end
+//     instance <model name> <x> <y> <z> [<scale> [<rotation about y in degrees>]]
+//     environment <path to an HDR lat-long image> [<scale>]
+//
+class Scene
+{
+public:
+    explicit Scene() = default;
+    explicit Scene(std::vector<std::shared_ptr<const Object>> objects, MaterialTable materials = MaterialTable{},
+                   Accelerator accelerator = Accelerator::Wide8);
+
+    // Replaces every object with a moved version of itself, at the same index, and refits the BVH instead of
+    // rebuilding it. Models referenced by instances are left untouched. Falls back to a rebuild once refits have
+    // degraded the tree too much.
+    auto update(std::vector<std::shared_ptr<const Object>> objects) -> void;
+
+    auto set_accelerator(Accelerator accelerator) -> void;
+    auto set_environment(std::shared_ptr<const EnvironmentMap> environment) -> void;
+
+    [[nodiscard]] auto closest_hit(const Ray& ray, Interval interval = Interval::non_negative) const
+        -> std::optional<Hit>;
+    // Whether anything blocks the ray within the interval. Much cheaper than closest_hit() for shadow rays, which only
+    // need a yes or no.
+    [[nodiscard]] auto occluded(const Ray& ray, Interval interval = Interval::non_negative) const -> bool;
+    // Packets always traverse the binary BVH, whatever the accelerator, since every scene has one.
+    auto closest_hits(const RayPacket& packet, Interval interval, std::span<std::optional<Hit>> hits) const -> void;
+
+    [[nodiscard]] auto objects() const -> ObjectSpan { return _objects; }
+    [[nodiscard]] auto materials() const -> const MaterialTable& { return _materials; }
+    // The spheres with emissive materials among the objects, which next-event estimation samples.
+    [[nodiscard]] auto lights() const -> std::span<const Sphere* const> { return _lights; }
+    // Hierarchy over lights() that picks the lights worth sampling at a shading point.
+    [[nodiscard]] auto light_tree() const -> const LightTree& { return _light_tree; }
+    // Index of the emitter in lights(), or std::nullopt if light sampling never picks it.
+    [[nodiscard]] auto light_index(const Object& emitter) const -> std::optional<u32>;
+    // The sky that light sampling picks alongside the lights, or nullptr for the default gradient.
+    [[nodiscard]] auto environment() const -> const EnvironmentMap* { return _environment.get(); }
+    [[nodiscard]] auto bvh() const -> const Bvh& { return _bvh; }
+    [[nodiscard]] auto accelerator() const -> Accelerator { return _accelerator; }
+
+private:
+    std::vector<std::shared_ptr<const Object>> _objects{};
+    MaterialTable _materials{};
+    std::vector<const Sphere*> _lights{};
+    std::unordered_map<const Object*, u32> _light_indices{};
+    LightTree _light_tree{};
+    std::shared_ptr<const EnvironmentMap> _environment{};
+    Accelerator _accelerator{ Accelerator::Wide8 };
+    Bvh _bvh{};
+    Bvh4 _bvh4{};
+    Bvh8 _bvh8{};
+    Grid _grid{};
+    double _build_cost{ 0.0 };
+
+private:
+    auto build_accelerator() -> void;
+    auto collect_lights() -> void;
+};
+
+// Which files a scene description may read. Text from elsewhere, such as the network, must not name arbitrary files
+// on this machine, so it is parsed with an asset directory or without loading files at all.
+struct SceneParseParams
+{
+    bool load_files{ true }; // Otherwise directives that read files make the scene invalid.
+    // Paths are resolved against this directory and may not lead out of it. If empty, they are relative to the working
+    // directory and may name any file.
+    std::filesystem::path asset_directory{};
+};
+
+// Returns std::nullopt if the text is not a valid scene description.
+[[nodiscard]] auto parse_scene(std::string_view text, const SceneParseParams& params = {}) -> std::optional<Scene>;
+[[nodiscard]] auto load_scene_text(const std::filesystem::path& path) -> std::optional<std::string>;
+
+} // namespace tracer
@@ -5,15 +5,23 @@
 #include <glm/vec4.hpp>
 
 #include <optional>
+#include <span>
 #include <stop_token>
+#include <vector>
 
+#include "tracer/accumulation.hpp"
+#include "tracer/common.hpp"
 #include "tracer/numeric.hpp"
+#include "tracer/packet.hpp"
 #include "tracer/random.hpp"
 #include "tracer/ray.hpp"
 #include "tracer/renderer.hpp"
 
 namespace tracer {
 
+class GuidingField;
+class GuidingRecorder;
+
 struct Pixel
 {
     glm::dvec3 position{ 0.0 };
@@ -23,36 +31,92 @@ struct Pixel
 class SoftwareRenderer : public Renderer
 {
 public:
-    explicit SoftwareRenderer(const ImageView<glm::vec4>& image, ObjectSpan world, const Camera& camera = {},
+    explicit SoftwareRenderer(const ImageView<glm::vec4>& image, const Scene& scene, const Camera& camera = {},
+                              const RenderParams& render_params = {});
+    // Renders only the given tile of a frame_width x frame_height frame. The image must be the size of the tile.
+    explicit SoftwareRenderer(const ImageView<glm::vec4>& image, const Tile& tile, usize frame_width,
+                              usize frame_height, const Scene& scene, const Camera& camera = {},
                               const RenderParams& render_params = {});
+    // Renderers without a target image, for use with accumulate().
+    explicit SoftwareRenderer(usize frame_width, usize frame_height, const Scene& scene, const Camera& camera = {},
+                              const RenderParams& render_params = {});
+    explicit SoftwareRenderer(const Tile& tile, usize frame_width, usize frame_height, const Scene& scene,
+                              const Camera& camera = {}, const RenderParams& render_params = {});
 
     auto render(std::stop_token stop_token, volatile i32* progress) -> void override;
+    auto accumulate(AccumulationBuffer& buffer, usize target_samples, std::stop_token stop_token,
+                    volatile i32* progress) -> void;
+
+    // Guides diffuse bounces with the field, if not nullptr, and records what paths find into the recorder, if not
+    // nullptr. Both must outlive rendering.
+    auto set_guiding(const GuidingField* field, GuidingRecorder* recorder) -> void;
+
+    [[nodiscard]] static auto create_viewport(usize image_width, usize image_height) -> Viewport;
 
 private:
+    // A diffuse bounce of the current path, kept until the path ends to record the radiance found beyond it.
+    struct GuidingVertex
+    {
+        glm::dvec3 point{ 0.0 };
+        glm::dvec3 direction{ 0.0 };
+        glm::vec3 throughput{ 0.0f }; // Including the bounce.
+        glm::vec3 radiance{ 0.0f };   // Gathered by the path up to and including the bounce.
+        double pdf{ 0.0 };
+    };
+
+    // What the path tracing loop is compiled for. Guided paths sample diffuse bounces from the guiding field, and
+    // recording ones also feed the recorder. A max_depth of 0 leaves the depth limit to the render parameters.
+    struct PathConfig
+    {
+        bool guided{ false };
+        bool recording{ false };
+        usize max_depth{ 0 };
+    };
+
+    using BlockKernel = auto (SoftwareRenderer::*)(const Tile& block, usize sample_index, std::span<const bool> active,
+                                                   std::span<glm::vec3> radiance) -> void;
+
     [[nodiscard]] auto pixel(usize x, usize y) const -> Pixel;
-    [[nodiscard]] auto pixel_color(const Pixel& pixel) -> glm::vec3;
+    [[nodiscard]] auto pixel_index(usize x, usize y) const -> usize;
+    [[nodiscard]] auto pixel_color(const glm::vec3& radiance_sum) const -> glm::vec3;
     [[nodiscard]] auto sample_pixel(const Pixel& pixel) -> Ray;
 
-    [[nodiscard]] auto ray_color(const Ray& ray, usize max_depth) -> glm::vec3;
+    // The specialization of block_radiance() for the render parameters and guiding, so that the common setups run
+    // with their configuration folded into the loop instead of checking it at every vertex.
+    [[nodiscard]] auto select_block_kernel() const -> BlockKernel;
+
+    // Radiance of one sample of every active pixel of a block, given in frame coordinates. The primary rays of the
+    // block are traced together as one packet.
+    template<PathConfig Config>
+    auto block_radiance(const Tile& block, usize sample_index, std::span<const bool> active,
+                        std::span<glm::vec3> radiance) -> void;
+    [[nodiscard]] auto block_frustum(const Tile& block) const -> Frustum;
+
+    // Radiance along a camera ray whose closest hit is already known, following it for up to max_depth hits.
+    template<PathConfig Config> [[nodiscard]] auto trace_path(Ray ray, std::optional<Hit> hit) -> glm::vec3;
     [[nodiscard]] auto closest_hit(const Ray& ray, Interval interval = Interval::non_negative) const
         -> std::optional<Hit>;
-    [[nodiscard]] static auto ambient(const Ray& ray) -> glm::vec3;
+
+    auto record_vertices(const glm::vec3& radiance) -> void;
 
     [[nodiscard]] auto random_reflection(const glm::dvec3& normal) -> glm::dvec3;
-    [[nodiscard]] auto lambertian_reflection(const glm::dvec3& normal) -> glm::dvec3;
 
     [[nodiscard]] auto sample_unit_square() -> glm::dvec2;
 
-    [[nodiscard]] static auto create_viewport(usize image_width, usize image_height) -> Viewport;
-    [[nodiscard]] static auto gamma_correction(glm::vec3 linear_space_color) -> glm::vec3;
-
 private:
     ImageView<glm::vec4> _image{};
-    ObjectSpan _world{};
+    Tile _tile{};
+    usize _frame_width{ 0 };
+    usize _frame_height{ 0 };
+    const Scene* _scene{ nullptr };
     Camera _camera{};
     RenderParams _render_params{};
     Viewport _viewport{};
     Random _random{};
+    const GuidingField* _guiding{ nullptr };
+    GuidingRecorder* _recorder{ nullptr };
+    std::vector<GuidingVertex> _vertices{};
+    BlockKernel _block_radiance{ nullptr };
 };
 
 } // namespace tracer
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/vec4.hpp>
+
+#include <filesystem>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+struct StreamParams
+{
+    // Upper bound on the memory used for pixel data while rendering, regardless of the output resolution.
+    usize working_set_bytes{ 256ull * 1024 * 1024 };
+    // How the threads share the tiles of every band.
+    BatchParams batch_params{};
+};
+
+// Renders the frame in bands, streaming the tiles of every band from all threads, and writes each finished band
+// straight to a binary PPM file, so the whole frame never has to fit in memory. Bands with guiding are smaller, to
+// make room for the samples guiding keeps, and each learns on its own. Returns false if the file could not be written.
+[[nodiscard]] auto render_to_file(const std::filesystem::path& path, usize width, usize height, const Scene& scene,
+                                  const Camera& camera = {}, const RenderParams& render_params = {},
+                                  const StreamParams& stream_params = {},
+                                  std::stop_token stop_token = std::stop_token{}, volatile i32* progress = nullptr)
+    -> bool;
+
+[[nodiscard]] auto write_ppm(const std::filesystem::path& path, const ImageView<const glm::vec4>& image) -> bool;
+
+// Converts the image to a binary PPM file in memory, so that encoding and writing can happen on different threads.
+[[nodiscard]] auto encode_ppm(const ImageView<const glm::vec4>& image) -> std::vector<u8>;
+[[nodiscard]] auto write_file(const std::filesystem::path& path, std::span<const u8> data) -> bool;
+
+} // namespace tracer
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/common.hpp"
+
+namespace tracer {
+
+// The CPUs sharing a memory controller, usually those of one socket. Memory is local to the node of the thread that
+// first writes it.
+struct NumaNode
+{
+    u32 id{ 0 };
+    std::vector<u32> cpus{};
+};
+
+// Where a render thread runs.
+struct ThreadPlacement
+{
+    usize node{ 0 }; // Index into the nodes the placement was made for.
+    u32 cpu{ 0 };
+};
+
+// The NUMA nodes with CPUs, as Linux reports them, without the CPUs outside the affinity mask of the process. Machines
+// without NUMA information get a single node with the CPUs of the mask, and other platforms one with every hardware
+// thread.
+[[nodiscard]] auto numa_nodes() -> std::vector<NumaNode>;
+
+// The number of cores the CPUs of the nodes belong to, counting the hardware threads of a core once, or std::nullopt
+// where the platform does not report it.
+[[nodiscard]] auto core_count(std::span<const NumaNode> nodes) -> std::optional<usize>;
+
+// Spreads the threads across the nodes in turn, so that every node gets an equal share, and across the CPUs of each
+// node. Threads share CPUs only once there are more threads than CPUs.
+[[nodiscard]] auto place_threads(std::span<const NumaNode> nodes, usize thread_count) -> std::vector<ThreadPlacement>;
+
+// Restricts the calling thread to the CPU. Returns false if the platform does not support it or the CPU is not
+// available to the process.
+[[nodiscard]] auto pin_thread(u32 cpu) -> bool;
+
+} // namespace tracer
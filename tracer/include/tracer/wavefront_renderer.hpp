@@ -0,0 +1,121 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <optional>
+#include <stop_token>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/random.hpp"
+#include "tracer/ray.hpp"
+#include "tracer/ray_sort.hpp"
+#include "tracer/renderer.hpp"
+#include "tracer/software_renderer.hpp"
+
+namespace tracer {
+
+// Renderer that advances a whole wave of paths one bounce at a time instead of tracing each path to the end. Every
+// bounce runs as separate batched stages over queues of paths: intersect all of them, sort the hits by their entry in
+// the material table, shade and queue shadow rays toward lights, trace the shadow rays, then scatter the surviving
+// paths into their next ray, optionally sorted by direction and origin. Terminated paths are dropped from the queue as
+// it is rebuilt, so every stage only touches live paths. Produces the same image as SoftwareRenderer.
+class WavefrontRenderer : public Renderer
+{
+public:
+    explicit WavefrontRenderer(const ImageView<glm::vec4>& image, const Scene& scene, const Camera& camera = {},
+                               const RenderParams& render_params = {});
+    // Renders only the given tile of a frame_width x frame_height frame. The image must be the size of the tile.
+    explicit WavefrontRenderer(const ImageView<glm::vec4>& image, const Tile& tile, usize frame_width,
+                               usize frame_height, const Scene& scene, const Camera& camera = {},
+                               const RenderParams& render_params = {});
+
+    auto render(std::stop_token stop_token, volatile i32* progress) -> void override;
+
+private:
+    // Live paths, one entry per path in every array.
+    struct PathQueue
+    {
+        std::vector<double> origin_x{};
+        std::vector<double> origin_y{};
+        std::vector<double> origin_z{};
+        std::vector<double> direction_x{};
+        std::vector<double> direction_y{};
+        std::vector<double> direction_z{};
+        std::vector<glm::vec3> throughput{};
+        std::vector<Random> generators{};
+        std::vector<u32> samples{}; // Index of the path's sample within the wave.
+        // Diffuse surface the ray bounced off, which sampled lights. Meaningless unless sampled_lights is set, which it
+        // is not for camera rays and bounces off other materials.
+        std::vector<glm::dvec3> previous_points{};
+        std::vector<glm::dvec3> previous_normals{};
+        std::vector<u8> sampled_lights{};
+
+        [[nodiscard]] auto size() const -> usize { return samples.size(); }
+        [[nodiscard]] auto ray(usize path) const -> Ray;
+        [[nodiscard]] auto previous(usize path) const -> std::optional<Hit>;
+
+        auto clear() -> void;
+        auto reserve(usize size) -> void;
+        auto push(const Ray& ray, const glm::vec3& throughput, const Random& generator, u32 sample,
+                  const std::optional<Hit>& previous) -> void;
+    };
+
+    // Result of intersecting the current queue, one entry per path.
+    struct HitQueue
+    {
+        std::vector<glm::dvec3> points{};
+        std::vector<glm::dvec3> normals{};
+        std::vector<u8> front_faces{};
+        std::vector<const Object*> objects{};
+        std::vector<u32> keys{}; // MaterialId of the hit plus one, or 0 for paths that left the scene.
+
+        auto resize(usize size) -> void;
+    };
+
+    // Shadow rays of next-event estimation, traced together after shading.
+    struct ShadowQueue
+    {
+        std::vector<Ray> rays{};
+        std::vector<Interval> intervals{};
+        std::vector<glm::vec3> radiance{}; // Added to the sample if the ray is unoccluded.
+        std::vector<u32> samples{};
+
+        auto clear() -> void;
+    };
+
+    ImageView<glm::vec4> _image{};
+    Tile _tile{};
+    usize _frame_width{ 0 };
+    usize _frame_height{ 0 };
+    const Scene* _scene{ nullptr };
+    Camera _camera{};
+    RenderParams _render_params{};
+    Viewport _viewport{};
+
+    PathQueue _paths{};
+    PathQueue _next_paths{};
+    HitQueue _hits{};
+    ShadowQueue _shadows{};
+    std::vector<u32> _order{}; // Paths of the current queue sorted by the material they hit.
+    std::vector<usize> _material_offsets{};
+    std::vector<u64> _sort_keys{};
+    RaySorter _ray_sorter{};
+    std::vector<glm::vec3> _radiance{}; // One entry per sample of the wave.
+
+private:
+    [[nodiscard]] auto pixel(usize x, usize y) const -> Pixel;
+
+    auto generate(usize first_sample, usize sample_count) -> void;
+    auto intersect() -> void;
+    auto sort_by_material() -> void;
+    auto shade() -> void;
+    auto trace_shadows() -> void;
+    auto extend() -> void;
+    auto sort_rays() -> void;
+};
+
+} // namespace tracer
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "tracer/bvh.hpp"
+#include "tracer/common.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+// Bounding volume hierarchy with Width children per node, collapsed from a binary Bvh. The child boxes of a node are
+// stored as 8-bit offsets from the node's origin in structure of arrays form, so that a ray is tested against all of
+// them in one vectorizable loop and a whole node fits in one (Width 4) or two (Width 8) cache lines.
+template<usize Width> class WideBvh
+{
+    static_assert(Width == 4 || Width == 8);
+
+public:
+    explicit WideBvh() = default;
+    explicit WideBvh(const Bvh& bvh);
+
+    [[nodiscard]] auto closest_hit(ObjectSpan objects, const Ray& ray, Interval interval = Interval::non_negative) const
+        -> std::optional<Hit>;
+    [[nodiscard]] auto occluded(ObjectSpan objects, const Ray& ray, Interval interval = Interval::non_negative) const
+        -> bool;
+
+    [[nodiscard]] auto node_count() const -> usize { return _nodes.size(); }
+
+private:
+    struct alignas(64) Node
+    {
+        glm::vec3 origin{ 0.0f };
+        std::array<i8, 3> exponent{}; // Child boxes are measured in steps of 2^exponent from the origin.
+        u8 child_count{ 0 };
+        std::array<u8, Width> min_x{};
+        std::array<u8, Width> min_y{};
+        std::array<u8, Width> min_z{};
+        std::array<u8, Width> max_x{};
+        std::array<u8, Width> max_y{};
+        std::array<u8, Width> max_z{};
+        std::array<u32, Width> child{}; // Child node, or first index of a leaf.
+        std::array<u16, Width> count{}; // Number of objects in a leaf child, 0 for interior children.
+    };
+
+    std::vector<Node> _nodes{};
+    std::vector<u32> _indices{};
+
+private:
+    auto collapse(const Bvh& bvh, u32 binary_node) -> u32;
+
+    // Visits the leaves the ray enters within the interval, nearest first. The visitor gets the range of indices of
+    // a leaf, may shrink the interval, and ends the traversal by returning true.
+    template<typename LeafVisitor> auto traverse(const Ray& ray, Interval& interval, LeafVisitor&& visit) const -> void;
+};
+
+extern template class WideBvh<4>;
+extern template class WideBvh<8>;
+
+using Bvh4 = WideBvh<4>;
+using Bvh8 = WideBvh<8>;
+
+} // namespace tracer
@@ -0,0 +1,71 @@
+#include "tracer/accumulation.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <limits>
+
+#include "tracer/assert.hpp"
+#include "tracer/common.hpp"
+#include "tracer/kernels.hpp"
+
+namespace tracer {
+
+AccumulationBuffer::AccumulationBuffer(usize width, usize height)
+{
+    resize(width, height);
+}
+
+auto AccumulationBuffer::resize(usize width, usize height) -> void
+{
+    _width = width;
+    _height = height;
+    _sums.assign(_width * _height, glm::vec3{ 0.0f });
+    _sample_counts.assign(_width * _height, 0);
+}
+
+auto AccumulationBuffer::clear() -> void
+{
+    std::ranges::fill(_sums, glm::vec3{ 0.0f });
+    std::ranges::fill(_sample_counts, 0);
+}
+
+auto AccumulationBuffer::merge(const AccumulationBuffer& tile_buffer, const Tile& tile) -> void
+{
+    TRACER_ASSERT(tile_buffer.width() == tile.width && tile_buffer.height() == tile.height);
+    TRACER_ASSERT(tile.x + tile.width <= _width && tile.y + tile.height <= _height);
+
+    for (usize y = 0; y < tile.height; y++)
+    {
+        for (usize x = 0; x < tile.width; x++)
+        {
+            auto source = y * tile.width + x;
+            auto destination = (tile.y + y) * _width + tile.x + x;
+            _sums[destination] += tile_buffer._sums[source];
+            _sample_counts[destination] += tile_buffer._sample_counts[source];
+        }
+    }
+}
+
+auto AccumulationBuffer::resolve(const ImageView<glm::vec4>& image) const -> void
+{
+    TRACER_ASSERT(image.width() == _width && image.height() == _height);
+
+    if (_sums.empty())
+        return;
+
+    // Images are stored row after row without padding, like the sums.
+    kernels().resolve(glm::value_ptr(_sums[0]), _sample_counts.data(), glm::value_ptr(image[0, 0]), _sums.size());
+}
+
+auto AccumulationBuffer::min_sample_count() const -> u32
+{
+    if (_sample_counts.empty())
+        return 0;
+
+    return std::ranges::min(_sample_counts);
+}
+
+} // namespace tracer
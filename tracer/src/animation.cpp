@@ -0,0 +1,137 @@
+#include "tracer/animation.hpp"
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/object.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+auto Track::add(const Keyframe& keyframe) -> void
+{
+    auto position = std::ranges::upper_bound(_keyframes, keyframe.frame, {}, &Keyframe::frame);
+    _keyframes.insert(position, keyframe);
+}
+
+auto Track::at(double frame) const -> std::optional<glm::dvec3>
+{
+    if (_keyframes.empty())
+        return std::nullopt;
+
+    auto next = std::ranges::upper_bound(_keyframes, frame, {}, &Keyframe::frame);
+
+    if (next == _keyframes.begin())
+        return next->value;
+
+    if (next == _keyframes.end())
+        return _keyframes.back().value;
+
+    auto previous = next - 1;
+    auto blend = (frame - previous->frame) / (next->frame - previous->frame);
+    return glm::mix(previous->value, next->value, blend);
+}
+
+auto Animation::camera_at(usize frame, const Camera& camera) const -> Camera
+{
+    auto result = camera;
+
+    if (auto position = camera_position.at(static_cast<double>(frame)))
+        result.position = *position;
+
+    return result;
+}
+
+auto Animation::objects_at(usize frame, ObjectSpan objects) const -> std::vector<std::shared_ptr<const Object>>
+{
+    auto result = std::vector<std::shared_ptr<const Object>>{ objects.begin(), objects.end() };
+
+    for (const auto& track : object_tracks)
+    {
+        if (auto offset = track.offset.at(static_cast<double>(frame)))
+            result[track.object] = objects[track.object]->translated(*offset);
+    }
+
+    return result;
+}
+
+auto parse_animation(std::string_view text, usize object_count) -> std::optional<Animation>
+{
+    auto animation = Animation{};
+    auto has_frames = false;
+    auto stream = std::istringstream{ std::string{ text } };
+    auto line = std::string{};
+
+    while (std::getline(stream, line))
+    {
+        if (auto comment = line.find('#'); comment != std::string::npos)
+            line.resize(comment);
+
+        auto words = std::istringstream{ line };
+        auto directive = std::string{};
+
+        if (!(words >> directive))
+            continue;
+
+        if (directive == "frames")
+        {
+            if (!(words >> animation.first_frame >> animation.last_frame)
+                || animation.last_frame < animation.first_frame)
+            {
+                return std::nullopt;
+            }
+
+            has_frames = true;
+        }
+        else if (directive == "camera")
+        {
+            auto keyframe = Keyframe{};
+
+            if (!(words >> keyframe.frame >> keyframe.value.x >> keyframe.value.y >> keyframe.value.z))
+                return std::nullopt;
+
+            animation.camera_position.add(keyframe);
+        }
+        else if (directive == "move")
+        {
+            auto object = usize{ 0 };
+            auto keyframe = Keyframe{};
+
+            if (!(words >> object >> keyframe.frame >> keyframe.value.x >> keyframe.value.y >> keyframe.value.z)
+                || object >= object_count)
+            {
+                return std::nullopt;
+            }
+
+            auto track = std::ranges::find(animation.object_tracks, object, &ObjectTrack::object);
+
+            if (track == animation.object_tracks.end())
+                track = animation.object_tracks.insert(track, ObjectTrack{ .object = object });
+
+            track->offset.add(keyframe);
+        }
+        else
+        {
+            return std::nullopt;
+        }
+
+        if (auto rest = std::string{}; words >> rest)
+            return std::nullopt;
+    }
+
+    if (!has_frames)
+        return std::nullopt;
+
+    return animation;
+}
+
+} // namespace tracer
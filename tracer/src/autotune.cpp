@@ -0,0 +1,321 @@
+#include "tracer/autotune.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <limits>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tracer/common.hpp"
+#include "tracer/cpu.hpp"
+#include "tracer/hash.hpp"
+#include "tracer/renderer.hpp"
+#include "tracer/scene.hpp"
+#include "tracer/topology.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Layout of a cache line:
+//   machine key, scene key (both hexadecimal), accelerator, kernels, pipeline, packet size, tile size, thread count
+constexpr auto accelerator_names = std::array{
+    std::pair{ Accelerator::Binary, std::string_view{ "binary" } },
+    std::pair{ Accelerator::Wide4, std::string_view{ "bvh4" } },
+    std::pair{ Accelerator::Wide8, std::string_view{ "bvh8" } },
+    std::pair{ Accelerator::Grid, std::string_view{ "grid" } },
+    std::pair{ Accelerator::HashedGrid, std::string_view{ "hashed-grid" } },
+};
+
+constexpr auto pipeline_names = std::array{
+    std::pair{ Pipeline::Megakernel, std::string_view{ "megakernel" } },
+    std::pair{ Pipeline::Wavefront, std::string_view{ "wavefront" } },
+};
+
+constexpr auto packet_sizes = std::array<usize, 4>{ 1, 2, 4, 8 };
+constexpr auto tile_sizes = std::array<usize, 3>{ 16, 32, 64 };
+
+template<typename T, usize Size>
+[[nodiscard]] auto name_of(const std::array<std::pair<T, std::string_view>, Size>& names, T value) -> std::string_view
+{
+    for (const auto& [named, name] : names)
+    {
+        if (named == value)
+            return name;
+    }
+
+    return "unknown";
+}
+
+template<typename T, usize Size>
+[[nodiscard]] auto parse_name(const std::array<std::pair<T, std::string_view>, Size>& names, std::string_view name)
+    -> std::optional<T>
+{
+    for (const auto& [value, value_name] : names)
+    {
+        if (value_name == name)
+            return value;
+    }
+
+    return std::nullopt;
+}
+
+[[nodiscard]] auto hardware_threads() -> usize
+{
+    return std::max(usize{ std::thread::hardware_concurrency() }, usize{ 1 });
+}
+
+// Selects the parts of the configuration that live outside the render and batch parameters.
+auto select(Scene& scene, const TunedConfig& config) -> void
+{
+    if (scene.accelerator() != config.accelerator)
+        scene.set_accelerator(config.accelerator);
+
+    [[maybe_unused]] const auto supported = set_instruction_set(config.instruction_set);
+    TRACER_ASSERT(supported);
+}
+
+[[nodiscard]] auto parse_entry(const std::string& line) -> std::optional<TuningEntry>
+{
+    auto words = std::istringstream{ line };
+    auto entry = TuningEntry{};
+    auto accelerator = std::string{};
+    auto instruction_set = std::string{};
+    auto pipeline = std::string{};
+
+    if (!(words >> std::hex >> entry.machine_key >> entry.scene_key >> std::dec >> accelerator >> instruction_set
+          >> pipeline >> entry.config.packet_size >> entry.config.tile_size >> entry.config.thread_count))
+    {
+        return std::nullopt;
+    }
+
+    if (auto rest = std::string{}; words >> rest)
+        return std::nullopt;
+
+    const auto parsed_accelerator = parse_name(accelerator_names, accelerator);
+    const auto parsed_instruction_set = parse_instruction_set(instruction_set);
+    const auto parsed_pipeline = parse_name(pipeline_names, pipeline);
+
+    if (!parsed_accelerator || !parsed_instruction_set || !parsed_pipeline)
+        return std::nullopt;
+
+    if (std::ranges::find(packet_sizes, entry.config.packet_size) == packet_sizes.end() || entry.config.tile_size == 0
+        || entry.config.thread_count == 0)
+    {
+        return std::nullopt;
+    }
+
+    entry.config.accelerator = *parsed_accelerator;
+    entry.config.instruction_set = *parsed_instruction_set;
+    entry.config.pipeline = *parsed_pipeline;
+    return entry;
+}
+
+} // namespace
+
+auto accelerator_name(Accelerator accelerator) -> std::string_view
+{
+    return name_of(accelerator_names, accelerator);
+}
+
+auto pipeline_name(Pipeline pipeline) -> std::string_view
+{
+    return name_of(pipeline_names, pipeline);
+}
+
+auto machine_key() -> u64
+{
+    auto hash = hash_bytes(hash_seed, instruction_set_name(detect_instruction_set()));
+
+    for (const auto& node : numa_nodes())
+        hash = hash_bytes(hash, std::to_string(node.id) + ":" + std::to_string(node.cpus.size()) + ";");
+
+    return hash_bytes(hash, std::to_string(hardware_threads()));
+}
+
+auto scene_key(std::string_view scene_text) -> u64
+{
+    return hash_bytes(hash_seed, scene_text);
+}
+
+auto autotune(Scene& scene, usize width, usize height, const Camera& camera, const RenderParams& render_params,
+              const BatchParams& batch_params, const AutotuneParams& params) -> TunedConfig
+{
+    TRACER_ASSERT(width != 0 && height != 0 && params.downscale != 0 && params.runs != 0);
+
+    // Same aspect ratio as the job, so that the tiles cover the same parts of the scene.
+    const auto pixels = static_cast<double>(width) * static_cast<double>(height);
+    const auto max_downscale = std::sqrt(pixels / static_cast<double>(std::max(params.min_pixels, usize{ 1 })));
+    const auto downscale = std::max(std::min(static_cast<double>(params.downscale), max_downscale), 1.0);
+    const auto calibration_width = std::max(static_cast<usize>(static_cast<double>(width) / downscale), usize{ 1 });
+    const auto calibration_height = std::max(static_cast<usize>(static_cast<double>(height) / downscale), usize{ 1 });
+
+    auto image = Image{ calibration_width, calibration_height };
+    auto calibration_params = render_params;
+    calibration_params.samples = std::min(render_params.samples, std::max(params.max_samples, usize{ 1 }));
+
+    auto best = TunedConfig{
+        .accelerator = scene.accelerator(),
+        .instruction_set = instruction_set(),
+        .pipeline = render_params.pipeline,
+        .packet_size = render_params.packet_size,
+        .tile_size = batch_params.tile_size,
+        .thread_count = batch_params.thread_count == 0 ? hardware_threads() : batch_params.thread_count,
+    };
+
+    auto measure = [&](const TunedConfig& config) {
+        select(scene, config);
+
+        auto view = BatchView{ .image = image, .camera = camera, .render_params = calibration_params };
+        view.render_params.pipeline = config.pipeline;
+        view.render_params.packet_size = config.packet_size;
+
+        // Tiles as large relative to the image as they would be at full resolution, so that threads get as many of
+        // them to share.
+        auto calibration_batch = batch_params;
+        calibration_batch.tile_size =
+            std::max(static_cast<usize>(std::round(static_cast<double>(config.tile_size) / downscale)), usize{ 1 });
+        calibration_batch.thread_count = config.thread_count;
+
+        auto fastest = std::numeric_limits<double>::infinity();
+
+        for (usize run = 0; run < params.runs; run++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            render_batch(std::span{ &view, 1 }, scene, calibration_batch);
+            const auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+            fastest = std::min(fastest, elapsed.count());
+        }
+
+        return fastest;
+    };
+
+    auto best_time = measure(best);
+
+    // Coordinate descent: each setting keeps the candidate that wins with the others at their best so far.
+    auto tune = [&]<typename T>(T TunedConfig::*setting, std::span<const T> candidates) {
+        for (const auto& candidate : candidates)
+        {
+            if (candidate == best.*setting)
+                continue;
+
+            auto config = best;
+            config.*setting = candidate;
+
+            if (auto time = measure(config); time < best_time * (1.0 - params.min_gain))
+            {
+                best = config;
+                best_time = time;
+            }
+        }
+    };
+
+    auto accelerators = std::vector<Accelerator>{};
+
+    for (const auto& [accelerator, name] : accelerator_names)
+        accelerators.push_back(accelerator);
+
+    auto instruction_sets = std::vector<InstructionSet>{};
+
+    for (auto set = InstructionSet::Baseline; set <= detect_instruction_set();
+         set = static_cast<InstructionSet>(std::to_underlying(set) + 1))
+    {
+        instruction_sets.push_back(set);
+    }
+
+    auto pipelines = std::vector<Pipeline>{};
+
+    for (const auto& [pipeline, name] : pipeline_names)
+        pipelines.push_back(pipeline);
+
+    // All hardware threads, or one per core on machines with several threads per core.
+    auto thread_counts = std::vector<usize>{ hardware_threads() };
+
+    if (const auto cores = core_count(numa_nodes()); cores && *cores != 0 && *cores < hardware_threads())
+        thread_counts.push_back(*cores);
+
+    tune(&TunedConfig::accelerator, std::span<const Accelerator>{ accelerators });
+    tune(&TunedConfig::instruction_set, std::span<const InstructionSet>{ instruction_sets });
+    tune(&TunedConfig::pipeline, std::span<const Pipeline>{ pipelines });
+
+    // The wavefront pipeline traces primary rays one by one.
+    if (best.pipeline == Pipeline::Megakernel)
+        tune(&TunedConfig::packet_size, std::span<const usize>{ packet_sizes });
+
+    tune(&TunedConfig::tile_size, std::span<const usize>{ tile_sizes });
+    tune(&TunedConfig::thread_count, std::span<const usize>{ thread_counts });
+
+    select(scene, best);
+    return best;
+}
+
+auto read_tuning_cache(const std::filesystem::path& path) -> std::vector<TuningEntry>
+{
+    auto entries = std::vector<TuningEntry>{};
+    auto file = std::ifstream{ path };
+    auto line = std::string{};
+
+    while (file && std::getline(file, line))
+    {
+        if (auto entry = parse_entry(line))
+            entries.push_back(*entry);
+    }
+
+    return entries;
+}
+
+auto write_tuning_cache(const std::filesystem::path& path, std::span<const TuningEntry> entries) -> bool
+{
+    // Write to a temporary file first, so that renders reading the cache meanwhile never see half of it.
+    auto temporary_path = path;
+    temporary_path += ".tmp";
+
+    {
+        auto file = std::ofstream{ temporary_path, std::ios::trunc };
+
+        if (!file)
+            return false;
+
+        for (const auto& entry : entries)
+        {
+            const auto& config = entry.config;
+            file << std::hex << entry.machine_key << ' ' << entry.scene_key << std::dec << ' '
+                 << accelerator_name(config.accelerator) << ' '
+                 << instruction_set_name(config.instruction_set) << ' ' << pipeline_name(config.pipeline) << ' '
+                 << config.packet_size << ' ' << config.tile_size << ' ' << config.thread_count << '\n';
+        }
+
+        if (!file.flush())
+            return false;
+    }
+
+    auto error = std::error_code{};
+    std::filesystem::rename(temporary_path, path, error);
+    return !error;
+}
+
+auto find_tuned_config(std::span<const TuningEntry> entries, u64 machine_key, u64 scene_key)
+    -> std::optional<TunedConfig>
+{
+    for (const auto& entry : entries)
+    {
+        if (entry.machine_key == machine_key && entry.scene_key == scene_key)
+            return entry.config;
+    }
+
+    return std::nullopt;
+}
+
+} // namespace tracer
@@ -0,0 +1,463 @@
+#include "tracer/bvh.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/assert.hpp"
+#include "tracer/common.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/packet.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+namespace {
+
+constexpr usize bin_count = 16;
+constexpr usize max_leaf_size = 4;
+
+// Splits that separate few objects from the rest, as geometrically spaced objects get, would let the surface area
+// heuristic build arbitrarily deep trees. Below this depth nodes are halved instead, which brings even 2^32 objects
+// down to one per node within the remaining levels.
+constexpr usize median_split_depth = Bvh::max_depth - 1 - 32;
+
+// Relative cost of visiting a node compared to intersecting an object.
+constexpr double traversal_cost = 1.0;
+
+} // namespace
+
+Bvh::Bvh(ObjectSpan objects)
+{
+    if (objects.empty())
+        return;
+
+    auto object_bounds = std::vector<Aabb>{};
+    object_bounds.reserve(objects.size());
+
+    for (const auto& object : objects)
+        object_bounds.push_back(object->bounds());
+
+    _indices.resize(objects.size());
+    std::iota(_indices.begin(), _indices.end(), u32{ 0 });
+    _nodes.reserve(2 * objects.size());
+
+    build(objects, object_bounds, 0, objects.size(), 0);
+}
+
+auto Bvh::build(ObjectSpan objects, std::vector<Aabb>& object_bounds, usize begin, usize end, usize depth) -> u32
+{
+    const auto node_index = static_cast<u32>(_nodes.size());
+    _nodes.emplace_back();
+
+    auto bounds = Aabb{};
+    auto centroid_bounds = Aabb{};
+
+    for (auto i = begin; i < end; i++)
+    {
+        bounds.expand(object_bounds[_indices[i]]);
+        centroid_bounds.expand(object_bounds[_indices[i]].centroid());
+    }
+
+    _nodes[node_index].bounds = bounds;
+
+    const auto count = end - begin;
+    const auto axis = centroid_bounds.largest_axis();
+    const auto axis_min = centroid_bounds.min[axis];
+    const auto axis_extent = centroid_bounds.extent()[axis];
+
+    auto make_leaf = [&] {
+        _nodes[node_index].offset = static_cast<u32>(begin);
+        _nodes[node_index].count = static_cast<u16>(count);
+        return node_index;
+    };
+
+    constexpr auto max_leaf_count = usize{ std::numeric_limits<u16>::max() };
+
+    auto split_children = [&](usize split) {
+        _nodes[node_index].axis = static_cast<u8>(axis);
+        build(objects, object_bounds, begin, split, depth + 1);
+        _nodes[node_index].offset = build(objects, object_bounds, split, end, depth + 1);
+        return node_index;
+    };
+
+    // The last level, median splits have left at most one object per node by now.
+    if (count <= max_leaf_size || depth + 1 >= max_depth)
+    {
+        TRACER_ASSERT(count <= max_leaf_count);
+        return make_leaf();
+    }
+
+    // All centroids coincide, so no split can separate them.
+    if (axis_extent <= 0.0)
+        return count <= max_leaf_count ? make_leaf() : split_children(begin + count / 2);
+
+    if (depth >= median_split_depth)
+    {
+        const auto middle = _indices.begin() + static_cast<isize>(begin + count / 2);
+
+        std::nth_element(_indices.begin() + static_cast<isize>(begin), middle,
+                         _indices.begin() + static_cast<isize>(end), [&](u32 a, u32 b) {
+                             return object_bounds[a].centroid()[axis] < object_bounds[b].centroid()[axis];
+                         });
+
+        return split_children(begin + count / 2);
+    }
+
+    auto bin_of = [&](u32 index) {
+        auto relative = (object_bounds[index].centroid()[axis] - axis_min) / axis_extent;
+        return std::min(static_cast<usize>(relative * static_cast<double>(bin_count)), bin_count - 1);
+    };
+
+    struct Bin
+    {
+        Aabb bounds{};
+        usize count{ 0 };
+    };
+
+    auto bins = std::array<Bin, bin_count>{};
+
+    for (auto i = begin; i < end; i++)
+    {
+        auto& bin = bins[bin_of(_indices[i])];
+        bin.bounds.expand(object_bounds[_indices[i]]);
+        bin.count++;
+    }
+
+    // Sweep from the right to get the area and count of everything right of each split, then from the left to
+    // evaluate the cost of every split.
+    auto right_areas = std::array<double, bin_count>{};
+    auto right_counts = std::array<usize, bin_count>{};
+    auto right_bounds = Aabb{};
+    usize right_count = 0;
+
+    for (auto bin = bin_count - 1; bin > 0; bin--)
+    {
+        right_bounds.expand(bins[bin].bounds);
+        right_count += bins[bin].count;
+        right_areas[bin] = right_bounds.surface_area();
+        right_counts[bin] = right_count;
+    }
+
+    auto best_cost = +infinity;
+    usize best_split = 0;
+    auto left_bounds = Aabb{};
+    usize left_count = 0;
+
+    for (usize split = 1; split < bin_count; split++)
+    {
+        left_bounds.expand(bins[split - 1].bounds);
+        left_count += bins[split - 1].count;
+
+        if (left_count == 0 || right_counts[split] == 0)
+            continue;
+
+        auto cost = left_bounds.surface_area() * static_cast<double>(left_count)
+                    + right_areas[split] * static_cast<double>(right_counts[split]);
+
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best_split = split;
+        }
+    }
+
+    const auto leaf_cost = bounds.surface_area() * static_cast<double>(count);
+    const auto split_cost = traversal_cost * bounds.surface_area() + best_cost;
+
+    if (best_split == 0)
+        return count <= max_leaf_count ? make_leaf() : split_children(begin + count / 2);
+
+    if (count <= max_leaf_count && leaf_cost <= split_cost)
+        return make_leaf();
+
+    auto middle = std::partition(_indices.begin() + static_cast<isize>(begin),
+                                 _indices.begin() + static_cast<isize>(end),
+                                 [&](u32 index) { return bin_of(index) < best_split; });
+
+    const auto split = static_cast<usize>(middle - _indices.begin());
+    TRACER_ASSERT(split > begin && split < end);
+
+    return split_children(split);
+}
+
+auto Bvh::refit(ObjectSpan objects) -> void
+{
+    // Children always come after their parent, so walking backwards visits children first.
+    for (auto i = _nodes.size(); i-- > 0;)
+    {
+        auto& node = _nodes[i];
+        node.bounds = Aabb{};
+
+        if (node.count != 0)
+        {
+            for (u32 j = node.offset; j < node.offset + node.count; j++)
+                node.bounds.expand(objects[_indices[j]]->bounds());
+        }
+        else
+        {
+            node.bounds.expand(_nodes[i + 1].bounds);
+            node.bounds.expand(_nodes[node.offset].bounds);
+        }
+    }
+}
+
+auto Bvh::depth() const -> usize
+{
+    // Children always come after their parent, so walking forwards visits parents first.
+    auto depths = std::vector<usize>(_nodes.size(), 1);
+    usize deepest = 0;
+
+    for (usize i = 0; i < _nodes.size(); i++)
+    {
+        deepest = std::max(deepest, depths[i]);
+
+        if (_nodes[i].count == 0)
+        {
+            depths[i + 1] = depths[i] + 1;
+            depths[_nodes[i].offset] = depths[i] + 1;
+        }
+    }
+
+    return deepest;
+}
+
+auto Bvh::cost() const -> double
+{
+    if (_nodes.empty())
+        return 0.0;
+
+    auto root_area = _nodes.front().bounds.surface_area();
+
+    if (root_area == 0.0)
+        return 0.0;
+
+    auto area = 0.0;
+
+    for (const auto& node : _nodes)
+        area += node.bounds.surface_area();
+
+    return area / root_area;
+}
+
+auto Bvh::closest_hit(ObjectSpan objects, const Ray& ray, Interval interval) const -> std::optional<Hit>
+{
+    if (_nodes.empty())
+        return std::nullopt;
+
+    return closest_hit(objects, ray, interval, 0);
+}
+
+auto Bvh::occluded(ObjectSpan objects, const Ray& ray, Interval interval) const -> bool
+{
+    if (_nodes.empty())
+        return false;
+
+    const auto inverse_direction = 1.0 / ray.direction();
+
+    auto stack = std::array<u32, max_depth>{};
+    usize stack_size = 0;
+    stack[stack_size++] = 0;
+
+    // Any hit will do, so children are visited in whatever order they were pushed.
+    while (stack_size != 0)
+    {
+        const auto node_index = stack[--stack_size];
+        const auto& node = _nodes[node_index];
+
+        if (!node.bounds.entry(ray, inverse_direction, interval))
+            continue;
+
+        if (node.count != 0)
+        {
+            for (u32 i = node.offset; i < node.offset + node.count; i++)
+            {
+                if (objects[_indices[i]]->occludes(ray, interval))
+                    return true;
+            }
+
+            continue;
+        }
+
+        TRACER_ASSERT(stack_size + 2 <= stack.size());
+        stack[stack_size++] = node.offset;
+        stack[stack_size++] = node_index + 1;
+    }
+
+    return false;
+}
+
+auto Bvh::closest_hits(ObjectSpan objects, const RayPacket& packet, Interval interval,
+                       std::span<std::optional<Hit>> hits) const -> void
+{
+    const auto ray_count = packet.directions.size();
+    TRACER_ASSERT(ray_count <= max_packet_size && hits.size() == ray_count);
+
+    std::ranges::fill(hits, std::nullopt);
+
+    if (_nodes.empty())
+        return;
+
+    // Kept as separate arrays so that the slab test below runs over all rays in lockstep and vectorizes.
+    alignas(64) auto inverse_x = std::array<double, max_packet_size>{};
+    alignas(64) auto inverse_y = std::array<double, max_packet_size>{};
+    alignas(64) auto inverse_z = std::array<double, max_packet_size>{};
+    alignas(64) auto t_max = std::array<double, max_packet_size>{};
+    auto entered = std::array<bool, max_packet_size>{};
+    auto active = std::array<u8, max_packet_size>{};
+
+    for (usize i = 0; i < ray_count; i++)
+    {
+        inverse_x[i] = 1.0 / packet.directions[i].x;
+        inverse_y[i] = 1.0 / packet.directions[i].y;
+        inverse_z[i] = 1.0 / packet.directions[i].z;
+        t_max[i] = interval.max;
+    }
+
+    // Same ordering of comparisons as Aabb::entry(), so that a packet ray reaches exactly the nodes it would alone.
+    auto clip = [](double t0, double t1, double inverse, double& near, double& far) {
+        const auto entry = inverse < 0.0 ? t1 : t0;
+        const auto exit = inverse < 0.0 ? t0 : t1;
+        near = entry > near ? entry : near;
+        far = exit < far ? exit : far;
+    };
+
+    auto stack = std::array<u32, max_depth>{};
+    usize stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size != 0)
+    {
+        const auto node_index = stack[--stack_size];
+        const auto& node = _nodes[node_index];
+
+        if (packet.frustum.excludes(node.bounds))
+            continue;
+
+        const auto min = node.bounds.min - packet.origin;
+        const auto max = node.bounds.max - packet.origin;
+
+        for (usize i = 0; i < ray_count; i++)
+        {
+            auto near = interval.min;
+            auto far = t_max[i];
+            clip(min.x * inverse_x[i], max.x * inverse_x[i], inverse_x[i], near, far);
+            clip(min.y * inverse_y[i], max.y * inverse_y[i], inverse_y[i], near, far);
+            clip(min.z * inverse_z[i], max.z * inverse_z[i], inverse_z[i], near, far);
+            entered[i] = near <= far;
+        }
+
+        usize active_count = 0;
+
+        for (usize i = 0; i < ray_count; i++)
+        {
+            if (entered[i])
+                active[active_count++] = static_cast<u8>(i);
+        }
+
+        if (active_count == 0)
+            continue;
+
+        auto ray = [&](usize i) { return Ray{ packet.origin, packet.directions[i] }; };
+
+        // The packet has diverged, testing every ray against every node below would mostly be wasted work.
+        if (active_count * 4 < ray_count)
+        {
+            for (usize j = 0; j < active_count; j++)
+            {
+                const auto i = active[j];
+
+                if (auto hit = closest_hit(objects, ray(i), Interval{ .min = interval.min, .max = t_max[i] },
+                                           node_index))
+                {
+                    hits[i] = hit;
+                    t_max[i] = hit->t;
+                }
+            }
+
+            continue;
+        }
+
+        if (node.count != 0)
+        {
+            for (u32 object = node.offset; object < node.offset + node.count; object++)
+            {
+                for (usize j = 0; j < active_count; j++)
+                {
+                    const auto i = active[j];
+
+                    if (auto hit = objects[_indices[object]]->hit(ray(i), Interval{ .min = interval.min,
+                                                                                      .max = t_max[i] }))
+                    {
+                        hits[i] = hit;
+                        t_max[i] = hit->t;
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        // The rays of a packet mostly agree on direction, so the first active one decides the order for all of them.
+        const auto left = node_index + 1;
+        const auto right = node.offset;
+        const auto right_first = packet.directions[active[0]][node.axis] < 0.0;
+
+        TRACER_ASSERT(stack_size + 2 <= stack.size());
+        stack[stack_size++] = right_first ? left : right;
+        stack[stack_size++] = right_first ? right : left;
+    }
+}
+
+auto Bvh::closest_hit(ObjectSpan objects, const Ray& ray, Interval interval, u32 root) const -> std::optional<Hit>
+{
+    const auto inverse_direction = 1.0 / ray.direction();
+    auto closest = std::optional<Hit>{};
+
+    auto stack = std::array<u32, max_depth>{};
+    usize stack_size = 0;
+    stack[stack_size++] = root;
+
+    while (stack_size != 0)
+    {
+        const auto& node = _nodes[stack[--stack_size]];
+
+        if (!node.bounds.entry(ray, inverse_direction, interval))
+            continue;
+
+        if (node.count != 0)
+        {
+            for (u32 i = node.offset; i < node.offset + node.count; i++)
+            {
+                if (auto hit = objects[_indices[i]]->hit(ray, interval))
+                {
+                    closest = hit;
+                    interval.max = closest->t;
+                }
+            }
+
+            continue;
+        }
+
+        // Visit the child on the side the ray comes from first, so the interval shrinks as early as possible.
+        const auto left = static_cast<u32>(&node - _nodes.data()) + 1;
+        const auto right = node.offset;
+        const auto right_first = ray.direction()[node.axis] < 0.0;
+
+        TRACER_ASSERT(stack_size + 2 <= stack.size());
+        stack[stack_size++] = right_first ? left : right;
+        stack[stack_size++] = right_first ? right : left;
+    }
+
+    return closest;
+}
+
+} // namespace tracer
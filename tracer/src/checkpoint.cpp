@@ -0,0 +1,173 @@
+#include "tracer/checkpoint.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <system_error>
+
+#include "tracer/accumulation.hpp"
+#include "tracer/common.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Layout (native endianness):
+//   magic, version, scene hash, width, height, camera, render params,
+//   uniform count flag, then either one sample count or one per pixel,
+//   one f32 RGB sum per pixel.
+constexpr auto magic = std::array<char, 4>{ 'P', 'T', 'C', 'K' };
+constexpr u32 version = 2;
+
+template<typename T> auto write_value(std::ofstream& file, const T& value) -> void
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T> auto write_span(std::ofstream& file, std::span<const T> values) -> void
+{
+    file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size_bytes()));
+}
+
+template<typename T> [[nodiscard]] auto read_value(std::ifstream& file, T& value) -> bool
+{
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template<typename T> [[nodiscard]] auto read_span(std::ifstream& file, std::span<T> values) -> bool
+{
+    return static_cast<bool>(
+        file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size_bytes())));
+}
+
+} // namespace
+
+auto write_checkpoint(const std::filesystem::path& path, const Checkpoint& checkpoint) -> bool
+{
+    // Write to a temporary file first, so a crash mid-write never destroys the previous checkpoint.
+    auto temporary_path = path;
+    temporary_path += ".tmp";
+
+    {
+        auto file = std::ofstream{ temporary_path, std::ios::binary | std::ios::trunc };
+
+        if (!file)
+            return false;
+
+        const auto& accumulation = checkpoint.accumulation;
+        auto sample_counts = accumulation.sample_counts();
+        auto uniform_counts = static_cast<u8>(
+            sample_counts.empty() || std::ranges::all_of(sample_counts, [&](u32 c) { return c == sample_counts[0]; }));
+
+        write_value(file, magic);
+        write_value(file, version);
+        write_value(file, checkpoint.scene_hash);
+        write_value(file, u64{ accumulation.width() });
+        write_value(file, u64{ accumulation.height() });
+        write_value(file, checkpoint.camera.position);
+        write_value(file, checkpoint.camera.focal_length);
+        write_value(file, u64{ checkpoint.render_params.samples });
+        write_value(file, u64{ checkpoint.render_params.max_depth });
+        write_value(file, checkpoint.render_params.seed);
+        write_value(file, uniform_counts);
+
+        if (uniform_counts)
+            write_value(file, sample_counts.empty() ? u32{ 0 } : sample_counts[0]);
+        else
+            write_span(file, sample_counts);
+
+        write_span(file, accumulation.sums());
+
+        if (!file.flush())
+            return false;
+    }
+
+    auto error = std::error_code{};
+    std::filesystem::rename(temporary_path, path, error);
+    return !error;
+}
+
+auto read_checkpoint(const std::filesystem::path& path) -> std::optional<Checkpoint>
+{
+    auto file = std::ifstream{ path, std::ios::binary };
+
+    if (!file)
+        return std::nullopt;
+
+    auto file_magic = std::array<char, 4>{};
+    auto file_version = u32{ 0 };
+
+    if (!read_value(file, file_magic) || file_magic != magic)
+        return std::nullopt;
+
+    if (!read_value(file, file_version) || file_version != version)
+        return std::nullopt;
+
+    auto checkpoint = Checkpoint{};
+    auto width = u64{ 0 };
+    auto height = u64{ 0 };
+    auto samples = u64{ 0 };
+    auto max_depth = u64{ 0 };
+    auto uniform_counts = u8{ 0 };
+
+    auto valid = read_value(file, checkpoint.scene_hash) && read_value(file, width) && read_value(file, height)
+                 && read_value(file, checkpoint.camera.position) && read_value(file, checkpoint.camera.focal_length)
+                 && read_value(file, samples) && read_value(file, max_depth)
+                 && read_value(file, checkpoint.render_params.seed) && read_value(file, uniform_counts);
+
+    if (!valid || uniform_counts > 1)
+        return std::nullopt;
+
+    // The size is checked against the rest of the file before allocating for it, so that a corrupt or truncated file
+    // is rejected instead of allocating for a bogus size, or reading past a buffer whose size wrapped around. Each
+    // side is divided into what is left rather than multiplied, so that the check itself can't overflow.
+    auto error = std::error_code{};
+    const auto file_size = std::filesystem::file_size(path, error);
+    const auto position = file.tellg();
+
+    if (error || position < 0 || file_size < static_cast<u64>(position))
+        return std::nullopt;
+
+    const auto remaining = file_size - static_cast<u64>(position);
+    const auto count_bytes = u64{ uniform_counts ? sizeof(u32) : 0 };
+    const auto pixel_bytes = u64{ sizeof(glm::vec3) + (uniform_counts ? 0 : sizeof(u32)) };
+
+    if (remaining < count_bytes || (width != 0 && height > (remaining - count_bytes) / pixel_bytes / width)
+        || count_bytes + width * height * pixel_bytes != remaining)
+    {
+        return std::nullopt;
+    }
+
+    checkpoint.render_params.samples = samples;
+    checkpoint.render_params.max_depth = max_depth;
+
+    auto& accumulation = checkpoint.accumulation;
+    accumulation.resize(width, height);
+
+    if (uniform_counts)
+    {
+        auto count = u32{ 0 };
+
+        if (!read_value(file, count))
+            return std::nullopt;
+
+        std::ranges::fill(accumulation.sample_counts(), count);
+    }
+    else if (!read_span(file, accumulation.sample_counts()))
+    {
+        return std::nullopt;
+    }
+
+    if (!read_span(file, accumulation.sums()))
+        return std::nullopt;
+
+    return checkpoint;
+}
+
+} // namespace tracer
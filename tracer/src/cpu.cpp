@@ -0,0 +1,205 @@
+#include "tracer/cpu.hpp"
+
+#if defined(PT_KERNEL_DISPATCH) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "tracer/common.hpp"
+#include "tracer/kernels.hpp"
+
+namespace tracer {
+
+// Kernel tables of the builds of kernels.cpp.
+namespace baseline {
+extern const Kernels kernels;
+} // namespace baseline
+
+#ifdef PT_KERNEL_DISPATCH
+namespace avx2 {
+extern const Kernels kernels;
+} // namespace avx2
+
+namespace avx512 {
+extern const Kernels kernels;
+} // namespace avx512
+
+#ifdef PT_KERNEL_SSE42
+namespace sse42 {
+extern const Kernels kernels;
+} // namespace sse42
+#endif
+#endif
+
+namespace {
+
+constexpr auto instruction_set_names = std::array{
+    std::pair{ InstructionSet::Baseline, std::string_view{ "baseline" } },
+    std::pair{ InstructionSet::Sse42, std::string_view{ "sse4.2" } },
+    std::pair{ InstructionSet::Avx2, std::string_view{ "avx2" } },
+    std::pair{ InstructionSet::Avx512, std::string_view{ "avx512" } },
+};
+
+#ifdef PT_KERNEL_DISPATCH
+
+#if defined(_MSC_VER) && !defined(__clang__)
+
+[[nodiscard]] auto cpu_supports(InstructionSet instruction_set) -> bool
+{
+    auto registers = std::array<int, 4>{};
+    auto bit = [&](usize index, u32 position) { return (static_cast<u32>(registers[index]) >> position & 1) != 0; };
+
+    __cpuid(registers.data(), 0);
+    const auto max_leaf = registers[0];
+
+    __cpuid(registers.data(), 1);
+    const auto sse42 = bit(2, 20);
+    const auto os_saves_ymm = bit(2, 27) && (_xgetbv(0) & 0x6) == 0x6;
+    // Opmask registers and both halves of the upper 16 ZMM registers, on top of the YMM state.
+    const auto os_saves_zmm = os_saves_ymm && (_xgetbv(0) & 0xe6) == 0xe6;
+
+    auto avx2 = false;
+    auto avx512 = false;
+
+    if (max_leaf >= 7)
+    {
+        __cpuidex(registers.data(), 7, 0);
+        avx2 = bit(1, 5);
+        avx512 = bit(1, 16) && bit(1, 30) && bit(1, 31); // F, BW and VL.
+    }
+
+    switch (instruction_set)
+    {
+    case InstructionSet::Baseline:
+        return true;
+    case InstructionSet::Sse42:
+        return sse42;
+    case InstructionSet::Avx2:
+        return avx2 && os_saves_ymm;
+    case InstructionSet::Avx512:
+        return avx512 && os_saves_zmm;
+    }
+
+    return false;
+}
+
+#else
+
+// The builtins read CPUID and also check that the operating system saves the wider registers.
+[[nodiscard]] auto cpu_supports(InstructionSet instruction_set) -> bool
+{
+    __builtin_cpu_init();
+
+    switch (instruction_set)
+    {
+    case InstructionSet::Baseline:
+        return true;
+    case InstructionSet::Sse42:
+        return __builtin_cpu_supports("sse4.2");
+    case InstructionSet::Avx2:
+        return __builtin_cpu_supports("avx2");
+    case InstructionSet::Avx512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+               && __builtin_cpu_supports("avx512vl");
+    }
+
+    return false;
+}
+
+#endif
+
+#endif
+
+[[nodiscard]] auto selected_instruction_set() -> std::atomic<InstructionSet>&
+{
+    static auto selected = std::atomic{ detect_instruction_set() };
+    return selected;
+}
+
+} // namespace
+
+auto instruction_set_name(InstructionSet instruction_set) -> std::string_view
+{
+    for (const auto& [value, name] : instruction_set_names)
+    {
+        if (value == instruction_set)
+            return name;
+    }
+
+    return "unknown";
+}
+
+auto parse_instruction_set(std::string_view name) -> std::optional<InstructionSet>
+{
+    for (const auto& [value, value_name] : instruction_set_names)
+    {
+        if (value_name == name)
+            return value;
+    }
+
+    return std::nullopt;
+}
+
+auto detect_instruction_set() -> InstructionSet
+{
+#ifdef PT_KERNEL_DISPATCH
+    if (cpu_supports(InstructionSet::Avx512))
+        return InstructionSet::Avx512;
+
+    if (cpu_supports(InstructionSet::Avx2))
+        return InstructionSet::Avx2;
+
+#ifdef PT_KERNEL_SSE42
+    if (cpu_supports(InstructionSet::Sse42))
+        return InstructionSet::Sse42;
+#endif
+#endif
+
+    return InstructionSet::Baseline;
+}
+
+auto instruction_set() -> InstructionSet
+{
+    return selected_instruction_set().load(std::memory_order_relaxed);
+}
+
+auto set_instruction_set(InstructionSet instruction_set) -> bool
+{
+    if (instruction_set > detect_instruction_set())
+        return false;
+
+#ifndef PT_KERNEL_SSE42
+    // Builds without an SSE4.2 variant, such as those with MSVC, run the baseline in its place.
+    if (instruction_set == InstructionSet::Sse42)
+        instruction_set = InstructionSet::Baseline;
+#endif
+
+    selected_instruction_set().store(instruction_set, std::memory_order_relaxed);
+    return true;
+}
+
+auto kernels() -> const Kernels&
+{
+    switch (instruction_set())
+    {
+#ifdef PT_KERNEL_DISPATCH
+    case InstructionSet::Avx512:
+        return avx512::kernels;
+    case InstructionSet::Avx2:
+        return avx2::kernels;
+#ifdef PT_KERNEL_SSE42
+    case InstructionSet::Sse42:
+        return sse42::kernels;
+#endif
+#endif
+    default:
+        return baseline::kernels;
+    }
+}
+
+} // namespace tracer
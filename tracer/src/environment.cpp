@@ -0,0 +1,178 @@
+#include "tracer/environment.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/assert.hpp"
+#include "tracer/color.hpp"
+#include "tracer/common.hpp"
+#include "tracer/defer.hpp"
+#include "tracer/random.hpp"
+#include "tracer/trigonometric.hpp"
+
+namespace tracer {
+
+EnvironmentMap::EnvironmentMap(u32 width, u32 height, std::span<const float> rgb, float scale)
+    : _width{ width }, _height{ height }, _texels(usize{ width } * height)
+{
+    TRACER_ASSERT(width != 0 && height != 0 && rgb.size() == 3 * _texels.size());
+
+    for (usize i = 0; i < _texels.size(); i++)
+        _texels[i].radiance = glm::vec3{ rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2] } * scale;
+
+    build_alias_table();
+}
+
+auto EnvironmentMap::load(const std::filesystem::path& path, float scale) -> std::optional<EnvironmentMap>
+{
+    auto width = 0;
+    auto height = 0;
+    auto channels = 0;
+    auto* pixels = stbi_loadf(path.string().c_str(), &width, &height, &channels, 3);
+
+    if (!pixels)
+        return std::nullopt;
+
+    Defer free_pixels{ [&] { stbi_image_free(pixels); } };
+
+    const auto texel_count = static_cast<usize>(width) * static_cast<usize>(height);
+
+    return EnvironmentMap{ static_cast<u32>(width), static_cast<u32>(height), std::span{ pixels, 3 * texel_count },
+                           scale };
+}
+
+auto EnvironmentMap::build_alias_table() -> void
+{
+    // Rows near the poles cover less solid angle, which the sine of their polar angle accounts for.
+    auto weights = std::vector<double>(_texels.size());
+    auto total = 0.0;
+
+    for (u32 row = 0; row < _height; row++)
+    {
+        const auto sine = std::sin(pi * (row + 0.5) / _height);
+
+        for (u32 column = 0; column < _width; column++)
+        {
+            const auto index = usize{ row } * _width + column;
+            weights[index] = static_cast<double>(luminance(_texels[index].radiance)) * sine;
+            total += weights[index];
+        }
+    }
+
+    // A black map is never sampled for its light, but the densities should still be consistent.
+    if (total <= 0.0)
+    {
+        total = 0.0;
+
+        for (u32 row = 0; row < _height; row++)
+        {
+            const auto sine = std::sin(pi * (row + 0.5) / _height);
+
+            for (u32 column = 0; column < _width; column++)
+            {
+                weights[usize{ row } * _width + column] = sine;
+                total += sine;
+            }
+        }
+    }
+
+    // Vose's method: pair every texel below the average weight with one above it, which fills the rest of its slot.
+    const auto count = static_cast<double>(_texels.size());
+    auto small = std::vector<u32>{};
+    auto large = std::vector<u32>{};
+
+    for (usize i = 0; i < _texels.size(); i++)
+    {
+        _texels[i].probability = static_cast<float>(weights[i] / total);
+        weights[i] *= count / total;
+        (weights[i] < 1.0 ? small : large).push_back(static_cast<u32>(i));
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        const auto less = small.back();
+        const auto more = large.back();
+        small.pop_back();
+
+        _texels[less].threshold = static_cast<float>(weights[less]);
+        _texels[less].alias = more;
+
+        weights[more] -= 1.0 - weights[less];
+
+        if (weights[more] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+
+    // Whatever is left is at the average weight, up to rounding.
+    for (auto index : small)
+        _texels[index] = Texel{ .radiance = _texels[index].radiance, .probability = _texels[index].probability };
+
+    for (auto index : large)
+        _texels[index] = Texel{ .radiance = _texels[index].radiance, .probability = _texels[index].probability };
+}
+
+auto EnvironmentMap::radiance(const glm::dvec3& direction) const -> glm::vec3
+{
+    return _texels[texel_index(direction)].radiance;
+}
+
+auto EnvironmentMap::sample(Random& random) const -> Sample
+{
+    // The fraction of the slot position decides between the texel and its alias.
+    const auto slot_position = random.get_double() * static_cast<double>(_texels.size());
+    const auto slot = std::min(static_cast<usize>(slot_position), _texels.size() - 1);
+    const auto keep = slot_position - static_cast<double>(slot) < static_cast<double>(_texels[slot].threshold);
+    const auto index = keep ? slot : usize{ _texels[slot].alias };
+
+    const auto row = index / _width;
+    const auto column = index % _width;
+
+    const auto theta = pi * (static_cast<double>(row) + random.get_double()) / _height;
+    const auto phi = 2.0 * pi * (static_cast<double>(column) + random.get_double()) / _width - pi;
+    const auto sine = std::sin(theta);
+
+    const auto direction = glm::dvec3{ sine * std::sin(phi), std::cos(theta), -sine * std::cos(phi) };
+    const auto& texel = _texels[index];
+
+    // Uniform within the texel's rectangle of angles, which covers sin(theta) times less solid angle than area.
+    const auto pdf = sine > 0.0 ? static_cast<double>(texel.probability) * static_cast<double>(_texels.size())
+                                      / (2.0 * pi * pi * sine)
+                                : 0.0;
+
+    return Sample{ .direction = direction, .radiance = texel.radiance, .pdf = pdf };
+}
+
+auto EnvironmentMap::pdf(const glm::dvec3& direction) const -> double
+{
+    const auto sine = std::sqrt(std::max(1.0 - direction.y * direction.y, 0.0));
+
+    if (sine == 0.0)
+        return 0.0;
+
+    return static_cast<double>(_texels[texel_index(direction)].probability) * static_cast<double>(_texels.size())
+           / (2.0 * pi * pi * sine);
+}
+
+auto EnvironmentMap::texel_index(const glm::dvec3& direction) const -> usize
+{
+    const auto theta = std::acos(std::clamp(direction.y, -1.0, 1.0));
+    const auto phi = std::atan2(direction.x, -direction.z);
+
+    const auto row = std::min(static_cast<usize>(theta / pi * _height), usize{ _height } - 1);
+    const auto column = std::min(static_cast<usize>((phi + pi) / (2.0 * pi) * _width), usize{ _width } - 1);
+
+    return row * _width + column;
+}
+
+} // namespace tracer
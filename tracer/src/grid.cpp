@@ -0,0 +1,328 @@
+#include "tracer/grid.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/assert.hpp"
+#include "tracer/common.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Cells per object. More cells mean fewer candidates per cell but more cells to step through.
+constexpr double dense_density = 2.0;
+constexpr double hashed_density = 8.0;
+
+constexpr usize max_dense_cells = usize{ 1 } << 24;
+constexpr usize max_cells_per_axis = usize{ 1 } << 20;
+
+// Objects with a bounding box diagonal this many times larger than the median are kept out of the grid.
+constexpr double large_object_factor = 32.0;
+
+using CellRange = std::array<std::array<usize, 3>, 2>;
+
+// Runs work(begin, end) over chunks of [0, count) on every hardware thread.
+template<typename Work> auto parallel_for(usize count, const Work& work) -> void
+{
+    const auto thread_count =
+        std::clamp(usize{ std::thread::hardware_concurrency() }, usize{ 1 }, std::max(count / 1024, usize{ 1 }));
+    const auto chunk = (count + thread_count - 1) / thread_count;
+
+    auto threads = std::vector<std::jthread>{};
+    threads.reserve(thread_count);
+
+    for (usize begin = 0; begin < count; begin += chunk)
+        threads.emplace_back([&work, begin, end = std::min(begin + chunk, count)] { work(begin, end); });
+}
+
+[[nodiscard]] auto hash_cell(const std::array<usize, 3>& cell) -> usize
+{
+    return (cell[0] * 73856093u) ^ (cell[1] * 19349663u) ^ (cell[2] * 83492791u);
+}
+
+} // namespace
+
+Grid::Grid(ObjectSpan objects, Storage storage) : _storage{ storage }
+{
+    if (objects.empty())
+        return;
+
+    auto object_bounds = std::vector<Aabb>(objects.size());
+    parallel_for(objects.size(), [&](usize begin, usize end) {
+        for (auto i = begin; i < end; i++)
+            object_bounds[i] = objects[i]->bounds();
+    });
+
+    // Split off the objects that would cover a large part of the grid.
+    auto diagonals = std::vector<double>(objects.size());
+
+    for (usize i = 0; i < objects.size(); i++)
+        diagonals[i] = glm::length(object_bounds[i].extent());
+
+    auto median = diagonals;
+    std::ranges::nth_element(median, median.begin() + static_cast<isize>(median.size() / 2));
+    const auto max_diagonal = large_object_factor * median[median.size() / 2];
+
+    auto grid_objects = std::vector<u32>{};
+
+    for (usize i = 0; i < objects.size(); i++)
+    {
+        if (diagonals[i] > max_diagonal)
+        {
+            _large_objects.push_back(static_cast<u32>(i));
+        }
+        else
+        {
+            grid_objects.push_back(static_cast<u32>(i));
+            _bounds.expand(object_bounds[i]);
+        }
+    }
+
+    if (grid_objects.empty())
+        return;
+
+    // Cells are roughly cubic, with their count proportional to the number of objects.
+    const auto extent = glm::max(_bounds.extent(), glm::dvec3{ 1e-9 });
+    const auto volume = extent.x * extent.y * extent.z;
+    const auto density = storage == Storage::Dense ? dense_density : hashed_density;
+    auto cells_per_unit = std::cbrt(density * static_cast<double>(grid_objects.size()) / volume);
+
+    auto resolve = [&] {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            auto cells = static_cast<usize>(std::ceil(extent[axis] * cells_per_unit));
+            _resolution[static_cast<usize>(axis)] = std::clamp(cells, usize{ 1 }, max_cells_per_axis);
+        }
+    };
+
+    resolve();
+
+    while (storage == Storage::Dense && _resolution[0] * _resolution[1] * _resolution[2] > max_dense_cells)
+    {
+        cells_per_unit *= 0.8;
+        resolve();
+    }
+
+    _cell_size = extent / glm::dvec3{ static_cast<double>(_resolution[0]), static_cast<double>(_resolution[1]),
+                                      static_cast<double>(_resolution[2]) };
+
+    auto cell_range = [&](const Aabb& bounds) {
+        auto range = CellRange{};
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const auto a = static_cast<usize>(axis);
+            const auto last = static_cast<double>(_resolution[a] - 1);
+            auto low = std::floor((bounds.min[axis] - _bounds.min[axis]) / _cell_size[axis]);
+            auto high = std::floor((bounds.max[axis] - _bounds.min[axis]) / _cell_size[axis]);
+            range[0][a] = static_cast<usize>(std::clamp(low, 0.0, last));
+            range[1][a] = static_cast<usize>(std::clamp(high, 0.0, last));
+        }
+
+        return range;
+    };
+
+    auto for_each_cell = [](const CellRange& range, const auto& function) {
+        for (auto z = range[0][2]; z <= range[1][2]; z++)
+        {
+            for (auto y = range[0][1]; y <= range[1][1]; y++)
+            {
+                for (auto x = range[0][0]; x <= range[1][0]; x++)
+                    function(std::array{ x, y, z });
+            }
+        }
+    };
+
+    // The hash table gets one bucket per object reference, so buckets hold about one cell each.
+    auto slot_count = _resolution[0] * _resolution[1] * _resolution[2];
+
+    if (storage == Storage::Hashed)
+    {
+        auto references = std::atomic<usize>{ 0 };
+        parallel_for(grid_objects.size(), [&](usize begin, usize end) {
+            usize count = 0;
+
+            for (auto i = begin; i < end; i++)
+            {
+                auto range = cell_range(object_bounds[grid_objects[i]]);
+                count += (range[1][0] - range[0][0] + 1) * (range[1][1] - range[0][1] + 1)
+                         * (range[1][2] - range[0][2] + 1);
+            }
+
+            references += count;
+        });
+
+        slot_count = std::bit_ceil(references.load());
+    }
+
+    _slot_offsets.assign(slot_count + 1, 0);
+
+    // Count the objects of every slot, turn the counts into offsets, then fill the slots in parallel.
+    {
+        auto counts = std::make_unique<std::atomic<u32>[]>(slot_count);
+
+        parallel_for(grid_objects.size(), [&](usize begin, usize end) {
+            for (auto i = begin; i < end; i++)
+            {
+                for_each_cell(cell_range(object_bounds[grid_objects[i]]), [&](const std::array<usize, 3>& cell) {
+                    counts[slot(cell)].fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+        });
+
+        for (usize i = 0; i < slot_count; i++)
+            _slot_offsets[i + 1] = _slot_offsets[i] + counts[i].load(std::memory_order_relaxed);
+
+        for (usize i = 0; i < slot_count; i++)
+            counts[i].store(_slot_offsets[i], std::memory_order_relaxed);
+
+        _slot_objects.resize(_slot_offsets.back());
+
+        parallel_for(grid_objects.size(), [&](usize begin, usize end) {
+            for (auto i = begin; i < end; i++)
+            {
+                for_each_cell(cell_range(object_bounds[grid_objects[i]]), [&](const std::array<usize, 3>& cell) {
+                    _slot_objects[counts[slot(cell)].fetch_add(1, std::memory_order_relaxed)] = grid_objects[i];
+                });
+            }
+        });
+    }
+
+    // Threads filled the slots in arbitrary order. Sorting them keeps renders deterministic when hits tie.
+    parallel_for(slot_count, [&](usize begin, usize end) {
+        for (auto i = begin; i < end; i++)
+        {
+            std::sort(_slot_objects.begin() + _slot_offsets[i], _slot_objects.begin() + _slot_offsets[i + 1]);
+        }
+    });
+}
+
+auto Grid::slot(const std::array<usize, 3>& cell) const -> usize
+{
+    if (_storage == Storage::Hashed)
+        return hash_cell(cell) & (slot_count() - 1);
+
+    return (cell[2] * _resolution[1] + cell[1]) * _resolution[0] + cell[0];
+}
+
+auto Grid::closest_hit(ObjectSpan objects, const Ray& ray, Interval interval) const -> std::optional<Hit>
+{
+    auto closest = std::optional<Hit>{};
+
+    traverse(ray, interval, [&](u32 index) {
+        if (auto hit = objects[index]->hit(ray, interval))
+        {
+            closest = hit;
+            interval.max = closest->t;
+        }
+
+        return false;
+    });
+
+    return closest;
+}
+
+auto Grid::occluded(ObjectSpan objects, const Ray& ray, Interval interval) const -> bool
+{
+    auto occluded = false;
+
+    traverse(ray, interval, [&](u32 index) {
+        occluded = objects[index]->occludes(ray, interval);
+        return occluded;
+    });
+
+    return occluded;
+}
+
+template<typename ObjectVisitor>
+auto Grid::traverse(const Ray& ray, Interval& interval, ObjectVisitor&& visit) const -> void
+{
+    for (auto index : _large_objects)
+    {
+        if (visit(index))
+            return;
+    }
+
+    if (_slot_offsets.empty())
+        return;
+
+    const auto inverse_direction = 1.0 / ray.direction();
+    const auto entry = _bounds.entry(ray, inverse_direction, interval);
+
+    if (!entry)
+        return;
+
+    // Start in the cell containing the entry point and step from cell boundary to cell boundary.
+    auto cell = std::array<usize, 3>{};
+    auto step = std::array<isize, 3>{};
+    auto next_crossing = glm::dvec3{ +infinity };
+    auto crossing_delta = glm::dvec3{ +infinity };
+    const auto entry_point = ray.at(*entry);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const auto a = static_cast<usize>(axis);
+        const auto position = (entry_point[axis] - _bounds.min[axis]) / _cell_size[axis];
+        cell[a] = static_cast<usize>(std::clamp(std::floor(position), 0.0, static_cast<double>(_resolution[a] - 1)));
+
+        const auto direction = ray.direction()[axis];
+
+        if (direction > 0.0)
+        {
+            step[a] = 1;
+            auto boundary = _bounds.min[axis] + static_cast<double>(cell[a] + 1) * _cell_size[axis];
+            next_crossing[axis] = (boundary - ray.origin()[axis]) * inverse_direction[axis];
+            crossing_delta[axis] = _cell_size[axis] * inverse_direction[axis];
+        }
+        else if (direction < 0.0)
+        {
+            step[a] = -1;
+            auto boundary = _bounds.min[axis] + static_cast<double>(cell[a]) * _cell_size[axis];
+            next_crossing[axis] = (boundary - ray.origin()[axis]) * inverse_direction[axis];
+            crossing_delta[axis] = -_cell_size[axis] * inverse_direction[axis];
+        }
+    }
+
+    while (true)
+    {
+        const auto slot_index = slot(cell);
+
+        for (auto i = _slot_offsets[slot_index]; i < _slot_offsets[slot_index + 1]; i++)
+        {
+            if (visit(_slot_objects[i]))
+                return;
+        }
+
+        const auto axis = next_crossing.x < next_crossing.y ? (next_crossing.x < next_crossing.z ? 0 : 2)
+                                                            : (next_crossing.y < next_crossing.z ? 1 : 2);
+        const auto a = static_cast<usize>(axis);
+
+        // Every cell after this one is farther away than the closest hit.
+        if (next_crossing[axis] > interval.max)
+            break;
+
+        if ((step[a] < 0 && cell[a] == 0) || (step[a] > 0 && cell[a] + 1 == _resolution[a]) || step[a] == 0)
+            break;
+
+        cell[a] = static_cast<usize>(static_cast<isize>(cell[a]) + step[a]);
+        next_crossing[axis] += crossing_delta[axis];
+    }
+}
+
+} // namespace tracer
@@ -0,0 +1,365 @@
+#include "tracer/guiding.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/assert.hpp"
+#include "tracer/common.hpp"
+#include "tracer/random.hpp"
+#include "tracer/trigonometric.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Recorded weights are summed as integers in units of 2^-20, so that sums do not depend on their order. Clamping
+// keeps the rare huge weight from overflowing them.
+constexpr double fixed_point_scale = 1 << 20;
+constexpr double max_weight = 1 << 24;
+
+// Directional trees stop at about 0.0004 degrees wide cells, spatial ones well below any scene's feature size.
+constexpr u32 max_directional_depth = 20;
+constexpr u32 max_spatial_depth = 48;
+
+// Half of the bounces follow the learnt distribution, the rest the cosine.
+constexpr double guiding_fraction = 0.5;
+
+constexpr auto no_node = std::numeric_limits<usize>::max();
+
+[[nodiscard]] auto quadrant_offset(usize quadrant) -> glm::dvec2
+{
+    return glm::dvec2{ static_cast<double>(quadrant & 1), static_cast<double>(quadrant >> 1) };
+}
+
+[[nodiscard]] auto total(const std::array<float, 4>& energy) -> double
+{
+    return static_cast<double>(energy[0]) + static_cast<double>(energy[1]) + static_cast<double>(energy[2])
+           + static_cast<double>(energy[3]);
+}
+
+} // namespace
+
+auto to_square(const glm::dvec3& direction) -> glm::dvec2
+{
+    constexpr auto below_one = 1.0 - std::numeric_limits<double>::epsilon();
+
+    auto angle = std::atan2(direction.z, direction.x) / (2.0 * pi);
+
+    if (angle < 0.0)
+        angle += 1.0;
+
+    return glm::dvec2{ std::clamp((direction.y + 1.0) * 0.5, 0.0, below_one), std::min(angle, below_one) };
+}
+
+auto to_direction(const glm::dvec2& position) -> glm::dvec3
+{
+    const auto cosine = 2.0 * position.x - 1.0;
+    const auto sine = std::sqrt(std::max(1.0 - cosine * cosine, 0.0));
+    const auto angle = 2.0 * pi * position.y;
+
+    return glm::dvec3{ sine * std::cos(angle), cosine, sine * std::sin(angle) };
+}
+
+auto DirectionalTree::sample(Random& random) const -> glm::dvec3
+{
+    auto position = glm::dvec2{ 0.0 };
+    auto size = 1.0;
+
+    for (usize node = 0;;)
+    {
+        const auto& energy = _nodes[node].energy;
+        const auto node_energy = total(energy);
+
+        if (node_energy <= 0.0)
+            break;
+
+        auto u = random.get_double() * node_energy;
+        usize quadrant = 0;
+
+        while (quadrant < 3 && u >= static_cast<double>(energy[quadrant]))
+        {
+            u -= static_cast<double>(energy[quadrant]);
+            quadrant++;
+        }
+
+        // Rounding may run past the last quadrant with energy.
+        while (energy[quadrant] == 0.0f)
+            quadrant--;
+
+        size *= 0.5;
+        position += size * quadrant_offset(quadrant);
+
+        const auto child = _nodes[node].children[quadrant];
+
+        if (child == 0)
+            break;
+
+        node = child;
+    }
+
+    // Uniform within the leaf cell.
+    position += size * glm::dvec2{ random.get_double(), random.get_double() };
+    return to_direction(position);
+}
+
+auto DirectionalTree::pdf(const glm::dvec3& direction) const -> double
+{
+    // Cells of the square cover proportional solid angle, and the whole square 4 pi steradians.
+    auto density = 1.0 / (4.0 * pi);
+
+    visit_cells(direction, [&](usize slot) {
+        const auto& energy = _nodes[slot / 4].energy;
+        const auto node_energy = total(energy);
+
+        if (node_energy > 0.0)
+            density *= 4.0 * static_cast<double>(energy[slot % 4]) / node_energy;
+    });
+
+    return density;
+}
+
+auto DirectionalTree::energy() const -> double
+{
+    return total(_nodes.front().energy);
+}
+
+auto DirectionalTree::refined(double threshold, u32 max_depth) const -> DirectionalTree
+{
+    auto tree = DirectionalTree{};
+    const auto tree_energy = energy();
+
+    if (tree_energy <= 0.0)
+        return tree;
+
+    const auto& root = _nodes.front().energy;
+    tree._nodes.clear();
+    tree.refine_node(*this, 0, { root[0], root[1], root[2], root[3] }, threshold, tree_energy, 1, max_depth);
+
+    return tree;
+}
+
+auto DirectionalTree::refine_node(const DirectionalTree& source, usize source_node, const std::array<double, 4>& energy,
+                                  double threshold, double total_energy, u32 depth, u32 max_depth) -> u32
+{
+    const auto index = static_cast<u32>(_nodes.size());
+    _nodes.emplace_back();
+
+    if (depth >= max_depth)
+        return index;
+
+    for (usize quadrant = 0; quadrant < 4; quadrant++)
+    {
+        if (energy[quadrant] / total_energy <= threshold)
+            continue;
+
+        const auto source_child = source_node != no_node ? source._nodes[source_node].children[quadrant] : 0;
+        auto child_energy = std::array<double, 4>{};
+        auto child_source = no_node;
+
+        if (source_child != 0)
+        {
+            const auto& recorded = source._nodes[source_child].energy;
+            child_energy = { recorded[0], recorded[1], recorded[2], recorded[3] };
+            child_source = source_child;
+        }
+        else
+        {
+            // A new subdivision of a leaf, whose energy is assumed to be spread evenly.
+            child_energy.fill(energy[quadrant] / 4.0);
+        }
+
+        const auto child = refine_node(source, child_source, child_energy, threshold, total_energy, depth + 1,
+                                       max_depth);
+        _nodes[index].children[quadrant] = child;
+    }
+
+    return index;
+}
+
+auto DirectionalTree::set_energies(std::span<const u64> energies) -> void
+{
+    TRACER_ASSERT(energies.size() == _nodes.size() * 4);
+
+    for (usize slot = 0; slot < energies.size(); slot++)
+        _nodes[slot / 4].energy[slot % 4] = static_cast<float>(static_cast<double>(energies[slot]) / fixed_point_scale);
+}
+
+GuidingField::GuidingField(const Aabb& bounds) : _bounds{ bounds }, _nodes(1), _leaves(1)
+{
+    assign_slots();
+}
+
+auto GuidingField::find(const glm::dvec3& point) const -> const DirectionalTree*
+{
+    if (_leaves.empty())
+        return nullptr;
+
+    const auto& distribution = _leaves[leaf_index(point)].distribution;
+    return distribution.energy() > 0.0 ? &distribution : nullptr;
+}
+
+auto GuidingField::absorb(std::span<const GuidingRecorder> recorders) -> void
+{
+    auto energies = std::vector<u64>{};
+
+    for (usize leaf_index = 0; leaf_index < _leaves.size(); leaf_index++)
+    {
+        auto& leaf = _leaves[leaf_index];
+        energies.assign(leaf.distribution.node_count() * 4, 0);
+        leaf.samples = 0;
+
+        for (const auto& recorder : recorders)
+        {
+            TRACER_ASSERT(recorder._field == this);
+
+            for (usize slot = 0; slot < energies.size(); slot++)
+                energies[slot] += recorder._energies[leaf.first_slot + slot];
+
+            leaf.samples += recorder._samples[leaf_index];
+        }
+
+        leaf.distribution.set_energies(energies);
+    }
+}
+
+auto GuidingField::refined(u64 spatial_threshold, double directional_threshold) const -> GuidingField
+{
+    auto field = GuidingField{};
+
+    if (_nodes.empty())
+        return field;
+
+    field._bounds = _bounds;
+    field._nodes.emplace_back();
+    field.copy_node(*this, 0, 0, 0, spatial_threshold, directional_threshold);
+    field.assign_slots();
+
+    return field;
+}
+
+auto GuidingField::leaf_index(const glm::dvec3& point) const -> usize
+{
+    auto bounds = _bounds;
+    usize node = 0;
+
+    while (_nodes[node].child != 0)
+    {
+        const auto axis = _nodes[node].axis;
+        const auto middle = (bounds.min[axis] + bounds.max[axis]) * 0.5;
+
+        if (point[axis] < middle)
+        {
+            bounds.max[axis] = middle;
+            node = _nodes[node].child;
+        }
+        else
+        {
+            bounds.min[axis] = middle;
+            node = _nodes[node].child + 1;
+        }
+    }
+
+    return _nodes[node].leaf;
+}
+
+auto GuidingField::copy_node(const GuidingField& source, usize source_node, usize node, u32 depth,
+                             u64 spatial_threshold, double directional_threshold) -> void
+{
+    const auto& from = source._nodes[source_node];
+    _nodes[node].axis = from.axis;
+
+    if (from.child != 0)
+    {
+        const auto child = static_cast<u32>(_nodes.size());
+        _nodes[node].child = child;
+        _nodes.resize(_nodes.size() + 2);
+
+        copy_node(source, from.child, child, depth + 1, spatial_threshold, directional_threshold);
+        copy_node(source, from.child + 1, child + 1, depth + 1, spatial_threshold, directional_threshold);
+        return;
+    }
+
+    const auto& leaf = source._leaves[from.leaf];
+    split_leaf(node, leaf.distribution.refined(directional_threshold, max_directional_depth), leaf.samples, depth,
+               spatial_threshold);
+}
+
+auto GuidingField::split_leaf(usize node, const DirectionalTree& distribution, u64 samples, u32 depth,
+                              u64 spatial_threshold) -> void
+{
+    if (samples <= spatial_threshold || depth >= max_spatial_depth)
+    {
+        _nodes[node].leaf = static_cast<u32>(_leaves.size());
+        _leaves.push_back(Leaf{ .distribution = distribution });
+        return;
+    }
+
+    // Both halves start out with the distribution of the whole, and are assumed to receive half the samples.
+    const auto child = static_cast<u32>(_nodes.size());
+    const auto axis = static_cast<u8>((_nodes[node].axis + 1) % 3);
+    _nodes[node].child = child;
+    _nodes.resize(_nodes.size() + 2);
+    _nodes[child].axis = axis;
+    _nodes[child + 1].axis = axis;
+
+    split_leaf(child, distribution, samples / 2, depth + 1, spatial_threshold);
+    split_leaf(child + 1, distribution, samples / 2, depth + 1, spatial_threshold);
+}
+
+auto GuidingField::assign_slots() -> void
+{
+    _slot_count = 0;
+
+    for (auto& leaf : _leaves)
+    {
+        leaf.first_slot = _slot_count;
+        _slot_count += leaf.distribution.node_count() * 4;
+    }
+}
+
+GuidingRecorder::GuidingRecorder(const GuidingField& field)
+    : _field{ &field }, _energies(field._slot_count), _samples(field._leaves.size())
+{}
+
+auto GuidingRecorder::record(const glm::dvec3& point, const glm::dvec3& direction, double weight) -> void
+{
+    const auto leaf_index = _field->leaf_index(point);
+    const auto& leaf = _field->_leaves[leaf_index];
+    _samples[leaf_index]++;
+
+    if (!(weight > 0.0))
+        return;
+
+    const auto energy = static_cast<u64>(std::min(weight, max_weight) * fixed_point_scale + 0.5);
+    leaf.distribution.visit_cells(direction, [&](usize slot) { _energies[leaf.first_slot + slot] += energy; });
+}
+
+auto sample_guided_bounce(const DirectionalTree* distribution, const glm::dvec3& normal, Random& random)
+    -> GuidedBounce
+{
+    if (!distribution)
+    {
+        const auto direction = glm::normalize(normal + random.get_unit_dvec3());
+        return GuidedBounce{ .direction = direction, .pdf = std::max(glm::dot(normal, direction), 0.0) / pi };
+    }
+
+    const auto guided = random.get_double() < guiding_fraction;
+    const auto direction = guided ? distribution->sample(random) : glm::normalize(normal + random.get_unit_dvec3());
+    const auto cosine_pdf = std::max(glm::dot(normal, direction), 0.0) / pi;
+
+    return GuidedBounce{
+        .direction = direction,
+        .pdf = guiding_fraction * distribution->pdf(direction) + (1.0 - guiding_fraction) * cosine_pdf,
+    };
+}
+
+} // namespace tracer
@@ -0,0 +1,98 @@
+#include "tracer/instance.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/assert.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+Model::Model(std::vector<std::shared_ptr<const Object>> objects) : _objects{ std::move(objects) }, _bvh{ _objects } {}
+
+auto Model::closest_hit(const Ray& ray, Interval interval) const -> std::optional<Hit>
+{
+    return _bvh.closest_hit(_objects, ray, interval);
+}
+
+auto Model::occluded(const Ray& ray, Interval interval) const -> bool
+{
+    return _bvh.occluded(_objects, ray, interval);
+}
+
+Instance::Instance(std::shared_ptr<const Model> model, const glm::dmat4& object_to_world)
+    : _model{ std::move(model) }, _object_to_world{ object_to_world },
+      _world_to_object{ glm::inverse(object_to_world) }
+{
+    TRACER_ASSERT(_model);
+
+    const auto model_bounds = _model->bounds();
+
+    if (model_bounds.empty())
+        return;
+
+    // Bounds of the transformed corners of the model's box.
+    for (int corner = 0; corner < 8; corner++)
+    {
+        auto point = glm::dvec3{
+            corner & 1 ? model_bounds.max.x : model_bounds.min.x,
+            corner & 2 ? model_bounds.max.y : model_bounds.min.y,
+            corner & 4 ? model_bounds.max.z : model_bounds.min.z,
+        };
+
+        _bounds.expand(glm::dvec3{ _object_to_world * glm::dvec4{ point, 1.0 } });
+    }
+}
+
+auto Instance::hit(const Ray& ray, Interval interval) const -> std::optional<Hit>
+{
+    auto hit = _model->closest_hit(object_ray(ray), interval);
+
+    if (!hit)
+        return std::nullopt;
+
+    // Normals transform by the inverse transpose.
+    auto normal = glm::normalize(glm::dvec3{ glm::transpose(_world_to_object) * glm::dvec4{ hit->normal, 0.0 } });
+
+    return Hit{
+        .point = ray.at(hit->t),
+        .normal = normal,
+        .t = hit->t,
+        .front_face = hit->front_face,
+        .material = hit->material,
+        .object = this,
+    };
+}
+
+auto Instance::occludes(const Ray& ray, Interval interval) const -> bool
+{
+    return _model->occluded(object_ray(ray), interval);
+}
+
+auto Instance::object_ray(const Ray& ray) const -> Ray
+{
+    // The direction isn't renormalized, so distances along the ray are the same in both spaces.
+    return Ray{
+        glm::dvec3{ _world_to_object * glm::dvec4{ ray.origin(), 1.0 } },
+        glm::dvec3{ _world_to_object * glm::dvec4{ ray.direction(), 0.0 } },
+    };
+}
+
+auto Instance::translated(const glm::dvec3& offset) const -> std::shared_ptr<const Object>
+{
+    return std::make_shared<Instance>(_model, glm::translate(glm::dmat4{ 1.0 }, offset) * _object_to_world);
+}
+
+} // namespace tracer
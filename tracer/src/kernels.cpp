@@ -0,0 +1,320 @@
+// Built once into the library for the baseline instruction set, and once more into an object library per instruction
+// set the kernels are dispatched to, with PT_KERNEL_ISA naming the namespace of the build and instruction set flags
+// enabling its code paths below (see CMakeLists.txt).
+//
+// The kernels must not call inline functions defined outside this file, such as those of glm or the standard library:
+// the linker keeps one copy of every inline function across the whole program, and it might keep the copy built for
+// AVX-512 for callers on CPUs without it. Intrinsics are never emitted out of line, so they are fine. Every code path
+// does the same operations in the same order as the scalar one, and contraction is disabled for every build, so
+// results are bit-identical whichever instruction set runs.
+
+#include "tracer/kernels.hpp"
+
+#if defined(__SSE4_2__) || defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <cmath>
+#endif
+
+#include "tracer/common.hpp"
+
+#ifndef PT_KERNEL_ISA
+#define PT_KERNEL_ISA baseline
+#endif
+
+namespace tracer::PT_KERNEL_ISA {
+
+namespace {
+
+constexpr float max_rgb8 = 0.9999f;
+
+// The same comparisons as glm's min() and max(), which the rest of the library uses. NaNs pass through.
+[[nodiscard]] inline auto maximum(float x, float y) -> float
+{
+    return x < y ? y : x;
+}
+
+[[nodiscard]] inline auto minimum(float x, float y) -> float
+{
+    return y < x ? y : x;
+}
+
+[[nodiscard]] inline auto square_root(float x) -> float
+{
+#if defined(__SSE4_2__) || defined(__AVX2__)
+    return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(x)));
+#else
+    return std::sqrt(x); // Only the baseline build, which shares the flags of the rest of the library, gets here.
+#endif
+}
+
+auto resolve_scalar(const float* sums, const u32* sample_counts, float* pixels, usize count) -> void
+{
+    for (usize i = 0; i < count; i++)
+    {
+        const auto sample_count = static_cast<float>(sample_counts[i]);
+
+        for (usize channel = 0; channel < 3; channel++)
+        {
+            // A gamma of 2.0, as in gamma_correction().
+            auto color = sample_counts[i] != 0 ? sums[i * 3 + channel] / sample_count : 0.0f;
+            color = minimum(maximum(color, 0.0f), 1.0f);
+            pixels[i * 4 + channel] = square_root(color);
+        }
+
+        pixels[i * 4 + 3] = 1.0f;
+    }
+}
+
+auto to_rgb8_scalar(const float* pixels, u8* bytes, usize count) -> void
+{
+    for (usize i = 0; i < count; i++)
+    {
+        for (usize channel = 0; channel < 3; channel++)
+        {
+            const auto color = minimum(maximum(pixels[i * 4 + channel], 0.0f), max_rgb8);
+            bytes[i * 3 + channel] = static_cast<u8>(color * 256.0f);
+        }
+    }
+}
+
+template<usize Width> auto intersect_children_scalar(const ChildBoxQuery& query, float* t_near) -> u32
+{
+    u32 mask = 0;
+
+    for (usize i = 0; i < Width; i++)
+    {
+        auto t_min = query.interval_min;
+        auto t_max = query.interval_max;
+
+        for (usize axis = 0; axis < 3; axis++)
+        {
+            const auto near = (static_cast<float>(query.near[axis][i]) * query.scale[axis]
+                               + query.relative_origin[axis])
+                              * query.inverse_direction[axis];
+            const auto far = (static_cast<float>(query.far[axis][i]) * query.scale[axis] + query.relative_origin[axis])
+                             * query.inverse_direction[axis];
+
+            // Written so that NaNs from 0 * infinity leave the interval unchanged.
+            t_min = near > t_min ? near : t_min;
+            t_max = far < t_max ? far : t_max;
+        }
+
+        t_near[i] = t_min;
+        mask |= static_cast<u32>(t_min * box_entry_slack <= t_max * box_exit_slack && i < query.child_count) << i;
+    }
+
+    return mask;
+}
+
+#if defined(__SSE4_2__) || defined(__AVX2__)
+
+// One pixel per vector: the three sums are loaded together with the first sum of the next pixel, which is why the
+// last pixel is left to the scalar loop. The operand order of max and min makes them behave like maximum() and
+// minimum() for NaNs and negative zeros.
+[[nodiscard]] inline auto resolve_pixel(const float* sums, u32 sample_count) -> __m128
+{
+    const auto zero = _mm_setzero_ps();
+    const auto one = _mm_set1_ps(1.0f);
+
+    auto color = _mm_div_ps(_mm_loadu_ps(sums), _mm_set1_ps(static_cast<float>(sample_count)));
+    color = sample_count != 0 ? color : zero;
+    color = _mm_sqrt_ps(_mm_min_ps(one, _mm_max_ps(zero, color)));
+    return _mm_blend_ps(color, one, 0b1000);
+}
+
+auto resolve(const float* sums, const u32* sample_counts, float* pixels, usize count) -> void
+{
+    usize i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 4 < count; i += 4)
+    {
+        auto color = _mm512_castps128_ps512(resolve_pixel(sums + i * 3, sample_counts[i]));
+        color = _mm512_insertf32x4(color, resolve_pixel(sums + i * 3 + 3, sample_counts[i + 1]), 1);
+        color = _mm512_insertf32x4(color, resolve_pixel(sums + i * 3 + 6, sample_counts[i + 2]), 2);
+        color = _mm512_insertf32x4(color, resolve_pixel(sums + i * 3 + 9, sample_counts[i + 3]), 3);
+        _mm512_storeu_ps(pixels + i * 4, color);
+    }
+#elif defined(__AVX2__)
+    for (; i + 2 < count; i += 2)
+    {
+        auto color = _mm256_castps128_ps256(resolve_pixel(sums + i * 3, sample_counts[i]));
+        color = _mm256_insertf128_ps(color, resolve_pixel(sums + i * 3 + 3, sample_counts[i + 1]), 1);
+        _mm256_storeu_ps(pixels + i * 4, color);
+    }
+#endif
+
+    for (; i + 1 < count; i++)
+        _mm_storeu_ps(pixels + i * 4, resolve_pixel(sums + i * 3, sample_counts[i]));
+
+    resolve_scalar(sums + i * 3, sample_counts + i, pixels + i * 4, count - i);
+}
+
+// Four pixels at a time, converted to 32-bit integers, packed down to bytes and stripped of alpha.
+auto to_rgb8(const float* pixels, u8* bytes, usize count) -> void
+{
+    const auto zero = _mm_setzero_ps();
+    const auto max = _mm_set1_ps(max_rgb8);
+    const auto scale = _mm_set1_ps(256.0f);
+    const auto drop_alpha = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    auto quantize = [&](const float* pixel) {
+        auto color = _mm_min_ps(max, _mm_max_ps(zero, _mm_loadu_ps(pixel)));
+        return _mm_cvttps_epi32(_mm_mul_ps(color, scale));
+    };
+
+    usize i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        auto low = _mm_packus_epi32(quantize(pixels + i * 4), quantize(pixels + i * 4 + 4));
+        auto high = _mm_packus_epi32(quantize(pixels + i * 4 + 8), quantize(pixels + i * 4 + 12));
+        auto packed = _mm_shuffle_epi8(_mm_packus_epi16(low, high), drop_alpha);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(bytes + i * 3), packed);
+        _mm_storeu_si32(bytes + i * 3 + 8, _mm_srli_si128(packed, 8));
+    }
+
+    to_rgb8_scalar(pixels + i * 4, bytes + i * 3, count - i);
+}
+
+// The distances at which a ray crosses the planes of four child boxes along one axis.
+[[nodiscard]] inline auto plane_distances4(const ChildBoxQuery& query, const u8* planes, usize axis) -> __m128
+{
+    const auto steps = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_loadu_si32(planes)));
+    const auto offsets = _mm_add_ps(_mm_mul_ps(steps, _mm_set1_ps(query.scale[axis])),
+                                    _mm_set1_ps(query.relative_origin[axis]));
+    return _mm_mul_ps(offsets, _mm_set1_ps(query.inverse_direction[axis]));
+}
+
+// Children first to first + 3. Max and min take the new distance first, as the scalar loop does.
+[[nodiscard]] inline auto intersect_children4_at(const ChildBoxQuery& query, usize first, float* t_near) -> u32
+{
+    auto t_min = _mm_set1_ps(query.interval_min);
+    auto t_max = _mm_set1_ps(query.interval_max);
+
+    for (usize axis = 0; axis < 3; axis++)
+    {
+        t_min = _mm_max_ps(plane_distances4(query, query.near[axis] + first, axis), t_min);
+        t_max = _mm_min_ps(plane_distances4(query, query.far[axis] + first, axis), t_max);
+    }
+
+    _mm_storeu_ps(t_near + first, t_min);
+
+    const auto hit = _mm_cmple_ps(_mm_mul_ps(t_min, _mm_set1_ps(box_entry_slack)),
+                                  _mm_mul_ps(t_max, _mm_set1_ps(box_exit_slack)));
+    return static_cast<u32>(_mm_movemask_ps(hit)) << first;
+}
+
+auto intersect_children4(const ChildBoxQuery& query, float* t_near) -> u32
+{
+    return intersect_children4_at(query, 0, t_near) & ((1u << query.child_count) - 1);
+}
+
+#if defined(__AVX512F__)
+
+// Near and far planes of all eight children at once, the near ones in the lower half.
+[[nodiscard]] inline auto plane_distances16(const ChildBoxQuery& query, usize axis) -> __m512
+{
+    const auto planes = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(query.near[axis])),
+                                           _mm_loadl_epi64(reinterpret_cast<const __m128i*>(query.far[axis])));
+    const auto steps = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(planes));
+    const auto offsets = _mm512_add_ps(_mm512_mul_ps(steps, _mm512_set1_ps(query.scale[axis])),
+                                       _mm512_set1_ps(query.relative_origin[axis]));
+    return _mm512_mul_ps(offsets, _mm512_set1_ps(query.inverse_direction[axis]));
+}
+
+auto intersect_children8(const ChildBoxQuery& query, float* t_near) -> u32
+{
+    auto t_min = _mm256_set1_ps(query.interval_min);
+    auto t_max = _mm256_set1_ps(query.interval_max);
+
+    for (usize axis = 0; axis < 3; axis++)
+    {
+        const auto distances = plane_distances16(query, axis);
+        const auto far = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(distances), 1));
+        t_min = _mm256_max_ps(_mm512_castps512_ps256(distances), t_min);
+        t_max = _mm256_min_ps(far, t_max);
+    }
+
+    _mm256_storeu_ps(t_near, t_min);
+
+    const auto hit = _mm256_cmp_ps(_mm256_mul_ps(t_min, _mm256_set1_ps(box_entry_slack)),
+                                   _mm256_mul_ps(t_max, _mm256_set1_ps(box_exit_slack)), _CMP_LE_OQ);
+    return static_cast<u32>(_mm256_movemask_ps(hit)) & ((1u << query.child_count) - 1);
+}
+
+#elif defined(__AVX2__)
+
+[[nodiscard]] inline auto plane_distances8(const ChildBoxQuery& query, const u8* planes, usize axis) -> __m256
+{
+    const auto steps =
+        _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes))));
+    const auto offsets = _mm256_add_ps(_mm256_mul_ps(steps, _mm256_set1_ps(query.scale[axis])),
+                                       _mm256_set1_ps(query.relative_origin[axis]));
+    return _mm256_mul_ps(offsets, _mm256_set1_ps(query.inverse_direction[axis]));
+}
+
+auto intersect_children8(const ChildBoxQuery& query, float* t_near) -> u32
+{
+    auto t_min = _mm256_set1_ps(query.interval_min);
+    auto t_max = _mm256_set1_ps(query.interval_max);
+
+    for (usize axis = 0; axis < 3; axis++)
+    {
+        t_min = _mm256_max_ps(plane_distances8(query, query.near[axis], axis), t_min);
+        t_max = _mm256_min_ps(plane_distances8(query, query.far[axis], axis), t_max);
+    }
+
+    _mm256_storeu_ps(t_near, t_min);
+
+    const auto hit = _mm256_cmp_ps(_mm256_mul_ps(t_min, _mm256_set1_ps(box_entry_slack)),
+                                   _mm256_mul_ps(t_max, _mm256_set1_ps(box_exit_slack)), _CMP_LE_OQ);
+    return static_cast<u32>(_mm256_movemask_ps(hit)) & ((1u << query.child_count) - 1);
+}
+
+#else
+
+auto intersect_children8(const ChildBoxQuery& query, float* t_near) -> u32
+{
+    const auto mask = intersect_children4_at(query, 0, t_near) | intersect_children4_at(query, 4, t_near);
+    return mask & ((1u << query.child_count) - 1);
+}
+
+#endif
+
+#else
+
+auto resolve(const float* sums, const u32* sample_counts, float* pixels, usize count) -> void
+{
+    resolve_scalar(sums, sample_counts, pixels, count);
+}
+
+auto to_rgb8(const float* pixels, u8* bytes, usize count) -> void
+{
+    to_rgb8_scalar(pixels, bytes, count);
+}
+
+auto intersect_children4(const ChildBoxQuery& query, float* t_near) -> u32
+{
+    return intersect_children_scalar<4>(query, t_near);
+}
+
+auto intersect_children8(const ChildBoxQuery& query, float* t_near) -> u32
+{
+    return intersect_children_scalar<8>(query, t_near);
+}
+
+#endif
+
+} // namespace
+
+extern const Kernels kernels{
+    .resolve = resolve,
+    .to_rgb8 = to_rgb8,
+    .intersect_children4 = intersect_children4,
+    .intersect_children8 = intersect_children8,
+};
+
+} // namespace tracer::PT_KERNEL_ISA
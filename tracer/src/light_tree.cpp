@@ -0,0 +1,190 @@
+#include "tracer/light_tree.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/assert.hpp"
+#include "tracer/color.hpp"
+#include "tracer/common.hpp"
+#include "tracer/material.hpp"
+#include "tracer/object.hpp"
+#include "tracer/trigonometric.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Median splits keep the tree balanced, so the turns to any leaf fit in a 64-bit trail.
+constexpr u32 max_depth = 64;
+
+} // namespace
+
+LightTree::LightTree(std::span<const Sphere* const> lights, const MaterialTable& materials)
+{
+    if (lights.empty())
+        return;
+
+    auto indices = std::vector<u32>(lights.size());
+    std::iota(indices.begin(), indices.end(), u32{ 0 });
+
+    _nodes.reserve(2 * lights.size());
+    _trails.resize(lights.size());
+
+    build(lights, materials, indices, 0, 0);
+}
+
+auto LightTree::build(std::span<const Sphere* const> lights, const MaterialTable& materials, std::span<u32> indices,
+                      u64 trail, u32 depth) -> u32
+{
+    TRACER_ASSERT(!indices.empty() && depth < max_depth);
+
+    const auto node_index = static_cast<u32>(_nodes.size());
+    _nodes.emplace_back();
+
+    auto bounds = Aabb{};
+    auto centroid_bounds = Aabb{};
+    auto power = 0.0f;
+
+    for (auto index : indices)
+    {
+        const auto& light = *lights[index];
+        const auto& emission = materials[light.material()].emission;
+        bounds.expand(light.bounds());
+        centroid_bounds.expand(light.center());
+
+        // Radiance times area, up to a constant factor shared by all lights.
+        power += luminance(emission) * static_cast<float>(light.radius() * light.radius());
+    }
+
+    _nodes[node_index].bounds = bounds;
+    _nodes[node_index].power = power;
+
+    if (indices.size() == 1)
+    {
+        _nodes[node_index].leaf = true;
+        _nodes[node_index].offset = indices.front();
+        _trails[indices.front()] = trail;
+        return node_index;
+    }
+
+    const auto axis = centroid_bounds.largest_axis();
+    const auto middle = indices.size() / 2;
+
+    std::ranges::nth_element(indices, indices.begin() + static_cast<isize>(middle), [&](u32 a, u32 b) {
+        return lights[a]->center()[axis] < lights[b]->center()[axis];
+    });
+
+    build(lights, materials, indices.first(middle), trail, depth + 1);
+    _nodes[node_index].offset =
+        build(lights, materials, indices.subspan(middle), trail | (u64{ 1 } << depth), depth + 1);
+
+    return node_index;
+}
+
+auto LightTree::select(const glm::dvec3& point, const glm::dvec3& normal, double u) const -> std::optional<Selection>
+{
+    if (_nodes.empty() || importance(_nodes.front(), point, normal) == 0.0)
+        return std::nullopt;
+
+    auto node_index = u32{ 0 };
+    auto probability = 1.0;
+
+    while (!_nodes[node_index].leaf)
+    {
+        const auto left = node_index + 1;
+        const auto right = _nodes[node_index].offset;
+        const auto left_importance = importance(_nodes[left], point, normal);
+        const auto right_importance = importance(_nodes[right], point, normal);
+
+        if (left_importance + right_importance == 0.0)
+            return std::nullopt;
+
+        const auto left_probability = left_importance / (left_importance + right_importance);
+
+        // Reuse the number for the next choice by rescaling the part of it that led here to [0, 1).
+        if (u < left_probability)
+        {
+            node_index = left;
+            probability *= left_probability;
+            u = std::min(u / left_probability, std::nextafter(1.0, 0.0));
+        }
+        else
+        {
+            node_index = right;
+            probability *= 1.0 - left_probability;
+            u = std::min((u - left_probability) / (1.0 - left_probability), std::nextafter(1.0, 0.0));
+        }
+    }
+
+    return Selection{ .light = _nodes[node_index].offset, .probability = probability };
+}
+
+auto LightTree::probability(const glm::dvec3& point, const glm::dvec3& normal, u32 light) const -> double
+{
+    if (_nodes.empty() || importance(_nodes.front(), point, normal) == 0.0)
+        return 0.0;
+
+    const auto trail = _trails[light];
+    auto node_index = u32{ 0 };
+    auto probability = 1.0;
+
+    for (u32 depth = 0; !_nodes[node_index].leaf; depth++)
+    {
+        const auto left = node_index + 1;
+        const auto right = _nodes[node_index].offset;
+        const auto left_importance = importance(_nodes[left], point, normal);
+        const auto right_importance = importance(_nodes[right], point, normal);
+
+        if (left_importance + right_importance == 0.0)
+            return 0.0;
+
+        const auto left_probability = left_importance / (left_importance + right_importance);
+        const auto go_right = (trail >> depth) & 1;
+
+        node_index = go_right ? right : left;
+        probability *= go_right ? 1.0 - left_probability : left_probability;
+    }
+
+    TRACER_ASSERT(_nodes[node_index].offset == light);
+    return probability;
+}
+
+auto LightTree::importance(const Node& node, const glm::dvec3& point, const glm::dvec3& normal) -> double
+{
+    const auto center = node.bounds.centroid();
+    const auto radius = glm::length(node.bounds.extent()) * 0.5;
+    const auto to_center = center - point;
+    const auto distance = glm::length(to_center);
+
+    // Distances within the box would make the falloff meaningless, so they are clamped to its size.
+    const auto distance_squared = std::max(distance * distance, radius * radius);
+
+    // The box is seen within radius / distance radians of its center. Shrink the angle to the normal by that much to
+    // bound the cosine of every direction toward the box.
+    auto cosine = 1.0;
+
+    if (distance > radius)
+    {
+        const auto angle = std::acos(std::clamp(glm::dot(normal, to_center) / distance, -1.0, 1.0));
+        const auto spread = std::asin(radius / distance);
+        const auto bounded_angle = std::max(angle - spread, 0.0);
+
+        if (bounded_angle >= pi / 2.0)
+            return 0.0;
+
+        cosine = std::cos(bounded_angle);
+    }
+
+    return static_cast<double>(node.power) * cosine / distance_squared;
+}
+
+} // namespace tracer
@@ -0,0 +1,166 @@
+#include "tracer/lighting.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+#include "tracer/assert.hpp"
+#include "tracer/common.hpp"
+#include "tracer/environment.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/random.hpp"
+#include "tracer/ray.hpp"
+#include "tracer/scene.hpp"
+#include "tracer/trigonometric.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Keeps shadow rays from hitting the surface they leave or the light they aim at due to rounding.
+constexpr double shadow_offset = 0.001;
+
+[[nodiscard]] auto power_heuristic(double pdf, double other_pdf) -> double
+{
+    return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+}
+
+// Density of a direction drawn by normalize(normal + random unit vector), which is cosine-weighted.
+[[nodiscard]] auto bounce_pdf(const glm::dvec3& normal, const glm::dvec3& direction) -> double
+{
+    return std::max(glm::dot(normal, direction), 0.0) / pi;
+}
+
+// Light sampling picks the environment map this often, and a light from the light tree otherwise.
+[[nodiscard]] auto environment_selection_probability(const Scene& scene) -> double
+{
+    if (!scene.environment())
+        return 0.0;
+
+    return scene.lights().empty() ? 1.0 : 0.5;
+}
+
+} // namespace
+
+auto sample_light(const Scene& scene, const Hit& hit, const glm::vec3& albedo, Random& random)
+    -> std::optional<LightSample>
+{
+    const auto lights = scene.lights();
+    const auto* environment = scene.environment();
+
+    if (lights.empty() && !environment)
+        return std::nullopt;
+
+    const auto environment_probability = environment_selection_probability(scene);
+    auto u = random.get_double();
+
+    if (u < environment_probability)
+    {
+        TRACER_ASSERT(environment);
+
+        const auto sample = environment->sample(random);
+        const auto cosine = glm::dot(hit.normal, sample.direction);
+
+        if (cosine <= 0.0 || sample.pdf == 0.0)
+            return std::nullopt;
+
+        const auto light_pdf = sample.pdf * environment_probability;
+        const auto weight = power_heuristic(light_pdf, bounce_pdf(hit.normal, sample.direction));
+        const auto scale = static_cast<float>(cosine / pi / light_pdf * weight);
+
+        return LightSample{
+            .ray = Ray{ hit.point, sample.direction },
+            .interval = Interval{ .min = shadow_offset, .max = infinity },
+            .radiance = sample.radiance * albedo * scale,
+        };
+    }
+
+    // Reuse the number for the light tree by rescaling the part of it that led here to [0, 1).
+    u = std::min((u - environment_probability) / (1.0 - environment_probability), std::nextafter(1.0, 0.0));
+
+    const auto selection = scene.light_tree().select(hit.point, hit.normal, u);
+
+    if (!selection)
+        return std::nullopt;
+
+    const auto& light = *lights[selection->light];
+
+    const auto direction = light.sample_direction(hit.point, random);
+
+    if (!direction)
+        return std::nullopt;
+
+    const auto cosine = glm::dot(hit.normal, *direction);
+    const auto ray = Ray{ hit.point, *direction };
+    const auto light_hit = cosine > 0.0 ? light.hit(ray) : std::nullopt;
+
+    if (!light_hit)
+        return std::nullopt;
+
+    const auto light_pdf = light.direction_pdf(hit.point) * selection->probability * (1.0 - environment_probability);
+    const auto weight = power_heuristic(light_pdf, bounce_pdf(hit.normal, *direction));
+
+    // Lambertian BRDF albedo / pi, times the cosine, over the density of the sample.
+    const auto scale = static_cast<float>(cosine / pi / light_pdf * weight);
+
+    return LightSample{
+        .ray = ray,
+        .interval = Interval{ .min = shadow_offset, .max = light_hit->t - shadow_offset },
+        .radiance = scene.materials()[light.material()].emission * albedo * scale,
+    };
+}
+
+auto emission_weight(const Scene& scene, const Hit& surface, const glm::dvec3& direction, const Object& emitter)
+    -> float
+{
+    const auto light = scene.light_index(emitter);
+
+    // Emitters that light sampling never picks are only found by bounces.
+    if (!light)
+        return 1.0f;
+
+    const auto light_pdf = scene.lights()[*light]->direction_pdf(surface.point)
+                           * scene.light_tree().probability(surface.point, surface.normal, *light)
+                           * (1.0 - environment_selection_probability(scene));
+
+    if (light_pdf == 0.0)
+        return 1.0f;
+
+    return static_cast<float>(power_heuristic(bounce_pdf(surface.normal, direction), light_pdf));
+}
+
+auto environment_radiance(const Scene& scene, const glm::dvec3& direction) -> glm::vec3
+{
+    if (const auto* environment = scene.environment())
+        return environment->radiance(direction);
+
+    static constexpr auto blue = glm::vec3{ 0.5f, 0.7f, 1.0f };
+    static constexpr auto white = glm::vec3{ 1.0f };
+
+    auto blend = static_cast<float>(direction.y) / 2.0f + 0.5f;
+    auto color = blend * blue + (1.0f - blend) * white;
+
+    return color;
+}
+
+auto environment_weight(const Scene& scene, const Hit& surface, const glm::dvec3& direction) -> float
+{
+    const auto* environment = scene.environment();
+
+    // The default sky is only found by bounces.
+    if (!environment)
+        return 1.0f;
+
+    const auto light_pdf = environment->pdf(direction) * environment_selection_probability(scene);
+
+    if (light_pdf == 0.0)
+        return 1.0f;
+
+    return static_cast<float>(power_heuristic(bounce_pdf(surface.normal, direction), light_pdf));
+}
+
+} // namespace tracer
@@ -0,0 +1,77 @@
+#include "tracer/material.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+#include "tracer/common.hpp"
+#include "tracer/random.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Schlick's approximation of the Fresnel reflectance.
+[[nodiscard]] auto reflectance(double cosine, double refraction_ratio) -> double
+{
+    auto r0 = (1.0 - refraction_ratio) / (1.0 + refraction_ratio);
+    r0 *= r0;
+    return r0 + (1.0 - r0) * std::pow(1.0 - cosine, 5.0);
+}
+
+} // namespace
+
+auto MaterialTable::add(const Material& material) -> MaterialId
+{
+    _materials.push_back(material);
+    return static_cast<MaterialId>(_materials.size() - 1);
+}
+
+auto scatter(const Material& material, const Ray& ray, const Hit& hit, Random& random) -> std::optional<Scatter>
+{
+    switch (material.type)
+    {
+    case MaterialType::Diffuse:
+        // Pick a random point on a unit sphere tangent to the intersection point.
+        return Scatter{ .direction = glm::normalize(hit.normal + random.get_unit_dvec3()),
+                        .attenuation = material.albedo };
+    case MaterialType::Metal:
+    {
+        auto direction = glm::reflect(glm::normalize(ray.direction()), hit.normal);
+        direction = glm::normalize(direction + static_cast<double>(material.fuzz) * random.get_unit_dvec3());
+
+        // Fuzz can push the reflection below the surface, where it is absorbed.
+        if (glm::dot(direction, hit.normal) <= 0.0)
+            return std::nullopt;
+
+        return Scatter{ .direction = direction, .attenuation = material.albedo };
+    }
+    case MaterialType::Dielectric:
+    {
+        const auto refraction_ratio = hit.front_face ? 1.0 / static_cast<double>(material.refractive_index)
+                                                     : static_cast<double>(material.refractive_index);
+        const auto unit_direction = glm::normalize(ray.direction());
+        const auto cosine = std::min(glm::dot(-unit_direction, hit.normal), 1.0);
+        const auto sine = std::sqrt(std::max(1.0 - cosine * cosine, 0.0));
+
+        const auto total_reflection = refraction_ratio * sine > 1.0;
+        const auto reflect = total_reflection || reflectance(cosine, refraction_ratio) > random.get_double();
+
+        return Scatter{
+            .direction = reflect ? glm::reflect(unit_direction, hit.normal)
+                                 : glm::refract(unit_direction, hit.normal, refraction_ratio),
+            .attenuation = material.albedo,
+        };
+    }
+    case MaterialType::Emissive:
+        return std::nullopt;
+    }
+
+    return std::nullopt;
+}
+
+} // namespace tracer
@@ -2,11 +2,19 @@
 
 #include <glm/exponential.hpp>
 #include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+#include <glm/vec3.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include <optional>
 
+#include "tracer/aabb.hpp"
 #include "tracer/numeric.hpp"
+#include "tracer/random.hpp"
 #include "tracer/ray.hpp"
+#include "tracer/trigonometric.hpp"
 
 namespace tracer {
 
@@ -47,7 +55,79 @@ auto Sphere::hit(const Ray& ray, Interval interval) const -> std::optional<Hit>
         .normal = front_face ? outward_normal : -outward_normal,
         .t = t,
         .front_face = front_face,
+        .material = _material,
+        .object = this,
     };
 }
 
+auto Sphere::occludes(const Ray& ray, Interval interval) const -> bool
+{
+    // Same quadratic as hit(), but neither the point nor the normal are needed.
+    const auto oc = _center - ray.origin();
+
+    auto a = glm::dot(ray.direction(), ray.direction());
+    auto h = glm::dot(ray.direction(), oc);
+    auto c = glm::dot(oc, oc) - _radius * _radius;
+    auto discriminant = h * h - a * c;
+
+    if (discriminant < 0.0)
+        return false;
+
+    auto discriminant_sqrt = glm::sqrt(discriminant);
+
+    return interval.contains((h - discriminant_sqrt) / a) || interval.contains((h + discriminant_sqrt) / a);
+}
+
+auto Sphere::bounds() const -> Aabb
+{
+    return Aabb{
+        .min = _center - _radius,
+        .max = _center + _radius,
+    };
+}
+
+auto Sphere::translated(const glm::dvec3& offset) const -> std::shared_ptr<const Object>
+{
+    return std::make_shared<Sphere>(_center + offset, _radius, _material);
+}
+
+auto Sphere::sample_direction(const glm::dvec3& point, Random& random) const -> std::optional<glm::dvec3>
+{
+    const auto size = cone_size(point);
+
+    if (size == 0.0)
+        return std::nullopt;
+
+    // Orthonormal basis around the axis of the cone.
+    const auto axis = glm::normalize(_center - point);
+    const auto helper = std::abs(axis.x) > 0.9 ? glm::dvec3{ 0.0, 1.0, 0.0 } : glm::dvec3{ 1.0, 0.0, 0.0 };
+    const auto tangent = glm::normalize(glm::cross(helper, axis));
+    const auto bitangent = glm::cross(axis, tangent);
+
+    const auto cos_theta = 1.0 - random.get_double() * size;
+    const auto sin_theta = glm::sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta));
+    const auto phi = 2.0 * pi * random.get_double();
+
+    return cos_theta * axis + sin_theta * (glm::cos(phi) * tangent + glm::sin(phi) * bitangent);
+}
+
+auto Sphere::direction_pdf(const glm::dvec3& point) const -> double
+{
+    const auto size = cone_size(point);
+    return size == 0.0 ? 0.0 : 1.0 / (2.0 * pi * size);
+}
+
+auto Sphere::cone_size(const glm::dvec3& point) const -> double
+{
+    const auto distance_squared = glm::dot(_center - point, _center - point);
+    const auto radius_squared = _radius * _radius;
+
+    if (distance_squared <= radius_squared)
+        return 0.0;
+
+    // 1 - cos = sin^2 / (1 + cos), which stays accurate for small or distant spheres.
+    const auto sin_squared = radius_squared / distance_squared;
+    return sin_squared / (1.0 + glm::sqrt(1.0 - sin_squared));
+}
+
 } // namespace tracer
@@ -0,0 +1,39 @@
+#include "tracer/packet.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+
+namespace tracer {
+
+Frustum::Frustum(const glm::dvec3& apex, const std::array<glm::dvec3, 4>& corners) : _apex{ apex }
+{
+    const auto center = (corners[0] + corners[1] + corners[2] + corners[3]) * 0.25 - apex;
+
+    for (usize i = 0; i < corners.size(); i++)
+    {
+        auto normal = glm::cross(corners[i] - apex, corners[(i + 1) % corners.size()] - apex);
+        _normals[i] = glm::dot(normal, center) < 0.0 ? -normal : normal;
+    }
+}
+
+auto Frustum::excludes(const Aabb& box) const -> bool
+{
+    for (const auto& normal : _normals)
+    {
+        // The corner of the box furthest along the normal. If even that one is behind the plane, all of them are.
+        const auto corner = glm::dvec3{ normal.x < 0.0 ? box.min.x : box.max.x, normal.y < 0.0 ? box.min.y : box.max.y,
+                                        normal.z < 0.0 ? box.min.z : box.max.z };
+
+        if (glm::dot(normal, corner - _apex) < 0.0)
+            return true;
+    }
+
+    return false;
+}
+
+} // namespace tracer
@@ -6,8 +6,28 @@
 
 #include <random>
 
+#include "tracer/common.hpp"
+
 namespace tracer {
 
+namespace {
+
+// SplitMix64 finalizer.
+[[nodiscard]] constexpr auto mix(u64 x) -> u64
+{
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+auto Random::for_sample(u64 seed, u64 pixel_index, u64 sample_index) -> Random
+{
+    return Random{ mix(mix(mix(seed) ^ pixel_index) ^ sample_index) };
+}
+
 auto Random::get_float() -> float
 {
     return get_float(0.0f, 1.0f);
@@ -0,0 +1,101 @@
+#include "tracer/ray_sort.hpp"
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/common.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+namespace {
+
+constexpr u32 origin_bits = 10;
+constexpr u32 direction_bits = 5;
+constexpr u32 radix_bits = 12;
+
+// Inserts two zero bits after each of the lower 10 bits.
+[[nodiscard]] auto spread_bits(u32 value) -> u64
+{
+    auto bits = u64{ value } & 0x3ff;
+    bits = (bits | (bits << 16)) & 0x30000ff;
+    bits = (bits | (bits << 8)) & 0x300f00f;
+    bits = (bits | (bits << 4)) & 0x30c30c3;
+    bits = (bits | (bits << 2)) & 0x9249249;
+    return bits;
+}
+
+[[nodiscard]] auto morton_code(const glm::dvec3& unit_position, u32 bits) -> u64
+{
+    const auto cells = static_cast<double>(1u << bits);
+    const auto cell = glm::clamp(unit_position * cells, glm::dvec3{ 0.0 }, glm::dvec3{ cells - 1.0 });
+
+    return spread_bits(static_cast<u32>(cell.x)) | spread_bits(static_cast<u32>(cell.y)) << 1
+           | spread_bits(static_cast<u32>(cell.z)) << 2;
+}
+
+} // namespace
+
+auto ray_sort_key(const Ray& ray, const Aabb& bounds) -> u64
+{
+    const auto direction = ray.direction();
+    const auto octant = u64{ direction.x < 0.0 } | u64{ direction.y < 0.0 } << 1 | u64{ direction.z < 0.0 } << 2;
+
+    const auto extent = glm::max(bounds.extent(), glm::dvec3{ 1e-12 });
+    const auto origin = morton_code((ray.origin() - bounds.min) / extent, origin_bits);
+    const auto spread = morton_code(direction * 0.5 + 0.5, direction_bits);
+
+    return octant << (3 * origin_bits + 3 * direction_bits) | origin << (3 * direction_bits) | spread;
+}
+
+auto RaySorter::sort(std::span<const u64> keys) -> std::span<const u32>
+{
+    _keys.assign(keys.begin(), keys.end());
+    _key_scratch.resize(keys.size());
+    _order.resize(keys.size());
+    _order_scratch.resize(keys.size());
+    std::iota(_order.begin(), _order.end(), u32{ 0 });
+
+    constexpr auto bucket_count = usize{ 1 } << radix_bits;
+    auto offsets = std::array<usize, bucket_count + 1>{};
+
+    // The keys move along with their indices, so that every pass reads both sequentially.
+    for (u32 shift = 0; shift < ray_sort_key_bits; shift += radix_bits)
+    {
+        auto digit = [&](u64 key) { return static_cast<usize>(key >> shift) & (bucket_count - 1); };
+
+        offsets.fill(0);
+
+        for (auto key : _keys)
+            offsets[digit(key) + 1]++;
+
+        // Every key has the same digit, the pass would not move anything.
+        if (std::ranges::find(offsets, _keys.size()) != offsets.end())
+            continue;
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        for (usize i = 0; i < _keys.size(); i++)
+        {
+            auto& offset = offsets[digit(_keys[i])];
+            _key_scratch[offset] = _keys[i];
+            _order_scratch[offset] = _order[i];
+            offset++;
+        }
+
+        std::swap(_keys, _key_scratch);
+        std::swap(_order, _order_scratch);
+    }
+
+    return _order;
+}
+
+} // namespace tracer
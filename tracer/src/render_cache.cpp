@@ -0,0 +1,242 @@
+#include "tracer/render_cache.hpp"
+
+#include <filesystem>
+#include <future>
+#include <iomanip>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <system_error>
+#include <utility>
+
+#include "tracer/accumulation.hpp"
+#include "tracer/checkpoint.hpp"
+#include "tracer/common.hpp"
+#include "tracer/hash.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+namespace {
+
+[[nodiscard]] auto buffer_bytes(const AccumulationBuffer& buffer) -> usize
+{
+    return buffer.sums().size_bytes() + buffer.sample_counts().size_bytes();
+}
+
+// Adding zero turns -0.0 into 0.0, which compares equal to it.
+[[nodiscard]] auto hash_coordinate(u64 hash, double value) -> u64
+{
+    return hash_value(hash, value + 0.0);
+}
+
+} // namespace
+
+auto RenderKey::operator==(const RenderKey& other) const -> bool
+{
+    return scene_version == other.scene_version && camera == other.camera && width == other.width
+           && height == other.height && same_estimate(render_params, other.render_params);
+}
+
+auto hash_render_key(const RenderKey& key) -> u64
+{
+    auto hash = hash_value(hash_seed, key.scene_version);
+
+    for (auto axis = 0; axis < 3; axis++)
+        hash = hash_coordinate(hash, key.camera.position[axis]);
+
+    hash = hash_coordinate(hash, key.camera.focal_length);
+    hash = hash_value(hash, key.width);
+    hash = hash_value(hash, key.height);
+
+    // The parameters same_estimate() compares.
+    hash = hash_value(hash, key.render_params.max_depth);
+    hash = hash_value(hash, key.render_params.seed);
+    return hash_value(hash, key.render_params.guiding);
+}
+
+RenderCache::RenderCache(usize memory_budget_bytes, const std::filesystem::path& spill_directory,
+                         usize spill_budget_bytes)
+    : _memory_budget_bytes{ memory_budget_bytes }, _spill_budget_bytes{ spill_budget_bytes }
+{
+    set_spill_directory(spill_directory);
+}
+
+RenderCache::~RenderCache()
+{
+    clear();
+}
+
+auto RenderCache::set_spill_directory(const std::filesystem::path& spill_directory) -> void
+{
+    while (!_spilled.empty())
+        drop_spilled(std::prev(_spilled.end()));
+
+    _spill_directory = spill_directory;
+
+    // Failing here only means that spilling fails later, and evicted renders are dropped instead.
+    if (!_spill_directory.empty())
+    {
+        auto error = std::error_code{};
+        std::filesystem::create_directories(_spill_directory, error);
+    }
+}
+
+auto RenderCache::store(const RenderKey& key, const AccumulationBuffer& buffer) -> void
+{
+    const auto hash = hash_render_key(key);
+    erase(hash);
+
+    const auto bytes = buffer_bytes(buffer);
+
+    if (bytes > _memory_budget_bytes)
+        return;
+
+    _entries.push_front(Entry{ .hash = hash, .key = key, .buffer = buffer, .bytes = bytes });
+    _index[hash] = _entries.begin();
+    _stats.memory_bytes += bytes;
+
+    evict();
+}
+
+auto RenderCache::find(const RenderKey& key) -> std::optional<AccumulationBuffer>
+{
+    const auto hash = hash_render_key(key);
+
+    if (auto found = _index.find(hash); found != _index.end() && found->second->key == key)
+    {
+        _entries.splice(_entries.begin(), _entries, found->second);
+        _stats.hits++;
+        return found->second->buffer;
+    }
+
+    if (auto found = _spilled_index.find(hash); found != _spilled_index.end() && found->second->key == key)
+    {
+        auto entry = found->second;
+        auto checkpoint = finish_spill(*entry) ? read_checkpoint(spill_path(hash)) : std::nullopt;
+
+        if (!checkpoint || checkpoint->scene_hash != key.scene_version || checkpoint->accumulation.width() != key.width
+            || checkpoint->accumulation.height() != key.height)
+        {
+            drop_spilled(entry);
+            _stats.misses++;
+            return std::nullopt;
+        }
+
+        auto error = std::error_code{};
+        std::filesystem::remove(spill_path(hash), error);
+
+        entry->buffer = std::move(checkpoint->accumulation);
+        _stats.spilled_bytes -= entry->bytes;
+        _stats.memory_bytes += entry->bytes;
+        _spilled_index.erase(found);
+        _entries.splice(_entries.begin(), _spilled, entry);
+        _index[hash] = entry;
+
+        _stats.hits++;
+        _stats.spill_hits++;
+
+        auto buffer = entry->buffer;
+        evict();
+        return buffer;
+    }
+
+    _stats.misses++;
+    return std::nullopt;
+}
+
+auto RenderCache::clear() -> void
+{
+    while (!_spilled.empty())
+        drop_spilled(std::prev(_spilled.end()));
+
+    _entries.clear();
+    _index.clear();
+    _stats.memory_bytes = 0;
+}
+
+auto RenderCache::stats() const -> RenderCacheStats
+{
+    auto stats = _stats;
+    stats.entries = _entries.size();
+    stats.spilled_entries = _spilled.size();
+    return stats;
+}
+
+auto RenderCache::spill_path(u64 hash) const -> std::filesystem::path
+{
+    auto name = std::ostringstream{};
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".ptck";
+    return _spill_directory / name.str();
+}
+
+auto RenderCache::erase(u64 hash) -> void
+{
+    if (auto found = _index.find(hash); found != _index.end())
+    {
+        _stats.memory_bytes -= found->second->bytes;
+        _entries.erase(found->second);
+        _index.erase(found);
+    }
+
+    if (auto found = _spilled_index.find(hash); found != _spilled_index.end())
+        drop_spilled(found->second);
+}
+
+auto RenderCache::evict() -> void
+{
+    while (_stats.memory_bytes > _memory_budget_bytes)
+    {
+        auto entry = std::prev(_entries.end());
+        _index.erase(entry->hash);
+        _stats.memory_bytes -= entry->bytes;
+
+        auto checkpoint = Checkpoint{
+            .scene_hash = entry->key.scene_version,
+            .camera = entry->key.camera,
+            .render_params = entry->key.render_params,
+            .accumulation = std::move(entry->buffer),
+        };
+
+        entry->buffer = AccumulationBuffer{};
+
+        if (_spill_directory.empty() || entry->bytes > _spill_budget_bytes)
+        {
+            _entries.erase(entry);
+            continue;
+        }
+
+        // The task owns the buffer until it is written, so memory is only freed once the disk caught up.
+        auto write = [path = spill_path(entry->hash), checkpoint = std::move(checkpoint)] {
+            return write_checkpoint(path, checkpoint);
+        };
+        entry->spill = std::async(std::launch::async, std::move(write));
+
+        _spilled.splice(_spilled.begin(), _entries, entry);
+        _spilled_index[entry->hash] = entry;
+        _stats.spilled_bytes += entry->bytes;
+
+        while (_stats.spilled_bytes > _spill_budget_bytes)
+            drop_spilled(std::prev(_spilled.end()));
+    }
+}
+
+auto RenderCache::drop_spilled(EntryList::iterator entry) -> void
+{
+    // Removing the file while it is being written could leave the rest of it behind.
+    [[maybe_unused]] const auto written = finish_spill(*entry);
+
+    auto error = std::error_code{};
+    std::filesystem::remove(spill_path(entry->hash), error);
+
+    _stats.spilled_bytes -= entry->bytes;
+    _spilled_index.erase(entry->hash);
+    _spilled.erase(entry);
+}
+
+auto RenderCache::finish_spill(Entry& entry) -> bool
+{
+    return !entry.spill.valid() || entry.spill.get();
+}
+
+} // namespace tracer
@@ -2,15 +2,277 @@
 
 #include <glm/vec4.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
 #include <memory>
+#include <mutex>
+#include <ranges>
 #include <span>
+#include <thread>
 #include <utility>
+#include <vector>
 
+#include "tracer/accumulation.hpp"
+#include "tracer/bvh.hpp"
 #include "tracer/common.hpp"
+#include "tracer/guiding.hpp"
+#include "tracer/scene.hpp"
 #include "tracer/software_renderer.hpp"
+#include "tracer/topology.hpp"
+#include "tracer/wavefront_renderer.hpp"
 
 namespace tracer {
 
+namespace {
+
+constexpr usize guiding_tile_size = 32;
+
+// A leaf of the guiding field is split once a pass records more samples in it than this times the square root of the
+// samples per pixel of the pass, and a directional cell once it holds more than this fraction of its leaf's energy.
+// Leaves covering surfaces that face apart waste the guided bounces that point below either, so leaves split much
+// sooner than the 12000 samples Müller et al. suggest.
+constexpr double spatial_split_factor = 1000.0;
+constexpr double directional_split_threshold = 0.01;
+
+struct BatchTile
+{
+    usize view{ 0 };
+    Tile tile{};
+};
+
+// Position of a tile along a Z-order curve, which interleaves the bits of the column and the row.
+[[nodiscard]] auto morton_index(u32 column, u32 row) -> u64
+{
+    u64 index = 0;
+
+    for (u32 bit = 0; bit < 32; bit++)
+        index |= (u64{ column } >> bit & 1) << (2 * bit) | (u64{ row } >> bit & 1) << (2 * bit + 1);
+
+    return index;
+}
+
+// Position of a tile along a Hilbert curve through a square of size x size tiles, size being a power of two.
+[[nodiscard]] auto hilbert_index(u32 column, u32 row, u32 size) -> u64
+{
+    u64 index = 0;
+
+    for (auto half = size / 2; half > 0; half /= 2)
+    {
+        const auto right = (column & half) != 0;
+        const auto top = (row & half) != 0;
+        index += u64{ half } * half * ((3 * u64{ right }) ^ u64{ top });
+
+        // Rotate the quadrant, so that the curve through it starts and ends next to those of its neighbours.
+        if (!top)
+        {
+            if (right)
+            {
+                column = size - 1 - column;
+                row = size - 1 - row;
+            }
+
+            std::swap(column, row);
+        }
+    }
+
+    return index;
+}
+
+[[nodiscard]] auto split_into_tiles(std::span<const StreamView> views, usize tile_size, TileOrder order)
+    -> std::vector<BatchTile>
+{
+    auto tiles = std::vector<BatchTile>{};
+    auto view_tiles = std::vector<Tile>{};
+
+    for (usize view = 0; view < views.size(); view++)
+    {
+        const auto& region = views[view].region;
+        view_tiles.clear();
+
+        for (auto y = region.y; y < region.y + region.height; y += tile_size)
+        {
+            for (auto x = region.x; x < region.x + region.width; x += tile_size)
+            {
+                view_tiles.push_back(Tile{
+                    .x = x,
+                    .y = y,
+                    .width = std::min(tile_size, region.x + region.width - x),
+                    .height = std::min(tile_size, region.y + region.height - y),
+                });
+            }
+        }
+
+        order_tiles(view_tiles, tile_size, order);
+
+        for (const auto& tile : view_tiles)
+            tiles.push_back(BatchTile{ .view = view, .tile = tile });
+    }
+
+    return tiles;
+}
+
+// Writes the tiles of a batch into the images of its views.
+class ImageSink final : public TileSink
+{
+public:
+    explicit ImageSink(std::span<const BatchView> views) : _views{ views } {}
+
+    auto tile_finished(usize view, const Tile& tile, const ImageView<const glm::vec4>& pixels) -> void override
+    {
+        const auto& image = _views[view].image;
+
+        for (usize y = 0; y < tile.height; y++)
+        {
+            for (usize x = 0; x < tile.width; x++)
+                image[tile.y + y, tile.x + x] = pixels[y, x];
+        }
+    }
+
+private:
+    std::span<const BatchView> _views;
+};
+
+// Renders the tile in passes of 1, 2, 4, ... samples per pixel. Every pass is guided by the field the passes before it
+// learnt, and records into a refined copy of that field for the next one. Each thread records into its own recorder,
+// and the recorders are merged into the field between passes, so threads never contend over it. Pixels keep all
+// their samples, including the ones from passes that were barely guided. A thread_count of 0 uses every hardware
+// thread.
+//
+// The tile is split into guiding_tile_size tiles, each of which is handed to tile_finished(tile, pixels) as soon as the
+// last pass is done with it, on the thread that rendered it and at the same time as others. Only their accumulation
+// buffers are held for the whole render, and each is freed once handed out.
+template<typename TileFinished>
+auto render_guided(const Tile& tile, usize frame_width, usize frame_height, const Scene& scene, const Camera& camera,
+                   const RenderParams& render_params, usize thread_count, std::stop_token stop_token,
+                   volatile i32* progress, const TileFinished& tile_finished) -> void
+{
+    if (progress)
+        *progress = 0;
+
+    auto tiles = std::vector<Tile>{};
+    auto buffers = std::vector<AccumulationBuffer>{};
+
+    for (usize y = 0; y < tile.height; y += guiding_tile_size)
+    {
+        for (usize x = 0; x < tile.width; x += guiding_tile_size)
+        {
+            tiles.push_back(Tile{
+                .x = tile.x + x,
+                .y = tile.y + y,
+                .width = std::min(guiding_tile_size, tile.width - x),
+                .height = std::min(guiding_tile_size, tile.height - y),
+            });
+        }
+    }
+
+    order_tiles(tiles, guiding_tile_size, TileOrder::Hilbert);
+
+    for (const auto& guiding_tile : tiles)
+        buffers.emplace_back(guiding_tile.width, guiding_tile.height);
+
+    if (thread_count == 0)
+        thread_count = std::max(usize{ std::thread::hardware_concurrency() }, usize{ 1 });
+
+    thread_count = std::min(thread_count, std::max(tiles.size(), usize{ 1 }));
+
+    auto sampling = GuidingField{};
+    auto recording = GuidingField{ scene.bvh().bounds() };
+    usize finished_samples = 0;
+    usize pass_samples = 1;
+
+    while (finished_samples < render_params.samples)
+    {
+        // The last pass takes all remaining samples rather than leaving a pass smaller than the one before it. It has
+        // no later pass to learn for.
+        const auto remaining_samples = render_params.samples - finished_samples;
+        const auto last_pass = remaining_samples < 2 * pass_samples;
+        const auto target_samples = finished_samples + (last_pass ? remaining_samples : pass_samples);
+
+        auto recorders = std::vector<GuidingRecorder>{};
+
+        if (!last_pass)
+        {
+            recorders.reserve(thread_count);
+
+            for (usize i = 0; i < thread_count; i++)
+                recorders.emplace_back(recording);
+        }
+
+        auto next_tile = std::atomic<usize>{ 0 };
+
+        auto work = [&](usize thread) {
+            auto* recorder = last_pass ? nullptr : &recorders[thread];
+            auto tile_image = Image{};
+
+            for (auto index = next_tile++; index < tiles.size() && !stop_token.stop_requested(); index = next_tile++)
+            {
+                auto renderer =
+                    SoftwareRenderer{ tiles[index], frame_width, frame_height, scene, camera, render_params };
+                renderer.set_guiding(&sampling, recorder);
+                renderer.accumulate(buffers[index], target_samples, stop_token, nullptr);
+
+                if (!last_pass || stop_token.stop_requested())
+                    continue;
+
+                tile_image.resize(tiles[index].width, tiles[index].height);
+                buffers[index].resolve(tile_image.view());
+                buffers[index] = AccumulationBuffer{};
+                tile_finished(tiles[index], std::as_const(tile_image).view());
+            }
+        };
+
+        {
+            auto threads = std::vector<std::jthread>{};
+            threads.reserve(thread_count - 1);
+
+            for (usize i = 1; i < thread_count; i++)
+                threads.emplace_back(work, i);
+
+            work(0);
+        }
+
+        if (stop_token.stop_requested())
+            return;
+
+        finished_samples = target_samples;
+
+        if (progress)
+            *progress = static_cast<i32>(finished_samples * 100 / render_params.samples);
+
+        if (!last_pass)
+        {
+            recording.absorb(recorders);
+            sampling = std::move(recording);
+            recording = sampling.refined(
+                static_cast<u64>(spatial_split_factor * std::sqrt(static_cast<double>(pass_samples))),
+                directional_split_threshold);
+            pass_samples *= 2;
+        }
+    }
+
+    if (progress)
+        *progress = 100;
+}
+
+// Same as above, writing the tile into the image, which is the size of the tile.
+auto render_guided(const ImageView<glm::vec4>& image, const Tile& tile, usize frame_width, usize frame_height,
+                   const Scene& scene, const Camera& camera, const RenderParams& render_params,
+                   std::stop_token stop_token, volatile i32* progress) -> void
+{
+    render_guided(tile, frame_width, frame_height, scene, camera, render_params, 0, std::move(stop_token), progress,
+                  [&](const Tile& guiding_tile, const ImageView<const glm::vec4>& pixels) {
+                      for (usize y = 0; y < guiding_tile.height; y++)
+                      {
+                          for (usize x = 0; x < guiding_tile.width; x++)
+                              image[guiding_tile.y - tile.y + y, guiding_tile.x - tile.x + x] = pixels[y, x];
+                      }
+                  });
+}
+
+} // namespace
+
 Image::Image(usize width, usize height)
 {
     resize(width, height);
@@ -46,10 +308,229 @@ auto Image::pixels() const -> std::span<const glm::vec4>
     return std::span{ _pixels.get(), _width * _height };
 }
 
-auto render(const ImageView<glm::vec4>& image, ObjectSpan world, const Camera& camera,
+auto same_estimate(const RenderParams& a, const RenderParams& b) -> bool
+{
+    return a.max_depth == b.max_depth && a.seed == b.seed && a.guiding == b.guiding;
+}
+
+auto render(const ImageView<glm::vec4>& image, const Scene& scene, const Camera& camera,
             const RenderParams& render_params, std::stop_token stop_token, volatile i32* progress) -> void
 {
-    SoftwareRenderer{ image, world, camera, render_params }.render(std::move(stop_token), progress);
+    if (render_params.guiding)
+    {
+        render_guided(image, Tile{ .x = 0, .y = 0, .width = image.width(), .height = image.height() }, image.width(),
+                      image.height(), scene, camera, render_params, std::move(stop_token), progress);
+    }
+    else if (render_params.pipeline == Pipeline::Wavefront)
+    {
+        WavefrontRenderer{ image, scene, camera, render_params }.render(std::move(stop_token), progress);
+    }
+    else
+    {
+        SoftwareRenderer{ image, scene, camera, render_params }.render(std::move(stop_token), progress);
+    }
+}
+
+auto accumulate(AccumulationBuffer& buffer, usize target_samples, const Scene& scene, const Camera& camera,
+                const RenderParams& render_params, std::stop_token stop_token, volatile i32* progress) -> void
+{
+    SoftwareRenderer{ buffer.width(), buffer.height(), scene, camera, render_params }.accumulate(
+        buffer, target_samples, std::move(stop_token), progress);
+}
+
+auto accumulate_tile(AccumulationBuffer& buffer, const Tile& tile, usize frame_width, usize frame_height,
+                     usize target_samples, const Scene& scene, const Camera& camera, const RenderParams& render_params,
+                     std::stop_token stop_token, volatile i32* progress) -> void
+{
+    SoftwareRenderer{ tile, frame_width, frame_height, scene, camera, render_params }.accumulate(
+        buffer, target_samples, std::move(stop_token), progress);
+}
+
+auto render_tile(const ImageView<glm::vec4>& image, const Tile& tile, usize frame_width, usize frame_height,
+                 const Scene& scene, const Camera& camera, const RenderParams& render_params,
+                 std::stop_token stop_token, volatile i32* progress) -> void
+{
+    if (render_params.guiding)
+    {
+        render_guided(image, tile, frame_width, frame_height, scene, camera, render_params, std::move(stop_token),
+                      progress);
+    }
+    else if (render_params.pipeline == Pipeline::Wavefront)
+    {
+        WavefrontRenderer{ image, tile, frame_width, frame_height, scene, camera, render_params }.render(
+            std::move(stop_token), progress);
+    }
+    else
+    {
+        SoftwareRenderer{ image, tile, frame_width, frame_height, scene, camera, render_params }.render(
+            std::move(stop_token), progress);
+    }
+}
+
+auto order_tiles(std::span<Tile> tiles, usize tile_size, TileOrder order) -> void
+{
+    TRACER_ASSERT(tile_size != 0);
+
+    if (tiles.empty() || order == TileOrder::RowMajor)
+    {
+        std::ranges::stable_sort(tiles, {}, [](const Tile& tile) { return std::pair{ tile.y, tile.x }; });
+        return;
+    }
+
+    const auto left = std::ranges::min(tiles, {}, &Tile::x).x;
+    const auto top = std::ranges::min(tiles, {}, &Tile::y).y;
+
+    auto column = [&](const Tile& tile) { return static_cast<u32>((tile.x - left) / tile_size); };
+    auto row = [&](const Tile& tile) { return static_cast<u32>((tile.y - top) / tile_size); };
+
+    const auto columns = std::ranges::max(tiles | std::views::transform(column)) + 1;
+    const auto rows = std::ranges::max(tiles | std::views::transform(row)) + 1;
+    const auto size = std::bit_ceil(std::max(columns, rows));
+
+    std::ranges::stable_sort(tiles, {}, [&](const Tile& tile) {
+        return order == TileOrder::Morton ? morton_index(column(tile), row(tile))
+                                          : hilbert_index(column(tile), row(tile), size);
+    });
+}
+
+auto render_batch(std::span<const BatchView> views, const Scene& scene, const BatchParams& batch_params,
+                  std::stop_token stop_token, volatile i32* progress) -> void
+{
+    auto stream_views = std::vector<StreamView>{};
+    stream_views.reserve(views.size());
+
+    for (const auto& view : views)
+    {
+        stream_views.push_back(StreamView{
+            .width = view.image.width(),
+            .height = view.image.height(),
+            .camera = view.camera,
+            .render_params = view.render_params,
+        });
+    }
+
+    auto sink = ImageSink{ views };
+    render_streamed(stream_views, scene, sink, batch_params, std::move(stop_token), progress);
+}
+
+auto render_streamed(std::span<const StreamView> views, const Scene& scene, TileSink& sink,
+                     const BatchParams& batch_params, std::stop_token stop_token, volatile i32* progress) -> void
+{
+    TRACER_ASSERT(batch_params.tile_size != 0);
+
+    if (progress)
+        *progress = 0;
+
+    auto regions = std::vector<StreamView>{ views.begin(), views.end() };
+
+    for (auto& view : regions)
+    {
+        if (view.region.width == 0 || view.region.height == 0)
+            view.region = Tile{ .x = 0, .y = 0, .width = view.width, .height = view.height };
+
+        TRACER_ASSERT(view.region.x + view.region.width <= view.width
+                      && view.region.y + view.region.height <= view.height);
+    }
+
+    const auto tiles = split_into_tiles(regions, batch_params.tile_size, batch_params.tile_order);
+    auto next_tile = std::atomic<usize>{ 0 };
+    auto completed_tiles = std::atomic<usize>{ 0 };
+
+    auto thread_count = batch_params.thread_count;
+
+    if (thread_count == 0)
+        thread_count = std::max(usize{ std::thread::hardware_concurrency() }, usize{ 1 });
+
+    // Guided views learn from all of their region, over passes that each cover the whole of it, which tiles rendered
+    // one by one could not share. They are rendered by all threads first, one view at a time, and handed to the sink
+    // in the tiles guiding works in, as the last pass finishes them.
+    for (usize view_index = 0; view_index < regions.size() && !stop_token.stop_requested(); view_index++)
+    {
+        const auto& view = regions[view_index];
+
+        if (!view.render_params.guiding)
+            continue;
+
+        render_guided(view.region, view.width, view.height, scene, view.camera, view.render_params, thread_count,
+                      stop_token, nullptr, [&](const Tile& tile, const ImageView<const glm::vec4>& pixels) {
+                          sink.tile_finished(view_index, tile, pixels);
+                      });
+
+        if (stop_token.stop_requested())
+            break;
+
+        // Progress counts in the tiles of the batch, which the view would have been split into otherwise.
+        const auto view_tiles = static_cast<usize>(std::ranges::count(tiles, view_index, &BatchTile::view));
+        const auto completed = completed_tiles += view_tiles;
+
+        if (progress)
+            *progress = static_cast<i32>(static_cast<float>(completed) / static_cast<float>(tiles.size()) * 100.0f);
+    }
+
+    thread_count = std::min(thread_count, std::max(tiles.size(), usize{ 1 }));
+
+    const auto nodes = batch_params.pin_threads ? numa_nodes() : std::vector<NumaNode>{};
+    const auto placements = place_threads(nodes, thread_count);
+
+    // Replicas are made by the first thread to need them, which runs on their node.
+    const auto replicate = batch_params.pin_threads && batch_params.replicate_scene;
+    auto replicas = std::vector<std::unique_ptr<const Scene>>(replicate ? nodes.size() : 0);
+    auto replicas_made = std::vector<std::once_flag>(replicas.size());
+
+    // Renders tiles until the queue is empty. Only the first thread reports progress, so that a single thread writes
+    // to it.
+    auto work = [&](usize thread) {
+        const auto* thread_scene = &scene;
+
+        if (!placements.empty())
+        {
+            const auto [node, cpu] = placements[thread];
+
+            if (pin_thread(cpu) && replicate)
+            {
+                std::call_once(replicas_made[node], [&] { replicas[node] = std::make_unique<const Scene>(scene); });
+                thread_scene = replicas[node].get();
+            }
+        }
+
+        // Allocated after pinning, so that the pages are local to the thread's node.
+        auto tile_image = Image{};
+
+        for (auto index = next_tile++; index < tiles.size() && !stop_token.stop_requested(); index = next_tile++)
+        {
+            const auto& [view_index, tile] = tiles[index];
+            const auto& view = regions[view_index];
+
+            if (view.render_params.guiding)
+                continue;
+
+            tile_image.resize(tile.width, tile.height);
+            render_tile(tile_image, tile, view.width, view.height, *thread_scene, view.camera, view.render_params);
+
+            sink.tile_finished(view_index, tile, std::as_const(tile_image).view());
+
+            auto completed = ++completed_tiles;
+
+            if (thread == 0 && progress)
+                *progress = static_cast<i32>(static_cast<float>(completed) / static_cast<float>(tiles.size()) * 100.0f);
+        }
+    };
+
+    {
+        // Pinned threads are all started anew, so that the calling thread keeps the CPUs it may run on.
+        const usize first_thread = batch_params.pin_threads ? 0 : 1;
+        auto threads = std::vector<std::jthread>{};
+        threads.reserve(thread_count - first_thread);
+
+        for (auto i = first_thread; i < thread_count; i++)
+            threads.emplace_back(work, i);
+
+        if (first_thread == 1)
+            work(0);
+    }
+
+    if (progress && !stop_token.stop_requested())
+        *progress = 100;
 }
 
 } // namespace tracer
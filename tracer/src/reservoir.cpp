@@ -0,0 +1,457 @@
+#include "tracer/reservoir.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tracer/accumulation.hpp"
+#include "tracer/assert.hpp"
+#include "tracer/color.hpp"
+#include "tracer/common.hpp"
+#include "tracer/lighting.hpp"
+#include "tracer/material.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/random.hpp"
+#include "tracer/ray.hpp"
+#include "tracer/scene.hpp"
+#include "tracer/software_renderer.hpp"
+#include "tracer/trigonometric.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Starts slightly off the surface, so that a bounce does not hit the surface it leaves due to rounding.
+constexpr auto hit_interval = Interval{ .min = 0.001, .max = +infinity };
+
+// Keeps shadow rays from hitting the surface they leave or the light they aim at due to rounding.
+constexpr double shadow_offset = 0.001;
+
+// Reservoirs are only shared between surfaces this alike, since a sample that lights one well may miss the other.
+constexpr double min_normal_cosine = 0.9;
+constexpr double max_relative_distance = 0.1;
+
+constexpr usize max_spatial_neighbours = 15;
+
+// Calls the function for every row, spread over the threads, and returns once all rows are done. Rows are no longer
+// handed out once a stop is requested.
+template<typename Function>
+auto for_each_row(usize rows, usize thread_count, const std::stop_token& stop_token, const Function& function) -> void
+{
+    auto next_row = std::atomic<usize>{ 0 };
+
+    auto work = [&] {
+        for (auto row = next_row++; row < rows && !stop_token.stop_requested(); row = next_row++)
+            function(row);
+    };
+
+    auto threads = std::vector<std::jthread>{};
+    threads.reserve(thread_count - 1);
+
+    for (usize i = 1; i < thread_count; i++)
+        threads.emplace_back(work);
+
+    work();
+}
+
+} // namespace
+
+auto ReservoirRenderer::render_frame(AccumulationBuffer& buffer, const Scene& scene, const Camera& camera,
+                                     const RenderParams& render_params, const ReservoirParams& params,
+                                     std::stop_token stop_token) -> void
+{
+    if (buffer.width() != _width || buffer.height() != _height)
+    {
+        _width = buffer.width();
+        _height = buffer.height();
+        _has_history = false;
+    }
+
+    const auto pixel_count = _width * _height;
+    _surfaces.resize(pixel_count);
+    _reservoirs.resize(pixel_count);
+    _radiance.resize(pixel_count);
+    _generators.resize(pixel_count);
+    _merged.resize(pixel_count);
+
+    auto thread_count = params.thread_count;
+
+    if (thread_count == 0)
+        thread_count = std::max(usize{ std::thread::hardware_concurrency() }, usize{ 1 });
+
+    thread_count = std::min(thread_count, std::max(_height, usize{ 1 }));
+
+    // Every stage finishes for all pixels before the next starts, since reuse reads the reservoirs of other pixels.
+    // Within a stage, every pixel writes only its own state, and draws from its own generator, so rows can go to any
+    // thread without changing the frame.
+    for_each_row(_height, thread_count, stop_token, [&](usize y) {
+        for (usize x = 0; x < _width; x++)
+        {
+            trace_primary(scene, camera, render_params, x, y);
+            sample_candidates(scene, params, y * _width + x);
+        }
+    });
+
+    if (stop_token.stop_requested())
+        return;
+
+    for_each_row(_height, thread_count, stop_token, [&](usize y) {
+        for (usize x = 0; x < _width; x++)
+            reuse_temporal(scene, params, y * _width + x);
+    });
+
+    for_each_row(_height, thread_count, stop_token, [&](usize y) {
+        for (usize x = 0; x < _width; x++)
+        {
+            reuse_spatial(scene, params, x, y);
+            shade(scene, y * _width + x);
+        }
+    });
+
+    if (stop_token.stop_requested())
+        return;
+
+    auto sums = buffer.sums();
+    auto sample_counts = buffer.sample_counts();
+
+    for (usize pixel = 0; pixel < pixel_count; pixel++)
+    {
+        sums[pixel] += _radiance[pixel];
+        sample_counts[pixel]++;
+    }
+
+    std::swap(_surfaces, _previous_surfaces);
+    std::swap(_merged, _previous_reservoirs);
+    _previous_camera = camera;
+    _has_history = true;
+    _frame++;
+}
+
+auto ReservoirRenderer::clear_history() -> void
+{
+    _has_history = false;
+}
+
+auto ReservoirRenderer::trace_primary(const Scene& scene, const Camera& camera, const RenderParams& render_params,
+                                      usize x, usize y) -> void
+{
+    const auto pixel = y * _width + x;
+    auto& random = _generators[pixel];
+    random = Random::for_sample(render_params.seed, pixel, _frame);
+
+    const auto viewport = SoftwareRenderer::create_viewport(_width, _height);
+    const auto pixel_size =
+        glm::dvec2{ viewport.width / static_cast<double>(_width), viewport.height / static_cast<double>(_height) };
+    const auto jitter = glm::dvec2{ random.get_double(-0.5, 0.5), random.get_double(-0.5, 0.5) } * pixel_size;
+    const auto target = glm::dvec3{
+        ((static_cast<double>(x) + 0.5) / static_cast<double>(_width) - 0.5) * viewport.width + jitter.x,
+        -(((static_cast<double>(y) + 0.5) / static_cast<double>(_height) - 0.5) * viewport.height) + jitter.y,
+        -camera.focal_length,
+    };
+
+    const auto& materials = scene.materials();
+    auto ray = Ray{ camera.position, glm::normalize(target) };
+    auto radiance = glm::vec3{ 0.0f };
+    auto throughput = glm::vec3{ 1.0f };
+    auto surface = Surface{};
+    auto distance = 0.0;
+
+    // Follows mirrors and glass up to the first diffuse surface.
+    for (usize depth = 0; depth < render_params.max_depth; depth++)
+    {
+        const auto hit = scene.closest_hit(ray, hit_interval);
+
+        if (!hit)
+        {
+            radiance += throughput * environment_radiance(scene, ray.direction());
+            break;
+        }
+
+        distance += hit->t;
+        const auto& material = materials[hit->material];
+
+        if (material.type == MaterialType::Emissive)
+        {
+            radiance += throughput * material.emission;
+            break;
+        }
+
+        if (material.type == MaterialType::Diffuse)
+        {
+            surface = Surface{
+                .point = hit->point,
+                .normal = hit->normal,
+                .reflectance = throughput * material.albedo,
+                .distance = distance,
+                .valid = true,
+            };
+
+            // The environment, through a single cosine-weighted bounce, which leaves just the albedo to weight it by.
+            const auto direction = glm::normalize(hit->normal + random.get_unit_dvec3());
+
+            if (!scene.occluded(Ray{ hit->point, direction }, hit_interval))
+                radiance += surface.reflectance * environment_radiance(scene, direction);
+
+            break;
+        }
+
+        auto scattered = scatter(material, ray, *hit, random);
+
+        if (!scattered)
+            break;
+
+        throughput *= scattered->attenuation;
+        ray = Ray{ hit->point, scattered->direction };
+    }
+
+    _surfaces[pixel] = surface;
+    _radiance[pixel] = radiance;
+}
+
+auto ReservoirRenderer::sample_candidates(const Scene& scene, const ReservoirParams& params, usize pixel) -> void
+{
+    auto& reservoir = _reservoirs[pixel];
+    reservoir = Reservoir{};
+
+    const auto& surface = _surfaces[pixel];
+    const auto lights = scene.lights();
+
+    if (!surface.valid || lights.empty())
+        return;
+
+    auto& random = _generators[pixel];
+
+    for (usize i = 0; i < params.candidates; i++)
+    {
+        const auto selection = scene.light_tree().select(surface.point, surface.normal, random.get_double());
+
+        if (selection && selection->probability > 0.0)
+        {
+            update(reservoir, selection->light, target(scene, surface, selection->light) / selection->probability,
+                   random);
+        }
+    }
+
+    reservoir.count = static_cast<u32>(params.candidates);
+
+    const auto chosen = target(scene, surface, reservoir.light);
+
+    if (reservoir.weight_sum > 0.0 && chosen > 0.0)
+        reservoir.weight = reservoir.weight_sum / (static_cast<double>(reservoir.count) * chosen);
+}
+
+auto ReservoirRenderer::reuse_temporal(const Scene& scene, const ReservoirParams& params, usize pixel) -> void
+{
+    const auto& surface = _surfaces[pixel];
+
+    if (!params.temporal_reuse || !_has_history || !surface.valid)
+        return;
+
+    const auto previous = reproject(surface.point);
+
+    if (!previous)
+        return;
+
+    const auto& previous_surface = _previous_surfaces[*previous];
+
+    if (!similar(surface, previous_surface))
+        return;
+
+    auto history = _previous_reservoirs[*previous];
+    history.count = std::min(history.count, params.max_history * static_cast<u32>(params.candidates));
+
+    const auto current = _reservoirs[pixel];
+    const auto surfaces = std::array<const Surface*, 2>{ &surface, &previous_surface };
+    const auto reservoirs = std::array<const Reservoir*, 2>{ &current, &history };
+
+    _reservoirs[pixel] = merge(scene, surface, surfaces, reservoirs, _generators[pixel]);
+}
+
+auto ReservoirRenderer::reuse_spatial(const Scene& scene, const ReservoirParams& params, usize x, usize y) -> void
+{
+    const auto pixel = y * _width + x;
+    const auto& surface = _surfaces[pixel];
+
+    if (!surface.valid || params.spatial_neighbours == 0)
+    {
+        _merged[pixel] = _reservoirs[pixel];
+        return;
+    }
+
+    auto& random = _generators[pixel];
+    auto surfaces = std::array<const Surface*, max_spatial_neighbours + 1>{ &surface };
+    auto reservoirs = std::array<const Reservoir*, max_spatial_neighbours + 1>{ &_reservoirs[pixel] };
+    usize count = 1;
+
+    for (usize i = 0; i < std::min(params.spatial_neighbours, max_spatial_neighbours); i++)
+    {
+        const auto angle = 2.0 * pi * random.get_double();
+        const auto radius = params.spatial_radius * std::sqrt(random.get_double());
+        const auto neighbour_x = std::clamp(static_cast<double>(x) + std::round(radius * std::cos(angle)), 0.0,
+                                            static_cast<double>(_width - 1));
+        const auto neighbour_y = std::clamp(static_cast<double>(y) + std::round(radius * std::sin(angle)), 0.0,
+                                            static_cast<double>(_height - 1));
+        const auto neighbour = static_cast<usize>(neighbour_y) * _width + static_cast<usize>(neighbour_x);
+        const auto& neighbour_surface = _surfaces[neighbour];
+
+        if (neighbour == pixel || !similar(surface, neighbour_surface))
+            continue;
+
+        surfaces[count] = &neighbour_surface;
+        reservoirs[count] = &_reservoirs[neighbour];
+        count++;
+    }
+
+    _merged[pixel] = merge(scene, surface, std::span{ surfaces }.first(count), std::span{ reservoirs }.first(count),
+                           random);
+}
+
+auto ReservoirRenderer::shade(const Scene& scene, usize pixel) -> void
+{
+    const auto& surface = _surfaces[pixel];
+    const auto& reservoir = _merged[pixel];
+
+    if (!surface.valid || reservoir.weight <= 0.0)
+        return;
+
+    auto& random = _generators[pixel];
+    const auto& light = *scene.lights()[reservoir.light];
+    const auto direction = light.sample_direction(surface.point, random);
+
+    if (!direction)
+        return;
+
+    const auto cosine = glm::dot(surface.normal, *direction);
+    const auto ray = Ray{ surface.point, *direction };
+    const auto light_hit = cosine > 0.0 ? light.hit(ray) : std::nullopt;
+
+    // The only shadow ray of the pixel.
+    if (!light_hit || scene.occluded(ray, Interval{ .min = shadow_offset, .max = light_hit->t - shadow_offset }))
+        return;
+
+    // Lambertian BRDF reflectance / pi, times the cosine, over the density of the direction.
+    const auto scale = static_cast<float>(cosine / pi / light.direction_pdf(surface.point) * reservoir.weight);
+    _radiance[pixel] += scene.materials()[light.material()].emission * surface.reflectance * scale;
+}
+
+auto ReservoirRenderer::similar(const Surface& surface, const Surface& other) -> bool
+{
+    // How far the other point is off the surface's tangent plane, which unlike the distance to the camera stays the
+    // same across pixels looking at a plane at a grazing angle, and when the camera moves.
+    return other.valid && glm::dot(surface.normal, other.normal) >= min_normal_cosine
+           && std::abs(glm::dot(surface.normal, other.point - surface.point))
+                  <= max_relative_distance * surface.distance;
+}
+
+auto ReservoirRenderer::target(const Scene& scene, const Surface& surface, u32 light) -> double
+{
+    const auto lights = scene.lights();
+
+    if (light >= lights.size())
+        return 0.0;
+
+    const auto& sphere = *lights[light];
+    const auto pdf = sphere.direction_pdf(surface.point);
+
+    if (pdf == 0.0)
+        return 0.0;
+
+    // The cosine toward the part of the sphere closest to the normal, 0 once all of it is below the surface.
+    const auto offset = sphere.center() - surface.point;
+    const auto distance = glm::length(offset);
+    const auto center_angle = std::acos(std::clamp(glm::dot(surface.normal, offset) / distance, -1.0, 1.0));
+    const auto cone_angle = std::asin(std::min(sphere.radius() / distance, 1.0));
+    const auto angle = std::max(center_angle - cone_angle, 0.0);
+
+    if (angle >= pi / 2.0)
+        return 0.0;
+
+    // Radiance times the solid angle of the sphere, which is 1 / pdf, times the cosine, times the BRDF.
+    const auto emission = scene.materials()[sphere.material()].emission;
+    return static_cast<double>(luminance(emission * surface.reflectance)) * std::cos(angle) / (pi * pdf);
+}
+
+auto ReservoirRenderer::update(Reservoir& reservoir, u32 light, double weight, Random& random) -> void
+{
+    if (weight <= 0.0)
+        return;
+
+    reservoir.weight_sum += weight;
+
+    if (random.get_double() * reservoir.weight_sum < weight)
+        reservoir.light = light;
+}
+
+auto ReservoirRenderer::merge(const Scene& scene, const Surface& surface, std::span<const Surface* const> surfaces,
+                              std::span<const Reservoir* const> reservoirs, Random& random) -> Reservoir
+{
+    TRACER_ASSERT(surfaces.size() == reservoirs.size());
+
+    auto merged = Reservoir{};
+
+    for (const auto* reservoir : reservoirs)
+    {
+        if (reservoir->weight > 0.0)
+        {
+            const auto weight = target(scene, surface, reservoir->light) * reservoir->weight
+                                * static_cast<double>(reservoir->count);
+            update(merged, reservoir->light, weight, random);
+        }
+
+        merged.count += reservoir->count;
+    }
+
+    const auto chosen = target(scene, surface, merged.light);
+
+    if (merged.weight_sum <= 0.0 || chosen <= 0.0)
+        return merged;
+
+    // Only the reservoirs whose surface could have drawn the chosen light count toward normalizing it, which keeps
+    // surfaces that see fewer lights from darkening their neighbours.
+    u32 count = 0;
+
+    for (usize i = 0; i < reservoirs.size(); i++)
+    {
+        if (target(scene, *surfaces[i], merged.light) > 0.0)
+            count += reservoirs[i]->count;
+    }
+
+    if (count != 0)
+        merged.weight = merged.weight_sum / (static_cast<double>(count) * chosen);
+
+    return merged;
+}
+
+auto ReservoirRenderer::reproject(const glm::dvec3& point) const -> std::optional<usize>
+{
+    const auto offset = point - _previous_camera.position;
+
+    // Cameras look down -z.
+    if (offset.z >= 0.0)
+        return std::nullopt;
+
+    const auto viewport = SoftwareRenderer::create_viewport(_width, _height);
+    const auto scale = _previous_camera.focal_length / -offset.z;
+    const auto u = offset.x * scale / viewport.width + 0.5;
+    const auto v = -offset.y * scale / viewport.height + 0.5;
+
+    if (u < 0.0 || u >= 1.0 || v < 0.0 || v >= 1.0)
+        return std::nullopt;
+
+    const auto x = std::min(static_cast<usize>(u * static_cast<double>(_width)), _width - 1);
+    const auto y = std::min(static_cast<usize>(v * static_cast<double>(_height)), _height - 1);
+    return y * _width + x;
+}
+
+} // namespace tracer
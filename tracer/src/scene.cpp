@@ -0,0 +1,414 @@
+#include "tracer/scene.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/trigonometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tracer/assert.hpp"
+#include "tracer/bvh.hpp"
+#include "tracer/environment.hpp"
+#include "tracer/grid.hpp"
+#include "tracer/instance.hpp"
+#include "tracer/material.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/packet.hpp"
+#include "tracer/ray.hpp"
+#include "tracer/wide_bvh.hpp"
+
+namespace tracer {
+
+namespace {
+
+// How much refits may increase the cost of the BVH before it gets rebuilt.
+constexpr double max_refit_cost_growth = 1.5;
+
+[[nodiscard]] auto split_words(std::string_view line) -> std::vector<std::string_view>
+{
+    auto words = std::vector<std::string_view>{};
+
+    while (!line.empty())
+    {
+        auto start = line.find_first_not_of(" \t\r");
+
+        if (start == std::string_view::npos)
+            break;
+
+        line.remove_prefix(start);
+        auto end = std::min(line.find_first_of(" \t\r"), line.size());
+        words.push_back(line.substr(0, end));
+        line.remove_prefix(end);
+    }
+
+    return words;
+}
+
+// Rejects "nan" and "inf", which from_chars accepts, since NaN passes every range check below and neither is a
+// position or size the BVH can bin.
+[[nodiscard]] auto parse_double(std::string_view text, double& value) -> bool
+{
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size() && std::isfinite(value);
+}
+
+// Parses the words of a "material" line.
+[[nodiscard]] auto parse_material(std::span<const std::string_view> words) -> std::optional<Material>
+{
+    if (words.size() < 4)
+        return std::nullopt;
+
+    const auto type = words[2];
+    auto color = glm::dvec3{ 0.0 };
+    auto has_color = words.size() >= 6 && parse_double(words[3], color.r) && parse_double(words[4], color.g)
+                     && parse_double(words[5], color.b) && color.r >= 0.0 && color.g >= 0.0 && color.b >= 0.0;
+
+    if (type == "diffuse" && words.size() == 6 && has_color)
+        return Material::diffuse(glm::vec3{ color });
+
+    if (type == "metal" && (words.size() == 6 || words.size() == 7) && has_color)
+    {
+        auto fuzz = 0.0;
+
+        if (words.size() == 7 && (!parse_double(words[6], fuzz) || fuzz < 0.0 || fuzz > 1.0))
+            return std::nullopt;
+
+        return Material::metal(glm::vec3{ color }, static_cast<float>(fuzz));
+    }
+
+    if (type == "dielectric" && words.size() == 4)
+    {
+        auto refractive_index = 0.0;
+
+        if (!parse_double(words[3], refractive_index) || refractive_index <= 0.0)
+            return std::nullopt;
+
+        return Material::dielectric(static_cast<float>(refractive_index));
+    }
+
+    if (type == "emissive" && words.size() == 6 && has_color)
+        return Material::emissive(glm::vec3{ color });
+
+    return std::nullopt;
+}
+
+// The file a scene may read for the path it names, or std::nullopt if the parameters do not allow it.
+[[nodiscard]] auto resolve_scene_file(std::string_view name, const SceneParseParams& params)
+    -> std::optional<std::filesystem::path>
+{
+    if (!params.load_files)
+        return std::nullopt;
+
+    auto path = std::filesystem::path{ name };
+
+    if (params.asset_directory.empty())
+        return path;
+
+    // Resolves symbolic links too, so that neither ".." nor a link inside the directory leads out of it.
+    auto error = std::error_code{};
+    const auto directory = std::filesystem::weakly_canonical(params.asset_directory, error);
+
+    if (error || path.has_root_path())
+        return std::nullopt;
+
+    path = std::filesystem::weakly_canonical(directory / path, error);
+
+    if (error || std::ranges::mismatch(directory, path).in1 != directory.end())
+        return std::nullopt;
+
+    return path;
+}
+
+} // namespace
+
+Scene::Scene(std::vector<std::shared_ptr<const Object>> objects, MaterialTable materials, Accelerator accelerator)
+    : _objects{ std::move(objects) }, _materials{ std::move(materials) }, _accelerator{ accelerator }, _bvh{ _objects },
+      _build_cost{ _bvh.cost() }
+{
+    build_accelerator();
+    collect_lights();
+}
+
+auto Scene::update(std::vector<std::shared_ptr<const Object>> objects) -> void
+{
+    TRACER_ASSERT(objects.size() == _objects.size());
+    _objects = std::move(objects);
+    _bvh.refit(_objects);
+
+    if (_bvh.cost() > max_refit_cost_growth * _build_cost)
+    {
+        _bvh = Bvh{ _objects };
+        _build_cost = _bvh.cost();
+    }
+
+    build_accelerator();
+    collect_lights();
+}
+
+auto Scene::set_accelerator(Accelerator accelerator) -> void
+{
+    _accelerator = accelerator;
+    build_accelerator();
+}
+
+auto Scene::set_environment(std::shared_ptr<const EnvironmentMap> environment) -> void
+{
+    _environment = std::move(environment);
+}
+
+auto Scene::build_accelerator() -> void
+{
+    _bvh4 = _accelerator == Accelerator::Wide4 ? Bvh4{ _bvh } : Bvh4{};
+    _bvh8 = _accelerator == Accelerator::Wide8 ? Bvh8{ _bvh } : Bvh8{};
+
+    if (_accelerator == Accelerator::Grid)
+        _grid = Grid{ _objects, Grid::Storage::Dense };
+    else if (_accelerator == Accelerator::HashedGrid)
+        _grid = Grid{ _objects, Grid::Storage::Hashed };
+    else
+        _grid = Grid{};
+}
+
+auto Scene::collect_lights() -> void
+{
+    _lights.clear();
+    _light_indices.clear();
+
+    for (const auto& object : _objects)
+    {
+        const auto* sphere = dynamic_cast<const Sphere*>(object.get());
+
+        if (sphere && _materials[sphere->material()].type == MaterialType::Emissive
+            && _materials[sphere->material()].emission != glm::vec3{ 0.0f })
+        {
+            _light_indices.emplace(sphere, static_cast<u32>(_lights.size()));
+            _lights.push_back(sphere);
+        }
+    }
+
+    _light_tree = LightTree{ _lights, _materials };
+}
+
+auto Scene::light_index(const Object& emitter) const -> std::optional<u32>
+{
+    auto light = _light_indices.find(&emitter);
+
+    if (light == _light_indices.end())
+        return std::nullopt;
+
+    return light->second;
+}
+
+auto Scene::closest_hit(const Ray& ray, Interval interval) const -> std::optional<Hit>
+{
+    switch (_accelerator)
+    {
+    case Accelerator::Binary:
+        return _bvh.closest_hit(_objects, ray, interval);
+    case Accelerator::Wide4:
+        return _bvh4.closest_hit(_objects, ray, interval);
+    case Accelerator::Wide8:
+        return _bvh8.closest_hit(_objects, ray, interval);
+    case Accelerator::Grid:
+    case Accelerator::HashedGrid:
+        return _grid.closest_hit(_objects, ray, interval);
+    }
+
+    return std::nullopt;
+}
+
+auto Scene::occluded(const Ray& ray, Interval interval) const -> bool
+{
+    switch (_accelerator)
+    {
+    case Accelerator::Binary:
+        return _bvh.occluded(_objects, ray, interval);
+    case Accelerator::Wide4:
+        return _bvh4.occluded(_objects, ray, interval);
+    case Accelerator::Wide8:
+        return _bvh8.occluded(_objects, ray, interval);
+    case Accelerator::Grid:
+    case Accelerator::HashedGrid:
+        return _grid.occluded(_objects, ray, interval);
+    }
+
+    return false;
+}
+
+auto Scene::closest_hits(const RayPacket& packet, Interval interval, std::span<std::optional<Hit>> hits) const -> void
+{
+    _bvh.closest_hits(_objects, packet, interval, hits);
+}
+
+auto parse_scene(std::string_view text, const SceneParseParams& params) -> std::optional<Scene>
+{
+    auto objects = std::vector<std::shared_ptr<const Object>>{};
+    auto models = std::map<std::string, std::shared_ptr<const Model>, std::less<>>{};
+
+    // Objects of the model being defined, if any.
+    auto model_name = std::optional<std::string>{};
+    auto model_objects = std::vector<std::shared_ptr<const Object>>{};
+    auto environment = std::shared_ptr<const EnvironmentMap>{};
+    auto materials = MaterialTable{};
+    auto material_ids = std::map<std::string, MaterialId, std::less<>>{};
+
+    while (!text.empty())
+    {
+        auto line_end = std::min(text.find('\n'), text.size());
+        auto line = text.substr(0, line_end);
+        text.remove_prefix(std::min(line_end + 1, text.size()));
+
+        if (auto comment = line.find('#'); comment != std::string_view::npos)
+            line = line.substr(0, comment);
+
+        auto words = split_words(line);
+
+        if (words.empty())
+            continue;
+
+        if (words[0] == "material")
+        {
+            auto material = parse_material(words);
+
+            if (!material || model_name || material_ids.contains(words[1]))
+                return std::nullopt;
+
+            material_ids.emplace(std::string{ words[1] }, materials.add(*material));
+        }
+        else if (words[0] == "sphere")
+        {
+            auto center = glm::dvec3{ 0.0 };
+            auto radius = 0.0;
+            auto material = words.size() == 6 ? material_ids.find(words[5]) : material_ids.end();
+
+            if ((words.size() != 5 && (words.size() != 6 || material == material_ids.end()))
+                || !parse_double(words[1], center.x) || !parse_double(words[2], center.y)
+                || !parse_double(words[3], center.z) || !parse_double(words[4], radius) || radius <= 0.0)
+            {
+                return std::nullopt;
+            }
+
+            auto id = words.size() == 6 ? material->second : MaterialTable::default_material;
+            (model_name ? model_objects : objects).push_back(std::make_shared<Sphere>(center, radius, id));
+        }
+        else if (words[0] == "light")
+        {
+            auto center = glm::dvec3{ 0.0 };
+            auto radius = 0.0;
+            auto emission = glm::dvec3{ 0.0 };
+
+            if (words.size() != 8 || model_name || !parse_double(words[1], center.x)
+                || !parse_double(words[2], center.y) || !parse_double(words[3], center.z)
+                || !parse_double(words[4], radius) || !parse_double(words[5], emission.r)
+                || !parse_double(words[6], emission.g) || !parse_double(words[7], emission.b) || radius <= 0.0
+                || emission.r < 0.0 || emission.g < 0.0 || emission.b < 0.0)
+            {
+                return std::nullopt;
+            }
+
+            auto id = materials.add(Material::emissive(glm::vec3{ emission }));
+            objects.push_back(std::make_shared<Sphere>(center, radius, id));
+        }
+        else if (words[0] == "model")
+        {
+            if (words.size() != 2 || model_name || models.contains(words[1]))
+                return std::nullopt;
+
+            model_name = std::string{ words[1] };
+        }
+        else if (words[0] == "end")
+        {
+            if (words.size() != 1 || !model_name || model_objects.empty())
+                return std::nullopt;
+
+            models.emplace(std::move(*model_name), std::make_shared<const Model>(std::move(model_objects)));
+            model_name.reset();
+            model_objects.clear();
+        }
+        else if (words[0] == "instance")
+        {
+            auto model = models.find(words.size() >= 2 ? words[1] : std::string_view{});
+            auto position = glm::dvec3{ 0.0 };
+            auto scale = 1.0;
+            auto rotation = 0.0;
+
+            if (words.size() < 5 || words.size() > 7 || model_name || model == models.end()
+                || !parse_double(words[2], position.x) || !parse_double(words[3], position.y)
+                || !parse_double(words[4], position.z) || (words.size() > 5 && !parse_double(words[5], scale))
+                || (words.size() > 6 && !parse_double(words[6], rotation)) || scale <= 0.0)
+            {
+                return std::nullopt;
+            }
+
+            auto transform = glm::translate(glm::dmat4{ 1.0 }, position);
+            transform = glm::rotate(transform, glm::radians(rotation), glm::dvec3{ 0.0, 1.0, 0.0 });
+            transform = glm::scale(transform, glm::dvec3{ scale });
+            objects.push_back(std::make_shared<Instance>(model->second, transform));
+        }
+        else if (words[0] == "environment")
+        {
+            auto scale = 1.0;
+
+            if (words.size() < 2 || words.size() > 3 || model_name || environment
+                || (words.size() > 2 && !parse_double(words[2], scale)) || scale < 0.0)
+            {
+                return std::nullopt;
+            }
+
+            const auto path = resolve_scene_file(words[1], params);
+
+            if (!path)
+                return std::nullopt;
+
+            auto map = EnvironmentMap::load(*path, static_cast<float>(scale));
+
+            if (!map)
+                return std::nullopt;
+
+            environment = std::make_shared<const EnvironmentMap>(std::move(*map));
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (model_name)
+        return std::nullopt;
+
+    auto scene = Scene{ std::move(objects), std::move(materials) };
+    scene.set_environment(std::move(environment));
+    return scene;
+}
+
+auto load_scene_text(const std::filesystem::path& path) -> std::optional<std::string>
+{
+    auto file = std::ifstream{ path };
+
+    if (!file)
+        return std::nullopt;
+
+    auto stream = std::ostringstream{};
+    stream << file.rdbuf();
+    return std::move(stream).str();
+}
+
+} // namespace tracer
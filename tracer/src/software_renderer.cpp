@@ -1,43 +1,191 @@
 #include "tracer/software_renderer.hpp"
 
 #include <glm/common.hpp>
-#include <glm/exponential.hpp>
 #include <glm/geometric.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
+#include <algorithm>
+#include <array>
 #include <optional>
+#include <span>
 #include <stop_token>
 
+#include "tracer/accumulation.hpp"
 #include "tracer/assert.hpp"
+#include "tracer/color.hpp"
 #include "tracer/common.hpp"
 #include "tracer/geometric.hpp"
+#include "tracer/guiding.hpp"
+#include "tracer/lighting.hpp"
+#include "tracer/material.hpp"
 #include "tracer/numeric.hpp"
 #include "tracer/object.hpp"
+#include "tracer/packet.hpp"
 #include "tracer/random.hpp"
 #include "tracer/ray.hpp"
+#include "tracer/scene.hpp"
+#include "tracer/trigonometric.hpp"
 
 namespace tracer {
 
-SoftwareRenderer::SoftwareRenderer(const ImageView<glm::vec4>& image, ObjectSpan world, const Camera& camera,
+namespace {
+
+// Starts slightly off the surface, so that a bounce does not hit the surface it leaves due to rounding.
+constexpr auto hit_interval = Interval{ .min = 0.001, .max = +infinity };
+
+// Blocks are traced into arrays of max_packet_size rays. The packet size never changes the image, so a size out of
+// range is clamped rather than rejected.
+[[nodiscard]] auto clamp_packet_size(RenderParams render_params) -> RenderParams
+{
+    render_params.packet_size = std::clamp(render_params.packet_size, usize{ 1 }, max_packet_side);
+    return render_params;
+}
+
+} // namespace
+
+SoftwareRenderer::SoftwareRenderer(const ImageView<glm::vec4>& image, const Scene& scene, const Camera& camera,
+                                   const RenderParams& render_params)
+    : SoftwareRenderer{ image, Tile{ .x = 0, .y = 0, .width = image.width(), .height = image.height() },
+                        image.width(), image.height(), scene, camera, render_params }
+{}
+
+SoftwareRenderer::SoftwareRenderer(const ImageView<glm::vec4>& image, const Tile& tile, usize frame_width,
+                                   usize frame_height, const Scene& scene, const Camera& camera,
                                    const RenderParams& render_params)
-    : _image{ image }, _world{ world }, _camera{ camera }, _render_params{ render_params },
-      _viewport{ create_viewport(_image.width(), _image.height()) }
+    : _image{ image }, _tile{ tile }, _frame_width{ frame_width }, _frame_height{ frame_height }, _scene{ &scene },
+      _camera{ camera }, _render_params{ clamp_packet_size(render_params) },
+      _viewport{ create_viewport(_frame_width, _frame_height) }, _block_radiance{ select_block_kernel() }
+{
+    TRACER_ASSERT(_image.width() == _tile.width && _image.height() == _tile.height);
+    TRACER_ASSERT(_tile.x + _tile.width <= _frame_width && _tile.y + _tile.height <= _frame_height);
+}
+
+SoftwareRenderer::SoftwareRenderer(usize frame_width, usize frame_height, const Scene& scene, const Camera& camera,
+                                   const RenderParams& render_params)
+    : SoftwareRenderer{ Tile{ .x = 0, .y = 0, .width = frame_width, .height = frame_height }, frame_width,
+                        frame_height, scene, camera, render_params }
 {}
 
+SoftwareRenderer::SoftwareRenderer(const Tile& tile, usize frame_width, usize frame_height, const Scene& scene,
+                                   const Camera& camera, const RenderParams& render_params)
+    : _tile{ tile }, _frame_width{ frame_width }, _frame_height{ frame_height }, _scene{ &scene }, _camera{ camera },
+      _render_params{ clamp_packet_size(render_params) }, _viewport{ create_viewport(_frame_width, _frame_height) },
+      _block_radiance{ select_block_kernel() }
+{
+    TRACER_ASSERT(_tile.x + _tile.width <= _frame_width && _tile.y + _tile.height <= _frame_height);
+}
+
 auto SoftwareRenderer::render(std::stop_token stop_token, volatile i32* progress) -> void
 {
     if (progress)
         *progress = 0;
 
-    for (usize y = 0; y < _image.height(); y++)
+    const auto block_size = _render_params.packet_size;
+    auto active = std::array<bool, max_packet_size>{};
+    auto radiance = std::array<glm::vec3, max_packet_size>{};
+    auto sums = std::array<glm::vec3, max_packet_size>{};
+    active.fill(true);
+
+    for (usize y = 0; y < _tile.height; y += block_size)
+    {
+        if (progress)
+            *progress = static_cast<i32>(static_cast<float>(y) / static_cast<float>(_tile.height) * 100.0f);
+
+        for (usize x = 0; x < _tile.width; x += block_size)
+        {
+            const auto block = Tile{
+                .x = _tile.x + x,
+                .y = _tile.y + y,
+                .width = std::min(block_size, _tile.width - x),
+                .height = std::min(block_size, _tile.height - y),
+            };
+            const auto pixel_count = block.width * block.height;
+
+            sums.fill(glm::vec3{ 0.0f });
+
+            for (usize sample = 0; sample < _render_params.samples; sample++)
+            {
+                (this->*_block_radiance)(block, sample, std::span{ active }.first(pixel_count),
+                                         std::span{ radiance }.first(pixel_count));
+
+                for (usize i = 0; i < pixel_count; i++)
+                    sums[i] += radiance[i];
+            }
+
+            for (usize i = 0; i < pixel_count; i++)
+                _image[y + i / block.width, x + i % block.width] = glm::vec4{ pixel_color(sums[i]), 1.0f };
+        }
+
+        if (stop_token.stop_requested())
+            return;
+    }
+
+    if (progress)
+        *progress = 100;
+}
+
+auto SoftwareRenderer::accumulate(AccumulationBuffer& buffer, usize target_samples, std::stop_token stop_token,
+                                  volatile i32* progress) -> void
+{
+    // The buffer covers the tile, not the whole frame.
+    TRACER_ASSERT(buffer.width() == _tile.width && buffer.height() == _tile.height);
+
+    if (progress)
+        *progress = 0;
+
+    auto sums = buffer.sums();
+    auto sample_counts = buffer.sample_counts();
+
+    const auto block_size = _render_params.packet_size;
+    auto active = std::array<bool, max_packet_size>{};
+    auto radiance = std::array<glm::vec3, max_packet_size>{};
+
+    for (usize y = 0; y < _tile.height; y += block_size)
     {
         if (progress)
-            *progress = static_cast<i32>(static_cast<float>(y) / static_cast<float>(_image.height()) * 100.0f);
+            *progress = static_cast<i32>(static_cast<float>(y) / static_cast<float>(_tile.height) * 100.0f);
 
-        for (usize x = 0; x < _image.width(); x++)
-            _image[y, x] = glm::vec4{ pixel_color(pixel(x, y)), 1.0f };
+        for (usize x = 0; x < _tile.width; x += block_size)
+        {
+            const auto block = Tile{
+                .x = _tile.x + x,
+                .y = _tile.y + y,
+                .width = std::min(block_size, _tile.width - x),
+                .height = std::min(block_size, _tile.height - y),
+            };
+            const auto pixel_count = block.width * block.height;
+
+            auto buffer_index = [&](usize i) { return (y + i / block.width) * _tile.width + x + i % block.width; };
+
+            // Pixels of a block usually hold the same number of samples, but each only gets the ones it lacks.
+            auto first_sample = target_samples;
+
+            for (usize i = 0; i < pixel_count; i++)
+                first_sample = std::min(first_sample, usize{ sample_counts[buffer_index(i)] });
+
+            for (auto sample = first_sample; sample < target_samples; sample++)
+            {
+                for (usize i = 0; i < pixel_count; i++)
+                    active[i] = sample >= sample_counts[buffer_index(i)];
+
+                (this->*_block_radiance)(block, sample, std::span{ active }.first(pixel_count),
+                                         std::span{ radiance }.first(pixel_count));
+
+                for (usize i = 0; i < pixel_count; i++)
+                {
+                    if (active[i])
+                        sums[buffer_index(i)] += radiance[i];
+                }
+            }
+
+            for (usize i = 0; i < pixel_count; i++)
+            {
+                auto& sample_count = sample_counts[buffer_index(i)];
+                sample_count = std::max(sample_count, static_cast<u32>(target_samples));
+            }
+        }
 
         if (stop_token.stop_requested())
             return;
@@ -47,17 +195,24 @@ auto SoftwareRenderer::render(std::stop_token stop_token, volatile i32* progress
         *progress = 100;
 }
 
+auto SoftwareRenderer::set_guiding(const GuidingField* field, GuidingRecorder* recorder) -> void
+{
+    _guiding = field;
+    _recorder = recorder;
+    _block_radiance = select_block_kernel();
+}
+
 auto SoftwareRenderer::pixel(usize x, usize y) const -> Pixel
 {
     const auto pixel_position_relative_to_camera =
-        glm::dvec3{ ((static_cast<double>(x) + 0.5) / static_cast<double>(_image.width()) - 0.5) * _viewport.width,
-                    -(((static_cast<double>(y) + 0.5) / static_cast<double>(_image.height()) - 0.5) * _viewport.height),
+        glm::dvec3{ ((static_cast<double>(x) + 0.5) / static_cast<double>(_frame_width) - 0.5) * _viewport.width,
+                    -(((static_cast<double>(y) + 0.5) / static_cast<double>(_frame_height) - 0.5) * _viewport.height),
                     -_camera.focal_length };
 
     TRACER_ASSERT(_camera.focal_length != 0.0);
     const auto pixel_position = _camera.position + pixel_position_relative_to_camera;
-    const auto pixel_size = glm::dvec2{ _viewport.width / static_cast<double>(_image.width()),
-                                        _viewport.height / static_cast<double>(_image.height()) };
+    const auto pixel_size = glm::dvec2{ _viewport.width / static_cast<double>(_frame_width),
+                                        _viewport.height / static_cast<double>(_frame_height) };
 
     return Pixel{
         .position = pixel_position,
@@ -65,18 +220,15 @@ auto SoftwareRenderer::pixel(usize x, usize y) const -> Pixel
     };
 }
 
-auto SoftwareRenderer::pixel_color(const Pixel& pixel) -> glm::vec3
+auto SoftwareRenderer::pixel_index(usize x, usize y) const -> usize
 {
-    auto color = glm::vec3{ 0.0f };
-
-    for (usize i = 0; i < _render_params.samples; i++)
-    {
-        auto ray = sample_pixel(pixel);
-        color += ray_color(ray, _render_params.max_depth);
-    }
+    return y * _frame_width + x;
+}
 
+auto SoftwareRenderer::pixel_color(const glm::vec3& radiance_sum) const -> glm::vec3
+{
     TRACER_ASSERT(_render_params.samples != 0);
-    color /= static_cast<float>(_render_params.samples);
+    auto color = radiance_sum / static_cast<float>(_render_params.samples);
     color = gamma_correction(color);
     color = glm::clamp(color, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
 
@@ -92,63 +244,234 @@ auto SoftwareRenderer::sample_pixel(const Pixel& pixel) -> Ray
     return Ray{ _camera.position, ray_direction };
 }
 
-auto SoftwareRenderer::ray_color(const Ray& ray, usize max_depth) -> glm::vec3
+auto SoftwareRenderer::select_block_kernel() const -> BlockKernel
 {
-    if (max_depth == 0)
-        return glm::vec3{ 0.0f };
+    if (_guiding && _recorder)
+        return &SoftwareRenderer::block_radiance<PathConfig{ .guided = true, .recording = true }>;
 
-    if (auto hit = closest_hit(ray, Interval{ .min = 0.001, .max = +infinity }))
+    if (_guiding)
+        return &SoftwareRenderer::block_radiance<PathConfig{ .guided = true }>;
+
+    // Depth limits low enough for the loop to unroll, as for previews and direct lighting.
+    switch (_render_params.max_depth)
     {
-        static constexpr auto material_color = glm::vec3{ 0.5f };
+    case 1:
+        return &SoftwareRenderer::block_radiance<PathConfig{ .max_depth = 1 }>;
+    case 2:
+        return &SoftwareRenderer::block_radiance<PathConfig{ .max_depth = 2 }>;
+    case 4:
+        return &SoftwareRenderer::block_radiance<PathConfig{ .max_depth = 4 }>;
+    case 8:
+        return &SoftwareRenderer::block_radiance<PathConfig{ .max_depth = 8 }>;
+    default:
+        return &SoftwareRenderer::block_radiance<PathConfig{}>;
+    }
+}
 
-        auto reflect_direction = lambertian_reflection(hit->normal);
-        auto reflected_ray = Ray{
-            hit->point,
-            reflect_direction,
+template<SoftwareRenderer::PathConfig Config>
+auto SoftwareRenderer::block_radiance(const Tile& block, usize sample_index, std::span<const bool> active,
+                                      std::span<glm::vec3> radiance) -> void
+{
+    TRACER_ASSERT(active.size() == block.width * block.height && radiance.size() == active.size());
+    TRACER_ASSERT(active.size() <= max_packet_size);
+
+    if (Config.max_depth == 0 && _render_params.max_depth == 0)
+    {
+        std::ranges::fill(radiance, glm::vec3{ 0.0f });
+        return;
+    }
+
+    // Every ray keeps its own generator, so that its path continues exactly as if it had been traced alone.
+    auto directions = std::array<glm::dvec3, max_packet_size>{};
+    std::array<Random, max_packet_size> generators;
+    auto pixels = std::array<u8, max_packet_size>{};
+    usize ray_count = 0;
+
+    for (usize i = 0; i < active.size(); i++)
+    {
+        if (!active[i])
+            continue;
+
+        const auto x = block.x + i % block.width;
+        const auto y = block.y + i / block.width;
+
+        _random = Random::for_sample(_render_params.seed, pixel_index(x, y), sample_index);
+        directions[ray_count] = sample_pixel(pixel(x, y)).direction();
+        generators[ray_count] = _random;
+        pixels[ray_count] = static_cast<u8>(i);
+        ray_count++;
+    }
+
+    auto hits = std::array<std::optional<Hit>, max_packet_size>{};
+
+    if (ray_count == 1)
+    {
+        hits[0] = closest_hit(Ray{ _camera.position, directions[0] }, hit_interval);
+    }
+    else if (ray_count > 1)
+    {
+        auto packet = RayPacket{
+            .origin = _camera.position,
+            .directions = std::span{ directions }.first(ray_count),
+            .frustum = block_frustum(block),
         };
+        _scene->closest_hits(packet, hit_interval, std::span{ hits }.first(ray_count));
+    }
 
-        return material_color * ray_color(reflected_ray, max_depth - 1);
+    for (usize i = 0; i < ray_count; i++)
+    {
+        _random = generators[i];
+        radiance[pixels[i]] = trace_path<Config>(Ray{ _camera.position, directions[i] }, hits[i]);
     }
+}
 
-    return ambient(ray);
+auto SoftwareRenderer::block_frustum(const Tile& block) const -> Frustum
+{
+    const auto first = pixel(block.x, block.y);
+    const auto last = pixel(block.x + block.width - 1, block.y + block.height - 1);
+
+    // Samples stay within half a pixel of the pixel centers. The small margin keeps rays on the edges of the block
+    // inside the frustum despite rounding.
+    const auto half_size = first.size * 0.501;
+    const auto left = first.position.x - half_size.x;
+    const auto right = last.position.x + half_size.x;
+    const auto top = first.position.y + half_size.y;
+    const auto bottom = last.position.y - half_size.y;
+    const auto z = first.position.z;
+
+    return Frustum{
+        _camera.position,
+        {
+            glm::dvec3{ left, bottom, z },
+            glm::dvec3{ right, bottom, z },
+            glm::dvec3{ right, top, z },
+            glm::dvec3{ left, top, z },
+        },
+    };
 }
 
-auto SoftwareRenderer::closest_hit(const Ray& ray, Interval interval) const -> std::optional<Hit>
+template<SoftwareRenderer::PathConfig Config>
+auto SoftwareRenderer::trace_path(Ray ray, std::optional<Hit> hit) -> glm::vec3
 {
-    auto closest = std::optional<Hit>{};
+    TRACER_ASSERT(!Config.guided || _guiding);
+    TRACER_ASSERT(!Config.recording || _recorder);
+
+    const auto& materials = _scene->materials();
+    const auto max_depth = Config.max_depth != 0 ? Config.max_depth : _render_params.max_depth;
+
+    auto radiance = glm::vec3{ 0.0f };
+    auto throughput = glm::vec3{ 1.0f };
 
-    for (auto& object : _world)
+    // The diffuse surface the current ray bounced off, if any, to weight the emission it finds against light sampling.
+    // Other surfaces do not sample lights, so what their bounces find counts in full.
+    auto previous = std::optional<Hit>{};
+
+    for (usize depth = 0; depth < max_depth; depth++)
     {
-        if (auto hit = object->hit(ray, interval))
+        if (depth != 0)
+            hit = closest_hit(ray, hit_interval);
+
+        if (!hit)
         {
-            closest = hit;
-            interval.max = closest->t;
+            auto weight = previous ? environment_weight(*_scene, *previous, ray.direction()) : 1.0f;
+            radiance += throughput * environment_radiance(*_scene, ray.direction()) * weight;
+            break;
         }
+
+        TRACER_ASSERT(hit->object);
+
+        const auto& material = materials[hit->material];
+
+        if (material.type == MaterialType::Emissive)
+        {
+            auto weight = previous ? emission_weight(*_scene, *previous, ray.direction(), *hit->object) : 1.0f;
+            radiance += throughput * material.emission * weight;
+            break;
+        }
+
+        if (material.type == MaterialType::Diffuse)
+        {
+            if (auto light = sample_light(*_scene, *hit, material.albedo, _random))
+            {
+                if (!_scene->occluded(light->ray, light->interval))
+                    radiance += throughput * light->radiance;
+            }
+        }
+
+        // Nothing a bounce off the last vertex finds counts, except in the samples recorded for guiding.
+        if (!Config.recording && depth + 1 == max_depth)
+            break;
+
+        if (Config.guided && material.type == MaterialType::Diffuse)
+        {
+            const auto bounce = sample_guided_bounce(_guiding->find(hit->point), hit->normal, _random);
+            const auto cosine = glm::dot(hit->normal, bounce.direction);
+
+            if (cosine <= 0.0 || bounce.pdf <= 0.0)
+                break;
+
+            throughput *= material.albedo * static_cast<float>(cosine / pi / bounce.pdf);
+            previous = hit;
+            ray = Ray{ hit->point, bounce.direction };
+
+            if constexpr (Config.recording)
+            {
+                _vertices.push_back(GuidingVertex{
+                    .point = hit->point,
+                    .direction = bounce.direction,
+                    .throughput = throughput,
+                    .radiance = radiance,
+                    .pdf = bounce.pdf,
+                });
+            }
+
+            continue;
+        }
+
+        auto scattered = scatter(material, ray, *hit, _random);
+
+        if (!scattered)
+            break;
+
+        throughput *= scattered->attenuation;
+        previous = material.type == MaterialType::Diffuse ? hit : std::nullopt;
+        ray = Ray{ hit->point, scattered->direction };
     }
 
-    return closest;
+    if constexpr (Config.recording)
+        record_vertices(radiance);
+
+    return radiance;
 }
 
-auto SoftwareRenderer::ambient(const Ray& ray) -> glm::vec3
+auto SoftwareRenderer::record_vertices(const glm::vec3& radiance) -> void
 {
-    static constexpr auto blue = glm::vec3{ 0.5f, 0.7f, 1.0f };
-    static constexpr auto white = glm::vec3{ 1.0f };
+    for (const auto& vertex : _vertices)
+    {
+        // Radiance arriving at the vertex along the bounce, undoing the throughput of the path up to it.
+        const auto found = radiance - vertex.radiance;
+        auto incident = glm::vec3{ 0.0f };
 
-    auto blend = static_cast<float>(ray.direction().y) / 2.0f + 0.5f;
-    auto color = blend * blue + (1.0f - blend) * white;
+        for (auto channel = 0; channel < 3; channel++)
+        {
+            if (vertex.throughput[channel] > 0.0f)
+                incident[channel] = found[channel] / vertex.throughput[channel];
+        }
 
-    return color;
+        _recorder->record(vertex.point, vertex.direction, static_cast<double>(luminance(incident)) / vertex.pdf);
+    }
+
+    _vertices.clear();
 }
 
-auto SoftwareRenderer::random_reflection(const glm::dvec3& normal) -> glm::dvec3
+auto SoftwareRenderer::closest_hit(const Ray& ray, Interval interval) const -> std::optional<Hit>
 {
-    return faceforward(_random.get_unit_dvec3(), normal);
+    return _scene->closest_hit(ray, interval);
 }
 
-auto SoftwareRenderer::lambertian_reflection(const glm::dvec3& normal) -> glm::dvec3
+auto SoftwareRenderer::random_reflection(const glm::dvec3& normal) -> glm::dvec3
 {
-    // Pick a random point on a unit sphere tangent to the intersection point.
-    return glm::normalize(normal + _random.get_unit_dvec3());
+    return faceforward(_random.get_unit_dvec3(), normal);
 }
 
 auto SoftwareRenderer::sample_unit_square() -> glm::dvec2
@@ -169,11 +492,4 @@ auto SoftwareRenderer::create_viewport(usize image_width, usize image_height) ->
     };
 }
 
-auto SoftwareRenderer::gamma_correction(glm::vec3 linear_space_color) -> glm::vec3
-{
-    // We're using a gamma value of 2.0, therefore the inverse is just the square root.
-    linear_space_color = glm::clamp(linear_space_color, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
-    return glm::sqrt(linear_space_color);
-}
-
 } // namespace tracer
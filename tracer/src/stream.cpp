@@ -0,0 +1,189 @@
+#include "tracer/stream.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include "tracer/assert.hpp"
+#include "tracer/common.hpp"
+#include "tracer/kernels.hpp"
+#include "tracer/scene.hpp"
+#include "tracer/renderer.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Only the staging buffer that gets written to the file holds a whole band, the render threads work on tiles of their
+// own. Guiding also keeps the samples of the whole band until its last pass.
+constexpr usize bytes_per_pixel = sizeof(glm::vec<3, u8>);
+
+[[nodiscard]] auto ppm_header(usize width, usize height) -> std::string
+{
+    return "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+}
+
+auto write_header(std::ofstream& file, usize width, usize height) -> void
+{
+    auto header = ppm_header(width, height);
+    file.write(header.data(), static_cast<std::streamsize>(header.size()));
+}
+
+// Converts the tiles of a band to 8 bits as they finish, straight into the staging buffer the band is written from.
+class BandSink final : public TileSink
+{
+public:
+    explicit BandSink(std::span<glm::vec<3, u8>> staging) : _staging{ staging } {}
+
+    auto set_band(const Tile& band) -> void { _band = band; }
+
+    auto tile_finished([[maybe_unused]] usize view, const Tile& tile, const ImageView<const glm::vec4>& pixels)
+        -> void override
+    {
+        TRACER_ASSERT(tile.x >= _band.x && tile.x + tile.width <= _band.x + _band.width);
+        TRACER_ASSERT(tile.y >= _band.y && tile.y + tile.height <= _band.y + _band.height);
+
+        for (usize y = 0; y < tile.height; y++)
+        {
+            auto& first = _staging[(tile.y - _band.y + y) * _band.width + tile.x - _band.x];
+            kernels().to_rgb8(glm::value_ptr(pixels[y, 0]), glm::value_ptr(first), tile.width);
+        }
+    }
+
+private:
+    std::span<glm::vec<3, u8>> _staging;
+    Tile _band{};
+};
+
+} // namespace
+
+auto render_to_file(const std::filesystem::path& path, usize width, usize height, const Scene& scene,
+                    const Camera& camera, const RenderParams& render_params, const StreamParams& stream_params,
+                    std::stop_token stop_token, volatile i32* progress) -> bool
+{
+    TRACER_ASSERT(width != 0 && height != 0);
+
+    if (progress)
+        *progress = 0;
+
+    auto file = std::ofstream{ path, std::ios::binary | std::ios::trunc };
+
+    if (!file)
+        return false;
+
+    write_header(file, width, height);
+
+    // Bands span the whole width of the frame whenever a full row fits in the working set. Otherwise bands are a
+    // single row tall and get split into pieces. Every band is streamed from all render threads into the staging
+    // buffer and written before the next one starts, so every write is sequential.
+    const auto band_bytes_per_pixel = bytes_per_pixel + (render_params.guiding ? guided_bytes_per_pixel : 0);
+    const auto max_pixels = std::max(stream_params.working_set_bytes / band_bytes_per_pixel, usize{ 1 });
+    const auto band_height = std::clamp(max_pixels / width, usize{ 1 }, height);
+    const auto band_width = std::min(max_pixels, width);
+
+    auto staging = std::vector<glm::vec<3, u8>>(band_width * band_height);
+    auto sink = BandSink{ staging };
+
+    for (usize band_y = 0; band_y < height; band_y += band_height)
+    {
+        for (usize band_x = 0; band_x < width; band_x += band_width)
+        {
+            auto band = Tile{
+                .x = band_x,
+                .y = band_y,
+                .width = std::min(band_width, width - band_x),
+                .height = std::min(band_height, height - band_y),
+            };
+
+            auto view = StreamView{
+                .width = width,
+                .height = height,
+                .region = band,
+                .camera = camera,
+                .render_params = render_params,
+            };
+
+            sink.set_band(band);
+            render_streamed(std::span{ &view, 1 }, scene, sink, stream_params.batch_params, stop_token);
+
+            if (stop_token.stop_requested())
+                return false;
+
+            file.write(reinterpret_cast<const char*>(staging.data()),
+                       static_cast<std::streamsize>(band.width * band.height * sizeof(glm::vec<3, u8>)));
+
+            if (!file)
+                return false;
+        }
+
+        if (progress)
+        {
+            auto rows_done = std::min(band_y + band_height, height);
+            *progress = static_cast<i32>(static_cast<float>(rows_done) / static_cast<float>(height) * 100.0f);
+        }
+    }
+
+    file.flush();
+    return static_cast<bool>(file);
+}
+
+auto write_ppm(const std::filesystem::path& path, const ImageView<const glm::vec4>& image) -> bool
+{
+    auto file = std::ofstream{ path, std::ios::binary | std::ios::trunc };
+
+    if (!file)
+        return false;
+
+    write_header(file, image.width(), image.height());
+
+    auto row = std::vector<glm::vec<3, u8>>(image.width());
+
+    for (usize y = 0; y < image.height() && !row.empty(); y++)
+    {
+        kernels().to_rgb8(glm::value_ptr(image[y, 0]), glm::value_ptr(row[0]), row.size());
+
+        file.write(reinterpret_cast<const char*>(row.data()),
+                   static_cast<std::streamsize>(row.size() * sizeof(glm::vec<3, u8>)));
+    }
+
+    file.flush();
+    return static_cast<bool>(file);
+}
+
+auto encode_ppm(const ImageView<const glm::vec4>& image) -> std::vector<u8>
+{
+    auto header = ppm_header(image.width(), image.height());
+    auto data = std::vector<u8>(header.begin(), header.end());
+    const auto pixel_count = image.width() * image.height();
+
+    if (pixel_count != 0)
+    {
+        // Images are stored row after row without padding.
+        data.resize(header.size() + pixel_count * 3);
+        kernels().to_rgb8(glm::value_ptr(image[0, 0]), data.data() + header.size(), pixel_count);
+    }
+
+    return data;
+}
+
+auto write_file(const std::filesystem::path& path, std::span<const u8> data) -> bool
+{
+    auto file = std::ofstream{ path, std::ios::binary | std::ios::trunc };
+
+    if (!file)
+        return false;
+
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    file.flush();
+    return static_cast<bool>(file);
+}
+
+} // namespace tracer
@@ -0,0 +1,234 @@
+#include "tracer/topology.hpp"
+
+#if defined(_WIN32)
+
+    #define NOMINMAX
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+
+#elif defined(__linux__)
+
+    #include <pthread.h>
+    #include <sched.h>
+
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "tracer/common.hpp"
+
+namespace tracer {
+
+namespace {
+
+#if defined(__linux__)
+
+[[nodiscard]] auto parse_u32(std::string_view text) -> std::optional<u32>
+{
+    u32 value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+    if (error != std::errc{} || end != text.data() + text.size())
+        return std::nullopt;
+
+    return value;
+}
+
+// Parses a CPU list such as "0-3,8-11".
+[[nodiscard]] auto parse_cpu_list(std::string_view text) -> std::optional<std::vector<u32>>
+{
+    auto cpus = std::vector<u32>{};
+
+    while (!text.empty() && text.back() == '\n')
+        text.remove_suffix(1);
+
+    while (!text.empty())
+    {
+        const auto comma = std::min(text.find(','), text.size());
+        const auto range = text.substr(0, comma);
+        const auto dash = range.find('-');
+
+        const auto first = parse_u32(range.substr(0, dash));
+        const auto last = dash == std::string_view::npos ? first : parse_u32(range.substr(dash + 1));
+
+        if (!first || !last || *last < *first)
+            return std::nullopt;
+
+        for (auto cpu = *first; cpu <= *last; cpu++)
+            cpus.push_back(cpu);
+
+        text = text.substr(std::min(comma + 1, text.size()));
+    }
+
+    return cpus;
+}
+
+[[nodiscard]] auto read_linux_nodes() -> std::vector<NumaNode>
+{
+    auto nodes = std::vector<NumaNode>{};
+    auto error = std::error_code{};
+
+    for (const auto& entry : std::filesystem::directory_iterator{ "/sys/devices/system/node", error })
+    {
+        const auto name = entry.path().filename().string();
+
+        if (!name.starts_with("node"))
+            continue;
+
+        const auto id = parse_u32(std::string_view{ name }.substr(4));
+        auto file = std::ifstream{ entry.path() / "cpulist" };
+        auto text = std::string{};
+
+        if (!id || !file || !std::getline(file, text))
+            continue;
+
+        if (auto cpus = parse_cpu_list(text); cpus && !cpus->empty())
+            nodes.push_back(NumaNode{ .id = *id, .cpus = std::move(*cpus) });
+    }
+
+    std::ranges::sort(nodes, {}, &NumaNode::id);
+    return nodes;
+}
+
+// The CPUs the process may run on, which taskset, cgroup cpusets and container limits narrow down from those the
+// machine has.
+[[nodiscard]] auto read_allowed_cpus() -> std::optional<std::vector<u32>>
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return std::nullopt;
+
+    auto cpus = std::vector<u32>{};
+
+    for (u32 cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+#endif
+
+} // namespace
+
+auto numa_nodes() -> std::vector<NumaNode>
+{
+#if defined(__linux__)
+    auto nodes = read_linux_nodes();
+    const auto allowed = read_allowed_cpus();
+
+    if (allowed && !allowed->empty())
+    {
+        for (auto& node : nodes)
+            std::erase_if(node.cpus, [&](u32 cpu) { return !std::ranges::binary_search(*allowed, cpu); });
+
+        std::erase_if(nodes, [](const NumaNode& node) { return node.cpus.empty(); });
+
+        if (nodes.empty())
+            return { NumaNode{ .id = 0, .cpus = *allowed } };
+    }
+
+    if (!nodes.empty())
+        return nodes;
+#endif
+
+    auto node = NumaNode{};
+    node.cpus.resize(std::max(usize{ std::thread::hardware_concurrency() }, usize{ 1 }));
+
+    for (usize i = 0; i < node.cpus.size(); i++)
+        node.cpus[i] = static_cast<u32>(i);
+
+    return { std::move(node) };
+}
+
+auto core_count([[maybe_unused]] std::span<const NumaNode> nodes) -> std::optional<usize>
+{
+#if defined(__linux__)
+    // Hardware threads of a core list the same siblings, which the first of them identifies.
+    auto cores = std::vector<u32>{};
+
+    for (const auto& node : nodes)
+    {
+        for (const auto cpu : node.cpus)
+        {
+            const auto path = std::filesystem::path{ "/sys/devices/system/cpu" } / ("cpu" + std::to_string(cpu))
+                              / "topology" / "thread_siblings_list";
+            auto file = std::ifstream{ path };
+            auto text = std::string{};
+
+            if (!file || !std::getline(file, text))
+                return std::nullopt;
+
+            const auto siblings = parse_cpu_list(text);
+
+            if (!siblings || siblings->empty())
+                return std::nullopt;
+
+            cores.push_back(siblings->front());
+        }
+    }
+
+    std::ranges::sort(cores);
+    const auto duplicates = std::ranges::unique(cores);
+    cores.erase(duplicates.begin(), duplicates.end());
+    return cores.size();
+#else
+    return std::nullopt;
+#endif
+}
+
+auto place_threads(std::span<const NumaNode> nodes, usize thread_count) -> std::vector<ThreadPlacement>
+{
+    auto placements = std::vector<ThreadPlacement>{};
+
+    if (nodes.empty())
+        return placements;
+
+    placements.reserve(thread_count);
+
+    for (usize thread = 0; thread < thread_count; thread++)
+    {
+        const auto node = thread % nodes.size();
+        const auto& cpus = nodes[node].cpus;
+        placements.push_back(ThreadPlacement{ .node = node, .cpu = cpus[thread / nodes.size() % cpus.size()] });
+    }
+
+    return placements;
+}
+
+auto pin_thread([[maybe_unused]] u32 cpu) -> bool
+{
+#if defined(_WIN32)
+    // Only the first processor group, which holds up to 64 CPUs.
+    if (cpu >= 64)
+        return false;
+
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << cpu) != 0;
+#elif defined(__linux__)
+    if (cpu >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+} // namespace tracer
@@ -0,0 +1,405 @@
+#include "tracer/wavefront_renderer.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <optional>
+#include <stop_token>
+#include <utility>
+#include <vector>
+
+#include "tracer/assert.hpp"
+#include "tracer/color.hpp"
+#include "tracer/common.hpp"
+#include "tracer/lighting.hpp"
+#include "tracer/material.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/random.hpp"
+#include "tracer/ray.hpp"
+#include "tracer/ray_sort.hpp"
+#include "tracer/scene.hpp"
+#include "tracer/software_renderer.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Samples traced together. Large enough to keep every stage busy over long arrays, small enough that the queues of a
+// wave stay within a few megabytes.
+constexpr usize wave_size = usize{ 1 } << 16;
+
+// Starts slightly off the surface, so that a bounce does not hit the surface it leaves due to rounding.
+constexpr auto hit_interval = Interval{ .min = 0.001, .max = +infinity };
+
+// Paths are sorted by the material they hit plus one, and by this key if they left the scene and are shaded by the
+// sky.
+constexpr u32 sky_key = 0;
+
+} // namespace
+
+auto WavefrontRenderer::PathQueue::ray(usize path) const -> Ray
+{
+    return Ray{ glm::dvec3{ origin_x[path], origin_y[path], origin_z[path] },
+                glm::dvec3{ direction_x[path], direction_y[path], direction_z[path] } };
+}
+
+auto WavefrontRenderer::PathQueue::previous(usize path) const -> std::optional<Hit>
+{
+    if (!sampled_lights[path])
+        return std::nullopt;
+
+    return Hit{ .point = previous_points[path], .normal = previous_normals[path] };
+}
+
+auto WavefrontRenderer::PathQueue::clear() -> void
+{
+    origin_x.clear();
+    origin_y.clear();
+    origin_z.clear();
+    direction_x.clear();
+    direction_y.clear();
+    direction_z.clear();
+    throughput.clear();
+    generators.clear();
+    samples.clear();
+    previous_points.clear();
+    previous_normals.clear();
+    sampled_lights.clear();
+}
+
+auto WavefrontRenderer::PathQueue::reserve(usize size) -> void
+{
+    origin_x.reserve(size);
+    origin_y.reserve(size);
+    origin_z.reserve(size);
+    direction_x.reserve(size);
+    direction_y.reserve(size);
+    direction_z.reserve(size);
+    throughput.reserve(size);
+    generators.reserve(size);
+    samples.reserve(size);
+    previous_points.reserve(size);
+    previous_normals.reserve(size);
+    sampled_lights.reserve(size);
+}
+
+auto WavefrontRenderer::PathQueue::push(const Ray& ray, const glm::vec3& path_throughput, const Random& generator,
+                                        u32 sample, const std::optional<Hit>& previous) -> void
+{
+    origin_x.push_back(ray.origin().x);
+    origin_y.push_back(ray.origin().y);
+    origin_z.push_back(ray.origin().z);
+    direction_x.push_back(ray.direction().x);
+    direction_y.push_back(ray.direction().y);
+    direction_z.push_back(ray.direction().z);
+    throughput.push_back(path_throughput);
+    generators.push_back(generator);
+    samples.push_back(sample);
+    previous_points.push_back(previous ? previous->point : glm::dvec3{ 0.0 });
+    previous_normals.push_back(previous ? previous->normal : glm::dvec3{ 0.0 });
+    sampled_lights.push_back(previous.has_value());
+}
+
+auto WavefrontRenderer::HitQueue::resize(usize size) -> void
+{
+    points.resize(size);
+    normals.resize(size);
+    front_faces.resize(size);
+    objects.resize(size);
+    keys.resize(size);
+}
+
+auto WavefrontRenderer::ShadowQueue::clear() -> void
+{
+    rays.clear();
+    intervals.clear();
+    radiance.clear();
+    samples.clear();
+}
+
+WavefrontRenderer::WavefrontRenderer(const ImageView<glm::vec4>& image, const Scene& scene, const Camera& camera,
+                                     const RenderParams& render_params)
+    : WavefrontRenderer{ image, Tile{ .x = 0, .y = 0, .width = image.width(), .height = image.height() },
+                         image.width(), image.height(), scene, camera, render_params }
+{}
+
+WavefrontRenderer::WavefrontRenderer(const ImageView<glm::vec4>& image, const Tile& tile, usize frame_width,
+                                     usize frame_height, const Scene& scene, const Camera& camera,
+                                     const RenderParams& render_params)
+    : _image{ image }, _tile{ tile }, _frame_width{ frame_width }, _frame_height{ frame_height }, _scene{ &scene },
+      _camera{ camera }, _render_params{ render_params },
+      _viewport{ SoftwareRenderer::create_viewport(_frame_width, _frame_height) }
+{
+    TRACER_ASSERT(_image.width() == _tile.width && _image.height() == _tile.height);
+    TRACER_ASSERT(_tile.x + _tile.width <= _frame_width && _tile.y + _tile.height <= _frame_height);
+}
+
+auto WavefrontRenderer::render(std::stop_token stop_token, volatile i32* progress) -> void
+{
+    if (progress)
+        *progress = 0;
+
+    TRACER_ASSERT(_render_params.samples != 0);
+
+    const auto pixel_count = _tile.width * _tile.height;
+    const auto sample_count = pixel_count * _render_params.samples;
+    auto sums = std::vector<glm::vec3>(pixel_count, glm::vec3{ 0.0f });
+
+    _paths.reserve(std::min(wave_size, sample_count));
+    _next_paths.reserve(std::min(wave_size, sample_count));
+
+    for (usize first_sample = 0; first_sample < sample_count; first_sample += wave_size)
+    {
+        const auto wave_samples = std::min(wave_size, sample_count - first_sample);
+        generate(first_sample, wave_samples);
+
+        for (usize depth = 0; depth < _render_params.max_depth && _paths.size() != 0; depth++)
+        {
+            intersect();
+            sort_by_material();
+            shade();
+            trace_shadows();
+
+            // Paths still going after the last bounce would only ever contribute black.
+            if (depth + 1 == _render_params.max_depth)
+                break;
+
+            extend();
+
+            if (_render_params.sort_rays)
+                sort_rays();
+        }
+
+        // Samples of a pixel are consecutive, so every pixel sums its samples in the same order as SoftwareRenderer.
+        for (usize i = 0; i < wave_samples; i++)
+            sums[(first_sample + i) / _render_params.samples] += _radiance[i];
+
+        if (progress)
+        {
+            *progress = static_cast<i32>(static_cast<float>(first_sample + wave_samples)
+                                         / static_cast<float>(sample_count) * 100.0f);
+        }
+
+        if (stop_token.stop_requested())
+            return;
+    }
+
+    for (usize i = 0; i < pixel_count; i++)
+    {
+        auto color = sums[i] / static_cast<float>(_render_params.samples);
+        color = gamma_correction(color);
+        color = glm::clamp(color, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
+
+        _image[i / _tile.width, i % _tile.width] = glm::vec4{ color, 1.0f };
+    }
+
+    if (progress)
+        *progress = 100;
+}
+
+auto WavefrontRenderer::pixel(usize x, usize y) const -> Pixel
+{
+    const auto pixel_position_relative_to_camera =
+        glm::dvec3{ ((static_cast<double>(x) + 0.5) / static_cast<double>(_frame_width) - 0.5) * _viewport.width,
+                    -(((static_cast<double>(y) + 0.5) / static_cast<double>(_frame_height) - 0.5) * _viewport.height),
+                    -_camera.focal_length };
+
+    TRACER_ASSERT(_camera.focal_length != 0.0);
+
+    return Pixel{
+        .position = _camera.position + pixel_position_relative_to_camera,
+        .size = glm::dvec2{ _viewport.width / static_cast<double>(_frame_width),
+                            _viewport.height / static_cast<double>(_frame_height) },
+    };
+}
+
+auto WavefrontRenderer::generate(usize first_sample, usize sample_count) -> void
+{
+    _paths.clear();
+    _radiance.assign(sample_count, glm::vec3{ 0.0f });
+
+    for (usize i = 0; i < sample_count; i++)
+    {
+        const auto pixel_in_tile = (first_sample + i) / _render_params.samples;
+        const auto sample_index = (first_sample + i) % _render_params.samples;
+        const auto x = _tile.x + pixel_in_tile % _tile.width;
+        const auto y = _tile.y + pixel_in_tile / _tile.width;
+        const auto current_pixel = pixel(x, y);
+
+        auto generator = Random::for_sample(_render_params.seed, y * _frame_width + x, sample_index);
+        auto offset = glm::dvec2{ generator.get_double(-0.5, 0.5), generator.get_double(-0.5, 0.5) };
+        offset *= current_pixel.size;
+
+        auto sample_position = current_pixel.position + glm::dvec3{ offset.x, offset.y, 0.0 };
+        auto ray = Ray{ _camera.position, glm::normalize(sample_position - _camera.position) };
+
+        _paths.push(ray, glm::vec3{ 1.0f }, generator, static_cast<u32>(i), std::nullopt);
+    }
+}
+
+auto WavefrontRenderer::intersect() -> void
+{
+    _hits.resize(_paths.size());
+
+    for (usize i = 0; i < _paths.size(); i++)
+    {
+        if (auto hit = _scene->closest_hit(_paths.ray(i), hit_interval))
+        {
+            TRACER_ASSERT(hit->object);
+
+            _hits.points[i] = hit->point;
+            _hits.normals[i] = hit->normal;
+            _hits.front_faces[i] = hit->front_face;
+            _hits.objects[i] = hit->object;
+            _hits.keys[i] = hit->material + 1;
+        }
+        else
+        {
+            _hits.keys[i] = sky_key;
+        }
+    }
+}
+
+auto WavefrontRenderer::sort_by_material() -> void
+{
+    // Counting sort, stable so that paths of the same material keep the order of their pixels.
+    auto& offsets = _material_offsets;
+    offsets.assign(_scene->materials().size() + 2, 0);
+
+    for (auto key : _hits.keys)
+        offsets[usize{ key } + 1]++;
+
+    for (usize key = 1; key < offsets.size(); key++)
+        offsets[key] += offsets[key - 1];
+
+    _order.resize(_paths.size());
+
+    for (usize i = 0; i < _paths.size(); i++)
+        _order[offsets[_hits.keys[i]]++] = static_cast<u32>(i);
+}
+
+auto WavefrontRenderer::shade() -> void
+{
+    const auto& materials = _scene->materials();
+    _shadows.clear();
+
+    for (auto path : _order)
+    {
+        const auto& throughput = _paths.throughput[path];
+        const auto sample = _paths.samples[path];
+        const auto key = _hits.keys[path];
+
+        if (key == sky_key)
+        {
+            const auto direction = _paths.ray(path).direction();
+            const auto previous = _paths.previous(path);
+            auto weight = previous ? environment_weight(*_scene, *previous, direction) : 1.0f;
+            _radiance[sample] += throughput * environment_radiance(*_scene, direction) * weight;
+            continue;
+        }
+
+        const auto& material = materials[key - 1];
+
+        switch (material.type)
+        {
+        case MaterialType::Emissive:
+        {
+            const auto previous = _paths.previous(path);
+            auto weight = previous ? emission_weight(*_scene, *previous, _paths.ray(path).direction(),
+                                                     *_hits.objects[path])
+                                   : 1.0f;
+            _radiance[sample] += throughput * material.emission * weight;
+            break;
+        }
+        case MaterialType::Diffuse:
+        {
+            auto hit = Hit{ .point = _hits.points[path], .normal = _hits.normals[path] };
+
+            if (auto light = sample_light(*_scene, hit, material.albedo, _paths.generators[path]))
+            {
+                _shadows.rays.push_back(light->ray);
+                _shadows.intervals.push_back(light->interval);
+                _shadows.radiance.push_back(throughput * light->radiance);
+                _shadows.samples.push_back(sample);
+            }
+
+            break;
+        }
+        case MaterialType::Metal:
+        case MaterialType::Dielectric:
+            // Near-specular surfaces only scatter, which extend() does.
+            break;
+        }
+    }
+}
+
+auto WavefrontRenderer::trace_shadows() -> void
+{
+    for (usize i = 0; i < _shadows.rays.size(); i++)
+    {
+        if (!_scene->occluded(_shadows.rays[i], _shadows.intervals[i]))
+            _radiance[_shadows.samples[i]] += _shadows.radiance[i];
+    }
+}
+
+auto WavefrontRenderer::extend() -> void
+{
+    const auto& materials = _scene->materials();
+
+    // Rebuilding the queue from the paths that go on compacts it, and keeps paths of the same material together.
+    _next_paths.clear();
+
+    for (auto path : _order)
+    {
+        const auto key = _hits.keys[path];
+
+        if (key == sky_key)
+            continue;
+
+        const auto& material = materials[key - 1];
+        const auto ray = _paths.ray(path);
+        const auto surface = Hit{
+            .point = _hits.points[path],
+            .normal = _hits.normals[path],
+            .front_face = _hits.front_faces[path] != 0,
+        };
+
+        auto generator = _paths.generators[path];
+        auto scattered = scatter(material, ray, surface, generator);
+
+        if (!scattered)
+            continue;
+
+        _next_paths.push(Ray{ surface.point, scattered->direction }, _paths.throughput[path] * scattered->attenuation,
+                         generator, _paths.samples[path],
+                         material.type == MaterialType::Diffuse ? std::optional{ surface } : std::nullopt);
+    }
+
+    std::swap(_paths, _next_paths);
+}
+
+auto WavefrontRenderer::sort_rays() -> void
+{
+    const auto bounds = _scene->bvh().bounds();
+    _sort_keys.resize(_paths.size());
+
+    for (usize i = 0; i < _paths.size(); i++)
+        _sort_keys[i] = ray_sort_key(_paths.ray(i), bounds);
+
+    _next_paths.clear();
+
+    for (auto path : _ray_sorter.sort(_sort_keys))
+    {
+        _next_paths.push(_paths.ray(path), _paths.throughput[path], _paths.generators[path], _paths.samples[path],
+                         _paths.previous(path));
+    }
+
+    std::swap(_paths, _next_paths);
+}
+
+} // namespace tracer
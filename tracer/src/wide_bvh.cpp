@@ -0,0 +1,298 @@
+#include "tracer/wide_bvh.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "tracer/aabb.hpp"
+#include "tracer/assert.hpp"
+#include "tracer/bvh.hpp"
+#include "tracer/common.hpp"
+#include "tracer/kernels.hpp"
+#include "tracer/numeric.hpp"
+#include "tracer/object.hpp"
+#include "tracer/ray.hpp"
+
+namespace tracer {
+
+namespace {
+
+// Stack entries with this bit set refer to a leaf child, as the node index shifted left by 3 and the child's slot.
+constexpr u32 leaf_flag = 0x80000000u;
+
+[[nodiscard]] auto round_down(double value) -> float
+{
+    auto result = static_cast<float>(value);
+    return static_cast<double>(result) > value ? std::nextafter(result, -std::numeric_limits<float>::infinity())
+                                               : result;
+}
+
+[[nodiscard]] auto exponent_scale(i8 exponent) -> float
+{
+    return std::bit_cast<float>(static_cast<u32>(exponent + 127) << 23);
+}
+
+// No default member initializers, so the traversal stack isn't cleared on every query.
+struct StackEntry
+{
+    u32 reference;
+    float t;
+};
+
+} // namespace
+
+template<usize Width> WideBvh<Width>::WideBvh(const Bvh& bvh) : _indices{ bvh._indices }
+{
+    if (bvh._nodes.empty())
+        return;
+
+    _nodes.reserve(bvh._nodes.size() / (Width / 2) + 1);
+    collapse(bvh, 0);
+}
+
+template<usize Width> auto WideBvh<Width>::collapse(const Bvh& bvh, u32 binary_node) -> u32
+{
+    // Gather up to Width descendants by repeatedly opening the interior child with the largest surface area, which is
+    // the one most likely to be hit.
+    auto children = std::array<u32, Width>{};
+    usize child_count = 0;
+
+    const auto& root = bvh._nodes[binary_node];
+
+    if (root.count != 0)
+    {
+        children[child_count++] = binary_node;
+    }
+    else
+    {
+        children[child_count++] = binary_node + 1;
+        children[child_count++] = root.offset;
+    }
+
+    while (child_count < Width)
+    {
+        auto best = Width;
+        auto best_area = -1.0;
+
+        for (usize i = 0; i < child_count; i++)
+        {
+            const auto& node = bvh._nodes[children[i]];
+
+            if (node.count == 0 && node.bounds.surface_area() > best_area)
+            {
+                best = i;
+                best_area = node.bounds.surface_area();
+            }
+        }
+
+        if (best == Width)
+            break;
+
+        const auto opened = children[best];
+        children[best] = opened + 1;
+        children[child_count++] = bvh._nodes[opened].offset;
+    }
+
+    const auto node_index = static_cast<u32>(_nodes.size());
+    TRACER_ASSERT(node_index < (leaf_flag >> 3));
+    _nodes.emplace_back();
+
+    auto bounds = Aabb{};
+
+    for (usize i = 0; i < child_count; i++)
+        bounds.expand(bvh._nodes[children[i]].bounds);
+
+    // Quantize the child boxes conservatively: the origin is rounded down, minimums down and maximums up.
+    auto origin = glm::vec3{ round_down(bounds.min.x), round_down(bounds.min.y), round_down(bounds.min.z) };
+    auto exponent = std::array<i8, 3>{};
+    auto scale = glm::vec3{ 0.0f };
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        auto extent = bounds.max[axis] - static_cast<double>(origin[axis]);
+        auto e = extent > 0.0 ? static_cast<int>(std::ceil(std::log2(extent / 255.0))) : -100;
+        e = std::clamp(e, -100, 127);
+
+        while (e < 127 && static_cast<double>(origin[axis]) + 255.0 * std::ldexp(1.0, e) < bounds.max[axis])
+            e++;
+
+        exponent[static_cast<usize>(axis)] = static_cast<i8>(e);
+        scale[axis] = exponent_scale(static_cast<i8>(e));
+    }
+
+    auto quantize_min = [&](double value, int axis) {
+        auto steps = std::floor((value - static_cast<double>(origin[axis])) / static_cast<double>(scale[axis]));
+        return static_cast<u8>(std::clamp(steps, 0.0, 255.0));
+    };
+
+    auto quantize_max = [&](double value, int axis) {
+        auto steps = std::ceil((value - static_cast<double>(origin[axis])) / static_cast<double>(scale[axis]));
+        return static_cast<u8>(std::clamp(steps, 0.0, 255.0));
+    };
+
+    auto child_nodes = std::array<u32, Width>{};
+    auto counts = std::array<u16, Width>{};
+
+    for (usize i = 0; i < child_count; i++)
+    {
+        const auto& child = bvh._nodes[children[i]];
+        counts[i] = child.count;
+        child_nodes[i] = child.count != 0 ? child.offset : collapse(bvh, children[i]);
+    }
+
+    // Collapsing the children may have reallocated the nodes.
+    auto& node = _nodes[node_index];
+    node.origin = origin;
+    node.exponent = exponent;
+    node.child_count = static_cast<u8>(child_count);
+    node.child = child_nodes;
+    node.count = counts;
+
+    for (usize i = 0; i < child_count; i++)
+    {
+        const auto& child_bounds = bvh._nodes[children[i]].bounds;
+        node.min_x[i] = quantize_min(child_bounds.min.x, 0);
+        node.min_y[i] = quantize_min(child_bounds.min.y, 1);
+        node.min_z[i] = quantize_min(child_bounds.min.z, 2);
+        node.max_x[i] = quantize_max(child_bounds.max.x, 0);
+        node.max_y[i] = quantize_max(child_bounds.max.y, 1);
+        node.max_z[i] = quantize_max(child_bounds.max.z, 2);
+    }
+
+    return node_index;
+}
+
+template<usize Width>
+auto WideBvh<Width>::closest_hit(ObjectSpan objects, const Ray& ray, Interval interval) const -> std::optional<Hit>
+{
+    auto closest = std::optional<Hit>{};
+
+    traverse(ray, interval, [&](u32 first, u32 count) {
+        for (u32 i = first; i < first + count; i++)
+        {
+            if (auto hit = objects[_indices[i]]->hit(ray, interval))
+            {
+                closest = hit;
+                interval.max = closest->t;
+            }
+        }
+
+        return false;
+    });
+
+    return closest;
+}
+
+template<usize Width>
+auto WideBvh<Width>::occluded(ObjectSpan objects, const Ray& ray, Interval interval) const -> bool
+{
+    auto occluded = false;
+
+    traverse(ray, interval, [&](u32 first, u32 count) {
+        for (u32 i = first; i < first + count && !occluded; i++)
+            occluded = objects[_indices[i]]->occludes(ray, interval);
+
+        return occluded;
+    });
+
+    return occluded;
+}
+
+template<usize Width>
+template<typename LeafVisitor>
+auto WideBvh<Width>::traverse(const Ray& ray, Interval& interval, LeafVisitor&& visit) const -> void
+{
+    if (_nodes.empty())
+        return;
+
+    const auto origin = glm::vec3{ ray.origin() };
+    const auto inverse_direction = 1.0f / glm::vec3{ ray.direction() };
+    const auto negative = std::array<bool, 3>{ inverse_direction.x < 0.0f, inverse_direction.y < 0.0f,
+                                               inverse_direction.z < 0.0f };
+
+    // Picked once per query rather than per node.
+    const auto intersect_children = Width == 4 ? kernels().intersect_children4 : kernels().intersect_children8;
+
+    // Every node leaves at most Width - 1 siblings on the stack for the children it pushes. Wide nodes are interior
+    // nodes of the Bvh they were collapsed from, whose build bounds their depth, so the stack can't overflow.
+    std::array<StackEntry, Bvh::max_depth * Width> stack;
+    usize stack_size = 0;
+    stack[stack_size++] = StackEntry{ .reference = 0, .t = static_cast<float>(interval.min) };
+
+    while (stack_size != 0)
+    {
+        const auto entry = stack[--stack_size];
+
+        if (static_cast<double>(entry.t) * box_entry_slack > interval.max)
+            continue;
+
+        if (entry.reference & leaf_flag)
+        {
+            const auto& parent = _nodes[(entry.reference & ~leaf_flag) >> 3];
+            const auto slot = entry.reference & 7;
+
+            if (visit(parent.child[slot], u32{ parent.count[slot] }))
+                return;
+
+            continue;
+        }
+
+        const auto& node = _nodes[entry.reference];
+
+        // Slab test against every child at once. The near and far planes only depend on the direction of the ray.
+        const auto relative_origin = node.origin - origin;
+        const auto query = ChildBoxQuery{
+            .near = { negative[0] ? node.max_x.data() : node.min_x.data(),
+                      negative[1] ? node.max_y.data() : node.min_y.data(),
+                      negative[2] ? node.max_z.data() : node.min_z.data() },
+            .far = { negative[0] ? node.min_x.data() : node.max_x.data(),
+                     negative[1] ? node.min_y.data() : node.max_y.data(),
+                     negative[2] ? node.min_z.data() : node.max_z.data() },
+            .scale = { exponent_scale(node.exponent[0]), exponent_scale(node.exponent[1]),
+                       exponent_scale(node.exponent[2]) },
+            .relative_origin = { relative_origin.x, relative_origin.y, relative_origin.z },
+            .inverse_direction = { inverse_direction.x, inverse_direction.y, inverse_direction.z },
+            .interval_min = static_cast<float>(interval.min),
+            .interval_max = static_cast<float>(std::min(interval.max, double{ std::numeric_limits<float>::max() })),
+            .child_count = node.child_count,
+        };
+
+        auto t_near = std::array<float, Width>{};
+        const auto hit = intersect_children(query, t_near.data());
+
+        // Push the children that were hit from farthest to nearest, so the nearest is visited first.
+        std::array<StackEntry, Width> order;
+        usize hit_count = 0;
+
+        for (usize i = 0; i < Width; i++)
+        {
+            if ((hit >> i & 1) == 0)
+                continue;
+
+            auto reference = node.count[i] != 0 ? leaf_flag | (entry.reference << 3) | static_cast<u32>(i)
+                                                : node.child[i];
+            auto position = hit_count++;
+
+            for (; position > 0 && order[position - 1].t < t_near[i]; position--)
+                order[position] = order[position - 1];
+
+            order[position] = StackEntry{ .reference = reference, .t = t_near[i] };
+        }
+
+        TRACER_ASSERT(stack_size + hit_count <= stack.size());
+
+        for (usize i = 0; i < hit_count; i++)
+            stack[stack_size++] = order[i];
+    }
+}
+
+template class WideBvh<4>;
+template class WideBvh<8>;
+
+} // namespace tracer